@@ -27,6 +27,9 @@ extern "C" {
 
 #include <epicsMutex.h>
 #include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
+#include <epicsTypes.h>
 #include <epicsString.h>
 #include <epicsInterrupt.h>
 #include <cantProceed.h>
@@ -59,12 +62,61 @@ extern "C" {
 #define MODE_CHANNEL    33              /* Mode Control Register         */
 #define STATUS_CHANNEL  34              /* Status Register               */
 #define DIAG_CHANNEL    35              /* Diagnostic Test Mode register */
+#define TRIGGER_CHANNEL 36              /* driver: snapshot all cards    */
 
 /* data types for ai_read */
 #define DATA_TYPE       'D'             /* analog data (raw val is float)   */
 #define RANGE_TYPE      'R'             /* channel range (raw val is long)  */
 #define AC_TYPE         'A'             /* AC measurement (raw val is long) */
 #define CSR_TYPE        'B'             /* binary status or control register */
+#define LIMIT_TYPE      'L'             /* bi: comparator state (parm LH, LL or L) */
+#define PERF_TYPE       'P'             /* driver counter (signal is counter no) */
+
+/* index of DATA_TYPE, RANGE_TYPE and AC_TYPE in per-type tables */
+#define VSAM_IDX_DATA   0
+#define VSAM_IDX_RANGE  1
+#define VSAM_IDX_AC     2
+#define VSAM_NUM_IDX    3
+
+/* data types for waveforms */
+#define HIST_TYPE       'H'             /* latency histogram bins (signal is hist) */
+#define PCTL_TYPE       'Q'             /* p50,p99,max,count (signal is hist)      */
+#define FFT_TYPE        'F'             /* spectrum (signal is channel, or         */
+                                        /* VSAM_NUM_CHANS for the frequencies);    */
+                                        /* on ai, dominant frequency of channel    */
+#define DERIV_TYPE      'X'             /* derived channels (signal ignored);      */
+                                        /* on ai, derived channel n (signal n)     */
+#define CAPT_TYPE       'T'             /* transient capture (signal is channel,   */
+                                        /* or VSAM_NUM_CHANS for the time axis)    */
+#define TREND_TYPE      'M'             /* trend level, eg. M2X (signal is channel, */
+                                        /* or VSAM_NUM_CHANS for the time axis)    */
+#define HISTORY_TYPE    'Z'             /* compressed history (signal is channel), */
+                                        /* ZT for the point times; ZQ, ZQT slice   */
+                                        /* of query n (signal n); on ao, ZS, ZE    */
+                                        /* and ZC set start, end and channel of n  */
+
+/* driver counters, selected by the signal number of PERF_TYPE records */
+#define VSAM_CNT_DATA_READS    0        /* D32 reads of data words           */
+#define VSAM_CNT_RANGE_READS   1        /* D32 reads of range words          */
+#define VSAM_CNT_AC_READS      2        /* D32 reads of AC words             */
+#define VSAM_CNT_CSR_READS     3        /* reads of the status register      */
+#define VSAM_CNT_MODE_WRITES   4        /* writes to mode control register   */
+#define VSAM_CNT_RESET_WRITES  5        /* writes to reset register          */
+#define VSAM_CNT_DIAG_WRITES   6        /* writes to diagnostic register     */
+#define VSAM_CNT_BUS_ERRORS    7        /* failed bus probes                 */
+#define VSAM_CNT_SNAPSHOTS     8        /* whole-card acquisitions           */
+#define VSAM_CNT_RECORDS       9        /* record reads/writes served        */
+#define VSAM_CNT_ACQ_TIME      10       /* last acquisition duration (usec)  */
+#define VSAM_CNT_DATA_AGE      11       /* seconds since last fresh data     */
+#define VSAM_CNT_THROTTLED     12       /* waits for the bus budget          */
+#define VSAM_CNT_THROTTLE_TIME 13       /* total wait for the budget (usec)  */
+#define VSAM_CNT_TRIGGERS      14       /* triggered snapshots, all cards    */
+#define VSAM_CNT_TRIG_SKEW     15       /* last trigger, first to last card (usec) */
+#define VSAM_CNT_TRIG_OFFSET   16       /* last trigger to this card (usec)  */
+#define VSAM_CNT_CAPTURES      17       /* transient captures frozen         */
+#define VSAM_CNT_CAPT_CHAN     18       /* channel of the last capture       */
+#define VSAM_CNT_LIMIT_TRIPS   19       /* comparators going into alarm      */
+#define VSAM_NUM_COUNTERS      20
 
 /* bits in Mode Control Register */
 #define SET_FAST_SCAN   0x00000001      /* 0: normal scan; 1: fast scan       */
@@ -110,6 +162,577 @@ typedef volatile struct  {
 	unsigned long	padding[3];
 } VSAMMEM;
 
+/*
+ * Copy of the card memory taken by a whole-card acquisition.
+ * Range and AC words are kept exactly as read over D32, 
+ * so the same mask/shift from VSAMPVT applies to them.
+ */
+typedef struct VSAMSNAP {
+  epicsTimeStamp  stamp;                    /* time acquisition started */
+  unsigned long   status;                   /* status register          */
+  float           data[VSAM_NUM_CHANS];
+  unsigned long   range[VSAM_NUM_CHANS/4];
+  unsigned long   ac[VSAM_NUM_CHANS/2];
+} VSAMSNAP;
+
+/*
+ * Channels that have records, registered by init_record().
+ * A whole-card acquisition reads only the D32 words holding
+ * a registered channel.  With nothing registered the whole
+ * card is read.
+ */
+typedef struct VSAMUSE {
+  unsigned long   data_mask;                /* bit n: channel n data used  */
+  unsigned long   range_mask;               /* range used (also for AC)    */
+  unsigned long   ac_mask;
+  unsigned short  csr;                      /* status register has records */
+} VSAMUSE;
+
+/* Per-card driver counters, see VSAM_CNT_xxx */
+typedef struct VSAMSTATS {
+  unsigned long   data_reads;
+  unsigned long   range_reads;
+  unsigned long   ac_reads;
+  unsigned long   csr_reads;
+  unsigned long   mode_writes;
+  unsigned long   reset_writes;
+  unsigned long   diag_writes;
+  unsigned long   bus_errors;
+  unsigned long   snapshots;
+  unsigned long   records;
+  unsigned long   acq_usec;                 /* last acquisition duration */
+  epicsTimeStamp  fresh;                    /* last analog data acquired */
+  unsigned long   throttled;                /* waits for the bus budget  */
+  unsigned long   throttle_usec;            /* total wait for the budget */
+  unsigned long   trig_usec;                /* last trigger to this card */
+} VSAMSTATS;
+
+/*
+ * Latency histograms of the driver hot paths, one set per card.
+ * Bin 0 counts calls of up to 1 usec, bin n calls of more than
+ * 2**(n-1) and up to 2**n usec; the last bin also takes the overflow.
+ * Bins are plain counters updated without a lock, so a concurrent
+ * update from two scan tasks may occasionally lose one count.
+ */
+#define VSAM_HIST_AI_READ   0           /* ai_VSAM_read()       */
+#define VSAM_HIST_INPUT     1           /* input_VSAM_driver()  */
+#define VSAM_HIST_OUTPUT    2           /* output_VSAM_driver() */
+#define VSAM_HIST_ACQUIRE   3           /* VSAM_acquire()       */
+#define VSAM_NUM_HISTS      4
+#define VSAM_HIST_BINS      24
+
+typedef struct VSAMHIST {
+  unsigned long   bin[VSAM_HIST_BINS];
+  unsigned long   count;
+  unsigned long   max_usec;
+  double          sum_usec;
+} VSAMHIST;
+
+/*
+ * Driver trace events.  Phases are recorded as a begin event
+ * followed by the same event with VSAM_TRC_END set, so that
+ * VSAM_trace_dump() can report how long each phase took.
+ */
+#define VSAM_TRC_END         0x80       /* end of a phase            */
+#define VSAM_TRC_CONFIG      1          /* VSAM_config, arg=address  */
+#define VSAM_TRC_INIT        2          /* phase: VSAM_init          */
+#define VSAM_TRC_PROBE       3          /* phase: probe, arg=status  */
+#define VSAM_TRC_CLEAR       4          /* phase: VSAM_clear         */
+#define VSAM_TRC_FWREAD      5          /* phase: fw read, arg=rev   */
+#define VSAM_TRC_CALIB       6          /* phase: calibration check  */
+#define VSAM_TRC_CALIB_TRY   7          /* arg=status register       */
+#define VSAM_TRC_RESET       8          /* reset register written    */
+#define VSAM_TRC_MODE        9          /* arg=mode control value    */
+#define VSAM_TRC_DIAG        10         /* diag register written     */
+#define VSAM_TRC_QUARANTINE  11         /* card left out, arg=status */
+#define VSAM_TRC_BUSERR      12         /* bus error on acquisition  */
+#define VSAM_TRC_SETTLE      13         /* phase: scan mode switch, arg=mode */
+#define VSAM_NUM_TRC_EVENTS  14
+
+#define VSAM_TRACE_SIZE      1024       /* entries, power of 2       */
+
+typedef struct VSAMTRACE {
+  double          sec;                      /* VSAM_clock_sec()          */
+  short           card;
+  unsigned short  event;
+  unsigned long   arg;
+} VSAMTRACE;
+
+/* formats for the stats export */
+#define VSAM_EXPORT_JSON     0
+#define VSAM_EXPORT_PROM     1          /* Prometheus exposition text */
+
+/*
+ * Driver-side acquisition schedule of a card.  Each channel
+ * and data type has its own period; a pool worker reads whatever
+ * is due in a single pass and posts I/O Intr for the channels
+ * it read.  Records of scheduled channels are served from the
+ * snapshot instead of the bus.  The features that put channels
+ * on the schedule each keep the period they asked for; a channel
+ * runs at the one period they all agree on.
+ */
+#define VSAM_SCHED_SET       0          /* VSAM_sched_set()          */
+#define VSAM_SCHED_LIMIT     1          /* comparators               */
+#define VSAM_SCHED_AVG       2
+#define VSAM_SCHED_FILT      3
+#define VSAM_SCHED_FFT       4
+#define VSAM_SCHED_CAPT      5
+#define VSAM_SCHED_USERS     6
+
+/* channels first..last as a mask */
+#define VSAM_CHAN_RANGE(first,last) ((0xffffffffUL>>(31-(last))) & (0xffffffffUL<<(first)))
+
+typedef struct VSAMSCHED {
+  double          want[VSAM_SCHED_USERS][VSAM_NUM_IDX][VSAM_NUM_CHANS]; /* asked by each */
+  double          period[VSAM_NUM_IDX][VSAM_NUM_CHANS]; /* sec, 0 = off  */
+  double          due[VSAM_NUM_IDX][VSAM_NUM_CHANS];    /* sec from start */
+  unsigned long   mask[VSAM_NUM_IDX];       /* channels scheduled        */
+  double          next;                     /* earliest due time         */
+  int             owner;                    /* pool worker of this card  */
+  int             busy;                     /* a worker is reading it    */
+  unsigned long   passes;                   /* acquisitions made         */
+  unsigned long   late;                     /* due times that were missed */
+  unsigned long   stolen;                   /* passes made by other workers */
+} VSAMSCHED;
+
+/*
+ * Transient capture of a card.  Every acquisition of the capture
+ * type, or on a schedule every pass of it, is a sample of the 32
+ * channels kept in a ring, NaN for those not read.  A channel
+ * crossing its level arms the post-trigger count; when it runs
+ * out the ring is frozen into the published buffer and capture
+ * goes on, so it re-arms by itself.
+ */
+#define VSAM_EDGE_OFF        0
+#define VSAM_EDGE_RISING     1
+#define VSAM_EDGE_FALLING    -1
+#define VSAM_EDGE_BOTH       2
+#define VSAM_CAPT_MAX        8192       /* most samples, pre + post  */
+
+typedef struct VSAMCAPT {
+  char            type;                     /* DATA_TYPE or AC_TYPE      */
+  unsigned long   pre;                      /* samples before the trigger */
+  unsigned long   post;                     /* trigger sample and after  */
+  unsigned long   size;                     /* pre + post                */
+  unsigned long   use;                      /* channels with records or a
+                                               trigger                   */
+  double          period;                   /* sec, 0 = not scheduled    */
+  unsigned long   mask;                     /* scheduled channels, a sample
+                                               must read them all        */
+  float           level[VSAM_NUM_CHANS];
+  short           edge[VSAM_NUM_CHANS];     /* VSAM_EDGE_xxx             */
+  float           last[VSAM_NUM_CHANS];     /* previous sample           */
+  unsigned long   primed;                   /* bit n: last[n] is a sample */
+  float          *ring;                     /* size samples x 32 chans   */
+  epicsTimeStamp *ring_stamp;
+  unsigned long   head;                     /* next slot of the ring     */
+  unsigned long   filled;                   /* samples since configured  */
+  unsigned long   remain;                   /* post samples to go, 0 = armed */
+  short           trig_chan;                /* channel that crossed      */
+  unsigned long   trig_slot;
+  float          *frozen;                   /* chan n at frozen[n*size]  */
+  double         *frozen_time;              /* sec from the trigger      */
+  short           chan;                     /* of the frozen capture     */
+  epicsTimeStamp  stamp;                    /* of the trigger sample     */
+  unsigned long   count;                    /* captures frozen           */
+  IOSCANPVT       ioscan;                   /* posted on every capture   */
+} VSAMCAPT;
+
+/*
+ * High and low comparators on the data of each channel, evaluated
+ * on every acquisition that reads the channel.  A comparator trips
+ * at its limit and resets once the value is back by the hysteresis.
+ * State bit VSAM_LIMIT_HIGH/LOW of a channel is read by bi records.
+ */
+#define VSAM_LIMIT_HIGH      0x1
+#define VSAM_LIMIT_LOW       0x2
+
+typedef struct VSAMLIMIT {
+  float           high[VSAM_NUM_CHANS];
+  float           low[VSAM_NUM_CHANS];
+  float           hyst[VSAM_NUM_CHANS];
+  unsigned long   high_on;                  /* bit n: channel n compared */
+  unsigned long   low_on;
+  unsigned long   high_state;               /* bit n: channel n tripped  */
+  unsigned long   low_state;
+  unsigned long   trips;
+} VSAMLIMIT;
+
+/*
+ * Averaging of channel data over n acquisitions, see drvVSAMAvg.c.
+ * ai records of averaged channels read value[] instead of the
+ * snapshot.  Boxcar channels keep their last n samples in ring.
+ */
+#define VSAM_AVG_MAX         256        /* most samples averaged     */
+
+typedef struct VSAMAVG {
+  unsigned long   mask;                     /* bit n: channel n averaged */
+  unsigned long   decimate;                 /* else boxcar               */
+  unsigned long   valid;                    /* value[] has been set      */
+  int             n[VSAM_NUM_CHANS];
+  int             count[VSAM_NUM_CHANS];    /* samples in sum            */
+  int             next[VSAM_NUM_CHANS];     /* next slot in the ring     */
+  double          sum[VSAM_NUM_CHANS];
+  float           value[VSAM_NUM_CHANS];
+  float          *ring;                     /* VSAM_AVG_MAX per channel  */
+} VSAMAVG;
+
+/*
+ * Filter bank of a card, see drvVSAMFilt.c.  Every coefficient and
+ * state is an array over the channels so that one loop runs all 32.
+ * The filtered value of a channel is in out[].
+ */
+#define VSAM_FILT_STAGES     4          /* biquads per channel       */
+#define VSAM_FIR_TAPS        32
+
+typedef struct VSAMFILT {
+  unsigned long   mask;                     /* bit n: channel n filtered */
+  unsigned long   valid;                    /* out[] has been set        */
+  int             nstages;                  /* most used by any channel  */
+  int             ntaps;
+  int             stages[VSAM_NUM_CHANS];
+  int             taps[VSAM_NUM_CHANS];
+  double          period[VSAM_NUM_CHANS];   /* sec between samples       */
+  double          b0[VSAM_FILT_STAGES][VSAM_NUM_CHANS];
+  double          b1[VSAM_FILT_STAGES][VSAM_NUM_CHANS];
+  double          b2[VSAM_FILT_STAGES][VSAM_NUM_CHANS];
+  double          a1[VSAM_FILT_STAGES][VSAM_NUM_CHANS];
+  double          a2[VSAM_FILT_STAGES][VSAM_NUM_CHANS];
+  double          z1[VSAM_FILT_STAGES][VSAM_NUM_CHANS];
+  double          z2[VSAM_FILT_STAGES][VSAM_NUM_CHANS];
+  double          h[VSAM_FIR_TAPS][VSAM_NUM_CHANS];
+  double          x[VSAM_FIR_TAPS][VSAM_NUM_CHANS]; /* x[0] newest   */
+  float           out[VSAM_NUM_CHANS];
+} VSAMFILT;
+
+/*
+ * Spectral analysis of a card in fast scan, see drvVSAMFft.c.
+ * ring holds the last n samples of all channels; mag and peak
+ * are the results of the last analysis.
+ */
+#define VSAM_FFT_MAX         4096       /* most samples, power of 2  */
+
+typedef struct VSAMFFT {
+  unsigned long   n;                        /* samples analyzed          */
+  unsigned long   nbins;                    /* n/2+1                     */
+  unsigned long   mask;                     /* bit n: channel n analyzed */
+  double          period;                   /* sec between analyses      */
+  epicsTimeStamp  due;                      /* next analysis             */
+  float          *ring;                     /* n samples x 32 chans      */
+  epicsTimeStamp *stamp;
+  unsigned long   head;                     /* next slot of the ring     */
+  unsigned long   filled;                   /* samples since fast scan   */
+  float          *mag;                      /* nbins per channel         */
+  float           peak[VSAM_NUM_CHANS];     /* dominant frequency (Hz)   */
+  double          df;                       /* Hz per bin                */
+  unsigned long   count;                    /* analyses made             */
+  IOSCANPVT       ioscan;                   /* posted on every analysis  */
+  /* work space of the analysis task */
+  float          *work;
+  float          *work_mag;
+  double         *re,*im;
+  double         *tw_re,*tw_im;             /* W_n^k, k < n/2            */
+  double         *window;
+  double          wsum;
+  struct VSAMFFT *pnext;                    /* replaced, for the task    */
+} VSAMFFT;
+
+/*
+ * Derived channels of a card, see drvVSAMDerive.c.  The expressions
+ * are compiled into one list of stack instructions in prog[].
+ */
+#define VSAM_NUM_DERIVED     32
+#define VSAM_DERIVE_EXPR     80         /* longest expression        */
+#define VSAM_DERIVE_PROG     512        /* instructions, all channels */
+
+typedef struct VSAMINSN {
+  unsigned char   op;
+  unsigned char   type;                     /* 0 data, 1 AC              */
+  short           chan;                     /* or derived channel        */
+  unsigned long   mask;                     /* channels of a group       */
+  double          val;                      /* constant                  */
+} VSAMINSN;
+
+typedef struct VSAMDERIVE {
+  char            expr[VSAM_NUM_DERIVED][VSAM_DERIVE_EXPR];
+  unsigned long   defined;                  /* bit n: X n has an expression */
+  unsigned long   valid;                    /* value[n] is good          */
+  int             use_ac;
+  unsigned long   use[VSAM_NUM_DERIVED][2]; /* data, AC channels used    */
+  int             len;                      /* instructions in prog      */
+  VSAMINSN        prog[VSAM_DERIVE_PROG];
+  double          value[VSAM_NUM_DERIVED];
+  unsigned long   count;                    /* runs                      */
+  IOSCANPVT       ioscan;                   /* posted on every run       */
+} VSAMDERIVE;
+
+/*
+ * In-process subscribers to the snapshots of a card, see drvVSAMSub.c.
+ * func gets a read-only pointer to the snapshot itself, good only
+ * until it returns, and the channels just read.
+ */
+#define VSAM_SUB_MAX         8
+
+typedef void (*VSAM_SUB_FUNC)( void *arg,short card,const VSAMSNAP *psnap,
+                               unsigned long dmask,unsigned long rmask,unsigned long amask );
+
+typedef struct VSAMSUB {
+  VSAM_SUB_FUNC   func;                     /* NULL if slot is free      */
+  void           *arg;
+  unsigned long   mask;                     /* data chans, 0 for all     */
+  unsigned long   calls;
+} VSAMSUB;
+
+typedef struct VSAMSUBS {
+  int             nsub;
+  VSAMSUB         sub[VSAM_SUB_MAX];
+} VSAMSUBS;
+
+/*
+ * Layout of the shared-memory export, see drvVSAMShm.c.  Fixed-size
+ * types only, so that other programs can map it.  Bump the version
+ * on any change; fields are only ever added at the end of a struct.
+ */
+#define VSAM_SHM_MAGIC       0x5653414d  /* "VSAM"                    */
+#define VSAM_SHM_VERSION     1
+
+typedef struct VSAMSHMHDR {
+  volatile epicsUInt32 magic;               /* set once laid out         */
+  epicsUInt32     version;
+  epicsUInt32     hdr_size;                 /* bytes before first card   */
+  epicsUInt32     card_size;                /* bytes per card area       */
+  epicsUInt32     slot_size;
+  epicsUInt32     ncards;
+  epicsUInt32     depth;                    /* slots per card            */
+  epicsUInt32     pad;
+} VSAMSHMHDR;
+
+typedef struct VSAMSHMCARD {
+  epicsUInt32     card;
+  volatile epicsUInt32 count;               /* snapshots written         */
+} VSAMSHMCARD;                              /* followed by depth slots   */
+
+typedef struct VSAMSHMSLOT {
+  volatile epicsUInt32 seq;                 /* odd while being written   */
+  epicsUInt32     sec;                      /* EPICS epoch               */
+  epicsUInt32     nsec;
+  epicsUInt32     status;
+  epicsUInt32     dmask;                    /* channels read this time   */
+  epicsUInt32     rmask;
+  epicsUInt32     amask;
+  epicsFloat32    data[VSAM_NUM_CHANS];
+  epicsUInt32     range[VSAM_NUM_CHANS/4];  /* as in VSAMSNAP            */
+  epicsUInt32     ac[VSAM_NUM_CHANS/2];
+} VSAMSHMSLOT;
+
+/*
+ * Layout of the recorder file, see drvVSAMRec.c: a header, then nrec
+ * records in a ring.  The count records ending just before head are
+ * valid.  Bump the version on any change.
+ */
+#define VSAM_REC_MAGIC       0x56524543  /* "VREC"                    */
+#define VSAM_REC_VERSION     1
+
+typedef struct VSAMRECHDR {
+  volatile epicsUInt32 magic;               /* set once laid out         */
+  epicsUInt32     version;
+  epicsUInt32     hdr_size;                 /* bytes before first record */
+  epicsUInt32     rec_size;
+  epicsUInt32     nrec;                     /* records in the ring       */
+  volatile epicsUInt32 head;                /* next record written       */
+  volatile epicsUInt32 count;               /* valid records             */
+  volatile epicsUInt32 total;               /* records ever written      */
+  volatile epicsUInt32 dropped;             /* lost to a slow disk       */
+  epicsUInt32     pad[7];
+} VSAMRECHDR;
+
+typedef struct VSAMRECORD {
+  epicsUInt16     card;
+  epicsUInt16     flags;
+  epicsUInt32     sec;                      /* EPICS epoch               */
+  epicsUInt32     nsec;
+  epicsUInt32     status;
+  epicsUInt32     dmask;                    /* channels read this time   */
+  epicsUInt32     rmask;
+  epicsUInt32     amask;
+  epicsFloat32    data[VSAM_NUM_CHANS];
+  epicsUInt32     range[VSAM_NUM_CHANS/4];  /* as in VSAMSNAP            */
+  epicsUInt32     ac[VSAM_NUM_CHANS/2];
+} VSAMRECORD;
+
+/*
+ * Bus backend, see drvVSAMBus.c.  The driver reaches the card memory
+ * only through pVSAMbus: map() gives the address of a card, probe()
+ * reads a word and returns non-zero on a bus error, in32()/out32()
+ * move the D32 register words and inf() reads a data word.
+ */
+typedef struct VSAMBUS {
+  const char     *name;
+  long          (*map)( const char *name,short card,unsigned long addr,VSAMMEM **ppVSAM );
+  int           (*probe)( volatile void *paddr,epicsUInt32 *pval );
+  epicsUInt32   (*in32)( volatile void *paddr );
+  void          (*out32)( volatile void *paddr,epicsUInt32 val );
+  float         (*inf)( volatile void *paddr );
+} VSAMBUS;
+
+extern VSAMBUS *pVSAMbus;
+extern VSAMBUS  VSAM_vme_bus;
+
+#define VSAM_PROBE(a,pv)  ((*pVSAMbus->probe)((volatile void *)(a),(pv)))
+#define VSAM_IN32(a)      ((*pVSAMbus->in32)((volatile void *)(a)))
+#define VSAM_OUT32(a,v)   ((*pVSAMbus->out32)((volatile void *)(a),(epicsUInt32)(v)))
+#define VSAM_INF(a)       ((*pVSAMbus->inf)((volatile void *)(a)))
+
+/*
+ * Injected faults of a card, see drvVSAMFault.c.
+ */
+#define VSAM_FAULT_BUS       0          /* probes fail               */
+#define VSAM_FAULT_LATENCY   1          /* accesses take arg usec more */
+#define VSAM_FAULT_STUCK     2          /* data words stop changing  */
+#define VSAM_FAULT_CALIB     3          /* CALIB_SUCCESS lost        */
+#define VSAM_FAULT_RANGE     4          /* range byte above MAX_RANGE_BYTE */
+#define VSAM_NUM_FAULTS      5
+
+typedef struct VSAMFAULTSPEC {
+  int             on;
+  int             forever;                  /* until VSAM_fault_clear()  */
+  double          rate;                     /* chance per access         */
+  double          arg;
+  epicsTimeStamp  begin;
+  epicsTimeStamp  end;
+  unsigned long   hits;
+  epicsTimeStamp  last;                     /* last hit                  */
+  int             recovered;
+  epicsTimeStamp  recovery;                 /* first good data after end */
+  unsigned long   stuck_valid;
+  float           stuck[VSAM_NUM_CHANS];
+} VSAMFAULTSPEC;
+
+typedef struct VSAMFAULT {
+  VSAMFAULTSPEC   spec[VSAM_NUM_FAULTS];
+  int             done;                     /* all over and recovered    */
+} VSAMFAULT;
+
+/*
+ * Min/max/mean trend pyramid of a card, see drvVSAMTrend.c.
+ * Level n has buckets of 1, 10, 60 and 600 sec.
+ */
+#define VSAM_TREND_LEVELS    4
+#define VSAM_TREND_MAX       4096       /* buckets kept per level    */
+
+typedef struct VSAMTRENDBIN {
+  float           min;
+  float           max;
+  double          sum;
+  unsigned long   n;                        /* samples                   */
+} VSAMTRENDBIN;
+
+typedef struct VSAMTRENDLVL {
+  unsigned long   period;                   /* sec                       */
+  int             open;                     /* bucket[] has been started */
+  unsigned long   open_sec;                 /* start of bucket[]         */
+  VSAMTRENDBIN    bucket[VSAM_NUM_CHANS];   /* being filled              */
+  unsigned long   head;                     /* next slot of the ring     */
+  unsigned long   count;                    /* slots filled              */
+  float          *min;                      /* [slot*32+chan]            */
+  float          *max;
+  float          *mean;
+  epicsUInt32    *start;                    /* [slot], sec past epoch    */
+  IOSCANPVT       ioscan;                   /* posted when a bucket closes */
+} VSAMTRENDLVL;
+
+typedef struct VSAMTREND {
+  unsigned long   depth;
+  unsigned long   closed;                   /* bit n: level n to post    */
+  VSAMTRENDLVL    lvl[VSAM_TREND_LEVELS];
+} VSAMTREND;
+
+/*
+ * Compressed history of a card, see drvVSAMHistory.c.  Each
+ * channel has a ring of blocks; a block holds its first point
+ * as is and the following ones as varint usec deltas and value
+ * steps of quant (or raw floats if quant is 0).
+ */
+#define VSAM_HISTORY_CODE    228        /* code bytes, block is 256  */
+#define VSAM_HISTORY_QUERIES 4          /* time windows per card     */
+
+typedef struct VSAMHISTORYBLK {
+  epicsTimeStamp  start;                    /* of the first point        */
+  epicsTimeStamp  end;                      /* of the last point         */
+  float           first;                    /* value of the first point  */
+  float           quant;                    /* value step of the code    */
+  unsigned short  npts;
+  unsigned short  used;                     /* bytes of code[]           */
+  unsigned char   code[VSAM_HISTORY_CODE];
+} VSAMHISTORYBLK;
+
+typedef struct VSAMHISTORYCHAN {
+  char            mode;                     /* 'D'eadband or 'S'winging door */
+  float           err;                      /* error bound               */
+  float           quant;                    /* err/8, 0 if err is 0      */
+  float           band;                     /* err less half a quant     */
+  VSAMHISTORYBLK *blk;                      /* ring of nblk blocks       */
+  unsigned long   cur;                      /* block being filled        */
+  unsigned long   nused;                    /* blocks with points        */
+  int             open;                     /* cur takes more points     */
+  epicsTimeStamp  a_t;                      /* last point stored,        */
+  float           a_v;                      /*   as it decodes           */
+  int             held;                     /* newer sample not stored   */
+  epicsTimeStamp  h_t;
+  float           h_v;
+  double          s_lo;                     /* swinging door, per sec    */
+  double          s_hi;
+  unsigned long   nin;                      /* samples                   */
+  unsigned long   nout;                     /* points stored             */
+  unsigned long   nbytes;                   /* bytes stored              */
+} VSAMHISTORYCHAN;
+
+/* start and end are sec before now if <= 0, else sec past epoch */
+typedef struct VSAMHISTORYQUERY {
+  double          start;
+  double          end;
+  short           chan;
+  /* window last resolved and the points picked from it */
+  int             valid;
+  epicsTimeStamp  w_start;
+  epicsTimeStamp  w_end;
+  unsigned long   n;
+  unsigned long   size;                     /* of t and v                */
+  double         *t;                        /* sec from w_start          */
+  double         *v;
+} VSAMHISTORYQUERY;
+
+typedef struct VSAMHISTORY {
+  unsigned long   nblk;                     /* blocks per channel        */
+  VSAMHISTORYCHAN chan[VSAM_NUM_CHANS];
+  VSAMHISTORYQUERY query[VSAM_HISTORY_QUERIES];
+} VSAMHISTORY;
+
+/*
+ * Interleaved normal and fast scan of a card, see drvVSAMMode.c.
+ * AC and range are read from normal, the last good ones taken at
+ * the end of a settled normal scan period.
+ */
+typedef struct VSAMMODE {
+  int             on;
+  double          normal;                   /* sec in normal scan        */
+  double          fast;                     /* sec in fast scan          */
+  double          settle;                   /* sec for AC after normal   */
+  int             fast_on;                  /* fast scan written         */
+  int             settled;                  /* status shows the mode     */
+  epicsTimeStamp  switched;                 /* mode written              */
+  epicsTimeStamp  due;                      /* next switch               */
+  unsigned long   switches;
+  unsigned long   timeouts;                 /* status did not follow     */
+  double          settle_last;              /* sec, write to status      */
+  double          settle_max;
+  double          settle_sum;
+  unsigned long   settle_count;
+  int             valid;                    /* normal has been read      */
+  unsigned long   misses;                   /* normal periods not read   */
+  VSAMSNAP        cache;                    /* status, range and AC      */
+} VSAMMODE;
+
 typedef ELLLIST VSAM_CARD_LIST;
 
 typedef struct VSAMCNFG {
@@ -128,6 +751,29 @@ typedef struct VSAMCNFG {
    * only channel 0 is read and that information save here for later use.
    */
   float           fw_version[VSAM_NUM_CHANS]; 
+  epicsMutexId    lock;          /* guards snap                */
+  VSAMSNAP        snap;          /* last whole-card acquisition */
+  VSAMSTATS       stats;
+  VSAMHIST        hist[VSAM_NUM_HISTS];
+  VSAMUSE         use;           /* channels with records       */
+  VSAMSCHED      *psched;        /* NULL unless scheduled       */
+  unsigned short  sched_pass;    /* acquiring for the scheduler */
+  unsigned short  triggered;     /* read on VSAM_trigger()      */
+  VSAMSNAP        trig_snap;     /* last triggered acquisition,
+                                    stamped with the trigger    */
+  VSAMCAPT       *pcapt;         /* NULL unless capturing       */
+  VSAMLIMIT       limit;         /* comparators                 */
+  VSAMAVG        *pavg;          /* NULL unless averaging       */
+  VSAMFILT       *pfilt;         /* NULL unless filtering       */
+  VSAMFFT        *pfft;          /* NULL unless analyzing       */
+  VSAMDERIVE     *pderive;       /* NULL unless derived chans   */
+  VSAMSUBS       *psubs;         /* NULL unless subscribed      */
+  VSAMFAULT      *pfault;        /* NULL unless faults injected */
+  VSAMTREND      *ptrend;        /* NULL unless trending        */
+  VSAMHISTORY    *phistory;      /* NULL unless keeping history */
+  VSAMMODE       *pmode;         /* NULL unless interleaving    */
+  IOSCANPVT       limit_ioscan[VSAM_NUM_CHANS];
+  IOSCANPVT       ioscan[VSAM_NUM_IDX][VSAM_NUM_CHANS];
 } VSAMCNFG;
 
 typedef struct  VSAMCNFG * VSAM_ID;
@@ -145,6 +791,115 @@ int  VSAM_config( short card, unsigned long addr );
 int  VSAM_present( short card,VSAMMEM *pVSAM );
 int  VSAM_get_adrs( short card,VSAMMEM **ppVSAM );
 int  VSAM_version( short card,unsigned short *pversion );
+VSAM_ID VSAM_next_card( VSAM_ID pcard );
+VSAM_ID VSAM_getByCard( short card );
+int  VSAM_type_index( char type );
+int  VSAM_register_use( short card,short channel,char type );
+int  VSAM_acquire( short card );
+int  VSAM_acquire_mask( VSAM_ID pcard,unsigned long dmask,unsigned long rmask,unsigned long amask );
+int  VSAM_acquire_sched( VSAM_ID pcard,unsigned long dmask,unsigned long rmask,unsigned long amask );
+int  VSAM_acquire_claimed( VSAM_ID pcard,unsigned long dmask,unsigned long rmask,unsigned long amask );
+unsigned long VSAM_acquire_words( unsigned long dmask,unsigned long rmask,unsigned long amask );
+long VSAM_bus_budget( double per_sec,double per_ms );
+void VSAM_bus_claim( VSAM_ID pcard,unsigned long nwords );
+void VSAM_budget_report( void );
+int  VSAM_get_ioscan( short card,short channel,char type,IOSCANPVT *ppvt );
+long VSAM_sched_set( short card,const char *type,short first,short last,double period );
+long VSAM_sched_claim( short card,char type,unsigned long mask,double period,int user );
+long VSAM_trigger( void );
+long VSAM_trig_enable( short card,int enable );
+int  VSAM_trig_stats( unsigned long *pcount,unsigned long *pskew );
+void VSAM_trig_report( void );
+int  VSAM_get_stamp( short card,epicsTimeStamp *pstamp );
+int  VSAM_snap_decode( const VSAMSNAP *psnap,char type,float *pval );
+long VSAM_capture_config( short card,const char *type,int pre,int post,double period );
+long VSAM_capture_set( short card,short first,short last,double level,int edge );
+long VSAM_capture_use( short card,short chan );
+void VSAM_capture_sample( VSAM_ID pcard,unsigned long mask );
+int  VSAM_get_capture( short card,short signal,double *pval,unsigned long nmax,unsigned long *pnval );
+int  VSAM_capture_ioscan( short card,IOSCANPVT *ppvt );
+void VSAM_capture_report( VSAM_ID pcard );
+long VSAM_filter_biquad( short card,short first,short last,double period,
+                         double b0,double b1,double b2,double a1,double a2 );
+long VSAM_filter_fir( short card,short first,short last,double period,const char *taps );
+long VSAM_filter_clear( short card,short first,short last );
+long VSAM_filter_load( short card,const char *file,double period );
+void VSAM_filter_run( VSAM_ID pcard,unsigned long dmask );
+void VSAM_filter_report( VSAM_ID pcard );
+long VSAM_derive( short card,short index,const char *expr );
+long VSAM_derive_load( short card,const char *file );
+void VSAM_derive_run( VSAM_ID pcard,unsigned long dmask,unsigned long amask );
+int  VSAM_get_derived( short card,short index,double *pval );
+int  VSAM_get_derived_all( short card,double *pval,unsigned long nmax,unsigned long *pnval );
+void VSAM_derive_report( VSAM_ID pcard );
+int  VSAM_subscribe( short card,unsigned long mask,VSAM_SUB_FUNC func,void *arg );
+long VSAM_unsubscribe( short card,int id );
+void VSAM_sub_notify( VSAM_ID pcard,unsigned long dmask,unsigned long rmask,unsigned long amask );
+int  VSAM_snap_lock( short card,const VSAMSNAP **ppsnap,unsigned long *pcount );
+void VSAM_snap_unlock( short card );
+void VSAM_sub_report( VSAM_ID pcard );
+long VSAM_shm_export( const char *name,int depth );
+void VSAM_shm_report( void );
+long VSAM_rec_start( const char *file,int nrec );
+void VSAM_rec_report( void );
+long VSAM_bus_set( VSAMBUS *pbus );
+long VSAM_replay( const char *file,double speed,int loop );
+int  VSAM_replay_start( void );
+void VSAM_replay_report( void );
+long VSAM_fault( short card,const char *kind,double rate,double arg,double start,double duration );
+long VSAM_fault_clear( short card );
+void VSAM_fault_report( VSAM_ID pcard );
+long VSAM_trend_config( short card,int depth );
+void VSAM_trend_sample( VSAM_ID pcard,unsigned long dmask );
+void VSAM_trend_tick( VSAM_ID pcard );
+int  VSAM_get_trend( short card,short level,short chan,char stat,
+                     double *pval,unsigned long nmax,unsigned long *pnval );
+void VSAM_trend_report( VSAM_ID pcard );
+long VSAM_history_config( short card,int kbytes );
+long VSAM_history_set( short card,short first,short last,const char *mode,double err );
+void VSAM_history_sample( VSAM_ID pcard,unsigned long dmask );
+int  VSAM_get_history( short card,short chan,char which,
+                       double *pval,unsigned long nmax,unsigned long *pnval );
+int  VSAM_history_query( short card,short query,char field,double val );
+int  VSAM_get_history_query( short card,short query,char which,
+                             double *pval,unsigned long nmax,unsigned long *pnval );
+void VSAM_history_report( VSAM_ID pcard );
+long VSAM_interleave( short card,double normal,double fast,double settle );
+int  VSAM_mode_start( void );
+void VSAM_mode_report( VSAM_ID pcard );
+long VSAM_fft_config( short card,short first,short last,int n,double period,double sample_period );
+void VSAM_fft_sample( VSAM_ID pcard,unsigned long dmask );
+int  VSAM_get_spectrum( short card,short signal,double *pval,unsigned long nmax,unsigned long *pnval );
+int  VSAM_get_peak( short card,short chan,double *pval );
+void VSAM_fft_report( VSAM_ID pcard );
+long VSAM_avg_set( short card,short first,short last,int n,const char *mode,double period );
+void VSAM_avg_sample( VSAM_ID pcard,unsigned long dmask );
+void VSAM_avg_report( VSAM_ID pcard );
+long VSAM_limit_set( short card,short first,short last,const char *which,
+                     double low,double high,double hyst,double period );
+long VSAM_pool_config( int nworkers,int priority,unsigned long cpumask );
+int  VSAM_pool_start( void );
+void VSAM_pool_report( void );
+void VSAM_sched_report( VSAM_ID pcard );
+int  VSAM_get_snapshot( short card,VSAMSNAP *psnap );
+int  VSAM_get_counter( short card,short counter,double *pval );
+void VSAM_hist_add( VSAMHIST *phist,epicsUInt32 start );
+unsigned long VSAM_hist_percentile( const VSAMHIST *phist,double pct );
+int  VSAM_get_hist( short card,short hist,VSAMHIST *phist );
+long VSAM_hist_report( short card,int level );
+long VSAM_hist_reset( short card );
+epicsUInt32 VSAM_cycles( void );
+double VSAM_cycle_rate( void );
+double VSAM_cycle_usec( epicsUInt32 start );
+double VSAM_clock_sec( void );
+void VSAM_clock_wall( double sec,epicsTimeStamp *pstamp );
+int  VSAM_clock_init( void );
+void VSAM_trace( short card,unsigned short event,unsigned long arg );
+long VSAM_trace_dump( short card,int level );
+long VSAM_trace_reset( void );
+int  VSAM_stats_write( FILE *fp,int format );
+long VSAM_stats_dump( int format,const char *file );
+long VSAM_stats_export( int format,const char *file,double period );
 
 int bo_VSAM_read(
      short		card,
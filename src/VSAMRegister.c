@@ -0,0 +1,459 @@
+/* VSAMRegister.c - iocsh registration of the VSAM driver commands
+ *
+ *	On vxWorks and RTEMS (Cexp) these routines can be called
+ *	directly from the target shell; registering them here
+ *	makes them available from iocsh as well.
+ */
+
+#include        <iocsh.h>
+#include	"VSAM.h"           /* driver routines      */
+#include        "VSAMUtils.h"      /* VSAM_bench()         */
+#include        <epicsExport.h>
+
+/* VSAM_config( card,addr ) */
+static const iocshArg VSAM_configArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_configArg1 = { "A24 address",iocshArgInt };
+static const iocshArg * const VSAM_configArgs[2] = { &VSAM_configArg0,&VSAM_configArg1 };
+static const iocshFuncDef VSAM_configDef = { "VSAM_config",2,VSAM_configArgs };
+static void VSAM_configCall( const iocshArgBuf *args )
+{
+    VSAM_config( (short)args[0].ival,(unsigned long)args[1].ival );
+}
+
+/* VSAM_io_report( level ) */
+static const iocshArg VSAM_io_reportArg0 = { "level",iocshArgInt };
+static const iocshArg * const VSAM_io_reportArgs[1] = { &VSAM_io_reportArg0 };
+static const iocshFuncDef VSAM_io_reportDef = { "VSAM_io_report",1,VSAM_io_reportArgs };
+static void VSAM_io_reportCall( const iocshArgBuf *args )
+{
+    VSAM_io_report( (char)args[0].ival );
+}
+
+/* VSAM_hist_report( card,level ) */
+static const iocshArg VSAM_hist_reportArg0 = { "card (-1 for all)",iocshArgInt };
+static const iocshArg VSAM_hist_reportArg1 = { "level",iocshArgInt };
+static const iocshArg * const VSAM_hist_reportArgs[2] = { &VSAM_hist_reportArg0,&VSAM_hist_reportArg1 };
+static const iocshFuncDef VSAM_hist_reportDef = { "VSAM_hist_report",2,VSAM_hist_reportArgs };
+static void VSAM_hist_reportCall( const iocshArgBuf *args )
+{
+    VSAM_hist_report( (short)args[0].ival,args[1].ival );
+}
+
+/* VSAM_hist_reset( card ) */
+static const iocshArg VSAM_hist_resetArg0 = { "card (-1 for all)",iocshArgInt };
+static const iocshArg * const VSAM_hist_resetArgs[1] = { &VSAM_hist_resetArg0 };
+static const iocshFuncDef VSAM_hist_resetDef = { "VSAM_hist_reset",1,VSAM_hist_resetArgs };
+static void VSAM_hist_resetCall( const iocshArgBuf *args )
+{
+    VSAM_hist_reset( (short)args[0].ival );
+}
+
+/* VSAM_trace_dump( card,level ) */
+static const iocshArg VSAM_trace_dumpArg0 = { "card (-1 for all)",iocshArgInt };
+static const iocshArg VSAM_trace_dumpArg1 = { "level",iocshArgInt };
+static const iocshArg * const VSAM_trace_dumpArgs[2] = { &VSAM_trace_dumpArg0,&VSAM_trace_dumpArg1 };
+static const iocshFuncDef VSAM_trace_dumpDef = { "VSAM_trace_dump",2,VSAM_trace_dumpArgs };
+static void VSAM_trace_dumpCall( const iocshArgBuf *args )
+{
+    VSAM_trace_dump( (short)args[0].ival,args[1].ival );
+}
+
+/* VSAM_trace_reset() */
+static const iocshFuncDef VSAM_trace_resetDef = { "VSAM_trace_reset",0,NULL };
+static void VSAM_trace_resetCall( const iocshArgBuf *args )
+{
+    VSAM_trace_reset();
+}
+
+/* VSAM_stats_dump( format,file ) */
+static const iocshArg VSAM_stats_dumpArg0 = { "format (0=JSON,1=Prometheus)",iocshArgInt };
+static const iocshArg VSAM_stats_dumpArg1 = { "file (empty for console)",iocshArgString };
+static const iocshArg * const VSAM_stats_dumpArgs[2] = { &VSAM_stats_dumpArg0,&VSAM_stats_dumpArg1 };
+static const iocshFuncDef VSAM_stats_dumpDef = { "VSAM_stats_dump",2,VSAM_stats_dumpArgs };
+static void VSAM_stats_dumpCall( const iocshArgBuf *args )
+{
+    VSAM_stats_dump( args[0].ival,args[1].sval );
+}
+
+/* VSAM_stats_export( format,file,period ) */
+static const iocshArg VSAM_stats_exportArg0 = { "format (0=JSON,1=Prometheus)",iocshArgInt };
+static const iocshArg VSAM_stats_exportArg1 = { "file",iocshArgString };
+static const iocshArg VSAM_stats_exportArg2 = { "period (sec)",iocshArgDouble };
+static const iocshArg * const VSAM_stats_exportArgs[3] = { &VSAM_stats_exportArg0,&VSAM_stats_exportArg1,&VSAM_stats_exportArg2 };
+static const iocshFuncDef VSAM_stats_exportDef = { "VSAM_stats_export",3,VSAM_stats_exportArgs };
+static void VSAM_stats_exportCall( const iocshArgBuf *args )
+{
+    VSAM_stats_export( args[0].ival,args[1].sval,args[2].dval );
+}
+
+/* VSAM_sched_set( card,type,first,last,period ) */
+static const iocshArg VSAM_sched_setArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_sched_setArg1 = { "type (D,R or A)",iocshArgString };
+static const iocshArg VSAM_sched_setArg2 = { "first channel",iocshArgInt };
+static const iocshArg VSAM_sched_setArg3 = { "last channel",iocshArgInt };
+static const iocshArg VSAM_sched_setArg4 = { "period (sec, 0=off)",iocshArgDouble };
+static const iocshArg * const VSAM_sched_setArgs[5] = { &VSAM_sched_setArg0,&VSAM_sched_setArg1,
+                                                        &VSAM_sched_setArg2,&VSAM_sched_setArg3,
+                                                        &VSAM_sched_setArg4 };
+static const iocshFuncDef VSAM_sched_setDef = { "VSAM_sched_set",5,VSAM_sched_setArgs };
+static void VSAM_sched_setCall( const iocshArgBuf *args )
+{
+    VSAM_sched_set( (short)args[0].ival,args[1].sval,(short)args[2].ival,(short)args[3].ival,args[4].dval );
+}
+
+/* VSAM_bus_budget( per_sec,per_ms ) */
+static const iocshArg VSAM_bus_budgetArg0 = { "accesses per sec (0=no limit)",iocshArgDouble };
+static const iocshArg VSAM_bus_budgetArg1 = { "accesses per msec (0=no limit)",iocshArgDouble };
+static const iocshArg * const VSAM_bus_budgetArgs[2] = { &VSAM_bus_budgetArg0,&VSAM_bus_budgetArg1 };
+static const iocshFuncDef VSAM_bus_budgetDef = { "VSAM_bus_budget",2,VSAM_bus_budgetArgs };
+static void VSAM_bus_budgetCall( const iocshArgBuf *args )
+{
+    VSAM_bus_budget( args[0].dval,args[1].dval );
+}
+
+/* VSAM_pool_config( nworkers,priority,cpumask ) */
+static const iocshArg VSAM_pool_configArg0 = { "workers (0=one per card)",iocshArgInt };
+static const iocshArg VSAM_pool_configArg1 = { "EPICS priority (0=default)",iocshArgInt };
+static const iocshArg VSAM_pool_configArg2 = { "cpu mask (0=any)",iocshArgInt };
+static const iocshArg * const VSAM_pool_configArgs[3] = { &VSAM_pool_configArg0,&VSAM_pool_configArg1,&VSAM_pool_configArg2 };
+static const iocshFuncDef VSAM_pool_configDef = { "VSAM_pool_config",3,VSAM_pool_configArgs };
+static void VSAM_pool_configCall( const iocshArgBuf *args )
+{
+    VSAM_pool_config( args[0].ival,args[1].ival,(unsigned long)args[2].ival );
+}
+
+/* VSAM_trig_enable( card,enable ) */
+static const iocshArg VSAM_trig_enableArg0 = { "card (-1=all)",iocshArgInt };
+static const iocshArg VSAM_trig_enableArg1 = { "enable (0=off)",iocshArgInt };
+static const iocshArg * const VSAM_trig_enableArgs[2] = { &VSAM_trig_enableArg0,&VSAM_trig_enableArg1 };
+static const iocshFuncDef VSAM_trig_enableDef = { "VSAM_trig_enable",2,VSAM_trig_enableArgs };
+static void VSAM_trig_enableCall( const iocshArgBuf *args )
+{
+    VSAM_trig_enable( (short)args[0].ival,args[1].ival );
+}
+
+/* VSAM_trigger() */
+static const iocshFuncDef VSAM_triggerDef = { "VSAM_trigger",0,NULL };
+static void VSAM_triggerCall( const iocshArgBuf *args )
+{
+    VSAM_trigger();
+}
+
+/* VSAM_capture_config( card,type,pre,post,period ) */
+static const iocshArg VSAM_capture_configArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_capture_configArg1 = { "type (D or A)",iocshArgString };
+static const iocshArg VSAM_capture_configArg2 = { "samples before trigger",iocshArgInt };
+static const iocshArg VSAM_capture_configArg3 = { "samples from trigger on",iocshArgInt };
+static const iocshArg VSAM_capture_configArg4 = { "sample period sec (0=not scheduled)",iocshArgDouble };
+static const iocshArg * const VSAM_capture_configArgs[5] = { &VSAM_capture_configArg0,&VSAM_capture_configArg1,
+                                                             &VSAM_capture_configArg2,&VSAM_capture_configArg3,
+                                                             &VSAM_capture_configArg4 };
+static const iocshFuncDef VSAM_capture_configDef = { "VSAM_capture_config",5,VSAM_capture_configArgs };
+static void VSAM_capture_configCall( const iocshArgBuf *args )
+{
+    VSAM_capture_config( (short)args[0].ival,args[1].sval,args[2].ival,args[3].ival,args[4].dval );
+}
+
+/* VSAM_capture_set( card,first,last,level,edge ) */
+static const iocshArg VSAM_capture_setArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_capture_setArg1 = { "first channel",iocshArgInt };
+static const iocshArg VSAM_capture_setArg2 = { "last channel",iocshArgInt };
+static const iocshArg VSAM_capture_setArg3 = { "level",iocshArgDouble };
+static const iocshArg VSAM_capture_setArg4 = { "edge (1=rising,-1=falling,2=both,0=off)",iocshArgInt };
+static const iocshArg * const VSAM_capture_setArgs[5] = { &VSAM_capture_setArg0,&VSAM_capture_setArg1,
+                                                          &VSAM_capture_setArg2,&VSAM_capture_setArg3,
+                                                          &VSAM_capture_setArg4 };
+static const iocshFuncDef VSAM_capture_setDef = { "VSAM_capture_set",5,VSAM_capture_setArgs };
+static void VSAM_capture_setCall( const iocshArgBuf *args )
+{
+    VSAM_capture_set( (short)args[0].ival,(short)args[1].ival,(short)args[2].ival,args[3].dval,args[4].ival );
+}
+
+/* VSAM_limit_set( card,first,last,which,low,high,hyst,period ) */
+static const iocshArg VSAM_limit_setArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_limit_setArg1 = { "first channel",iocshArgInt };
+static const iocshArg VSAM_limit_setArg2 = { "last channel",iocshArgInt };
+static const iocshArg VSAM_limit_setArg3 = { "limits (H, L, HL or 0=off)",iocshArgString };
+static const iocshArg VSAM_limit_setArg4 = { "low",iocshArgDouble };
+static const iocshArg VSAM_limit_setArg5 = { "high",iocshArgDouble };
+static const iocshArg VSAM_limit_setArg6 = { "hysteresis",iocshArgDouble };
+static const iocshArg VSAM_limit_setArg7 = { "period sec (needed for H or L)",iocshArgDouble };
+static const iocshArg * const VSAM_limit_setArgs[8] = { &VSAM_limit_setArg0,&VSAM_limit_setArg1,
+                                                        &VSAM_limit_setArg2,&VSAM_limit_setArg3,
+                                                        &VSAM_limit_setArg4,&VSAM_limit_setArg5,
+                                                        &VSAM_limit_setArg6,&VSAM_limit_setArg7 };
+static const iocshFuncDef VSAM_limit_setDef = { "VSAM_limit_set",8,VSAM_limit_setArgs };
+static void VSAM_limit_setCall( const iocshArgBuf *args )
+{
+    VSAM_limit_set( (short)args[0].ival,(short)args[1].ival,(short)args[2].ival,args[3].sval,
+                    args[4].dval,args[5].dval,args[6].dval,args[7].dval );
+}
+
+/* VSAM_avg_set( card,first,last,n,mode,period ) */
+static const iocshArg VSAM_avg_setArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_avg_setArg1 = { "first channel",iocshArgInt };
+static const iocshArg VSAM_avg_setArg2 = { "last channel",iocshArgInt };
+static const iocshArg VSAM_avg_setArg3 = { "samples (0=off)",iocshArgInt };
+static const iocshArg VSAM_avg_setArg4 = { "mode (B=boxcar,D=decimate)",iocshArgString };
+static const iocshArg VSAM_avg_setArg5 = { "sample period sec (needed for n > 1)",iocshArgDouble };
+static const iocshArg * const VSAM_avg_setArgs[6] = { &VSAM_avg_setArg0,&VSAM_avg_setArg1,
+                                                      &VSAM_avg_setArg2,&VSAM_avg_setArg3,
+                                                      &VSAM_avg_setArg4,&VSAM_avg_setArg5 };
+static const iocshFuncDef VSAM_avg_setDef = { "VSAM_avg_set",6,VSAM_avg_setArgs };
+static void VSAM_avg_setCall( const iocshArgBuf *args )
+{
+    VSAM_avg_set( (short)args[0].ival,(short)args[1].ival,(short)args[2].ival,
+                  args[3].ival,args[4].sval,args[5].dval );
+}
+
+/* VSAM_filter_biquad( card,first,last,period,b0,b1,b2,a1,a2 ) */
+static const iocshArg VSAM_filter_biquadArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_filter_biquadArg1 = { "first channel",iocshArgInt };
+static const iocshArg VSAM_filter_biquadArg2 = { "last channel",iocshArgInt };
+static const iocshArg VSAM_filter_biquadArg3 = { "sample period sec",iocshArgDouble };
+static const iocshArg VSAM_filter_biquadArg4 = { "b0",iocshArgDouble };
+static const iocshArg VSAM_filter_biquadArg5 = { "b1",iocshArgDouble };
+static const iocshArg VSAM_filter_biquadArg6 = { "b2",iocshArgDouble };
+static const iocshArg VSAM_filter_biquadArg7 = { "a1",iocshArgDouble };
+static const iocshArg VSAM_filter_biquadArg8 = { "a2",iocshArgDouble };
+static const iocshArg * const VSAM_filter_biquadArgs[9] = { &VSAM_filter_biquadArg0,&VSAM_filter_biquadArg1,
+                                                            &VSAM_filter_biquadArg2,&VSAM_filter_biquadArg3,
+                                                            &VSAM_filter_biquadArg4,&VSAM_filter_biquadArg5,
+                                                            &VSAM_filter_biquadArg6,&VSAM_filter_biquadArg7,
+                                                            &VSAM_filter_biquadArg8 };
+static const iocshFuncDef VSAM_filter_biquadDef = { "VSAM_filter_biquad",9,VSAM_filter_biquadArgs };
+static void VSAM_filter_biquadCall( const iocshArgBuf *args )
+{
+    VSAM_filter_biquad( (short)args[0].ival,(short)args[1].ival,(short)args[2].ival,args[3].dval,
+                        args[4].dval,args[5].dval,args[6].dval,args[7].dval,args[8].dval );
+}
+
+/* VSAM_filter_fir( card,first,last,period,taps ) */
+static const iocshArg VSAM_filter_firArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_filter_firArg1 = { "first channel",iocshArgInt };
+static const iocshArg VSAM_filter_firArg2 = { "last channel",iocshArgInt };
+static const iocshArg VSAM_filter_firArg3 = { "sample period sec",iocshArgDouble };
+static const iocshArg VSAM_filter_firArg4 = { "taps \"h0 h1 ...\"",iocshArgString };
+static const iocshArg * const VSAM_filter_firArgs[5] = { &VSAM_filter_firArg0,&VSAM_filter_firArg1,
+                                                         &VSAM_filter_firArg2,&VSAM_filter_firArg3,
+                                                         &VSAM_filter_firArg4 };
+static const iocshFuncDef VSAM_filter_firDef = { "VSAM_filter_fir",5,VSAM_filter_firArgs };
+static void VSAM_filter_firCall( const iocshArgBuf *args )
+{
+    VSAM_filter_fir( (short)args[0].ival,(short)args[1].ival,(short)args[2].ival,args[3].dval,args[4].sval );
+}
+
+/* VSAM_filter_clear( card,first,last ) */
+static const iocshArg VSAM_filter_clearArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_filter_clearArg1 = { "first channel",iocshArgInt };
+static const iocshArg VSAM_filter_clearArg2 = { "last channel",iocshArgInt };
+static const iocshArg * const VSAM_filter_clearArgs[3] = { &VSAM_filter_clearArg0,&VSAM_filter_clearArg1,
+                                                           &VSAM_filter_clearArg2 };
+static const iocshFuncDef VSAM_filter_clearDef = { "VSAM_filter_clear",3,VSAM_filter_clearArgs };
+static void VSAM_filter_clearCall( const iocshArgBuf *args )
+{
+    VSAM_filter_clear( (short)args[0].ival,(short)args[1].ival,(short)args[2].ival );
+}
+
+/* VSAM_filter_load( card,file,period ) */
+static const iocshArg VSAM_filter_loadArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_filter_loadArg1 = { "file",iocshArgString };
+static const iocshArg VSAM_filter_loadArg2 = { "sample period sec",iocshArgDouble };
+static const iocshArg * const VSAM_filter_loadArgs[3] = { &VSAM_filter_loadArg0,&VSAM_filter_loadArg1,
+                                                          &VSAM_filter_loadArg2 };
+static const iocshFuncDef VSAM_filter_loadDef = { "VSAM_filter_load",3,VSAM_filter_loadArgs };
+static void VSAM_filter_loadCall( const iocshArgBuf *args )
+{
+    VSAM_filter_load( (short)args[0].ival,args[1].sval,args[2].dval );
+}
+
+/* VSAM_fft_config( card,first,last,n,period,sample_period ) */
+static const iocshArg VSAM_fft_configArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_fft_configArg1 = { "first channel",iocshArgInt };
+static const iocshArg VSAM_fft_configArg2 = { "last channel",iocshArgInt };
+static const iocshArg VSAM_fft_configArg3 = { "samples (power of 2)",iocshArgInt };
+static const iocshArg VSAM_fft_configArg4 = { "analysis period sec",iocshArgDouble };
+static const iocshArg VSAM_fft_configArg5 = { "sample period sec (0=not scheduled)",iocshArgDouble };
+static const iocshArg * const VSAM_fft_configArgs[6] = { &VSAM_fft_configArg0,&VSAM_fft_configArg1,
+                                                         &VSAM_fft_configArg2,&VSAM_fft_configArg3,
+                                                         &VSAM_fft_configArg4,&VSAM_fft_configArg5 };
+static const iocshFuncDef VSAM_fft_configDef = { "VSAM_fft_config",6,VSAM_fft_configArgs };
+static void VSAM_fft_configCall( const iocshArgBuf *args )
+{
+    VSAM_fft_config( (short)args[0].ival,(short)args[1].ival,(short)args[2].ival,
+                     args[3].ival,args[4].dval,args[5].dval );
+}
+
+/* VSAM_derive( card,index,expr ) */
+static const iocshArg VSAM_deriveArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_deriveArg1 = { "derived channel",iocshArgInt };
+static const iocshArg VSAM_deriveArg2 = { "expression",iocshArgString };
+static const iocshArg * const VSAM_deriveArgs[3] = { &VSAM_deriveArg0,&VSAM_deriveArg1,&VSAM_deriveArg2 };
+static const iocshFuncDef VSAM_deriveDef = { "VSAM_derive",3,VSAM_deriveArgs };
+static void VSAM_deriveCall( const iocshArgBuf *args )
+{
+    VSAM_derive( (short)args[0].ival,(short)args[1].ival,args[2].sval );
+}
+
+/* VSAM_derive_load( card,file ) */
+static const iocshArg VSAM_derive_loadArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_derive_loadArg1 = { "file",iocshArgString };
+static const iocshArg * const VSAM_derive_loadArgs[2] = { &VSAM_derive_loadArg0,&VSAM_derive_loadArg1 };
+static const iocshFuncDef VSAM_derive_loadDef = { "VSAM_derive_load",2,VSAM_derive_loadArgs };
+static void VSAM_derive_loadCall( const iocshArgBuf *args )
+{
+    VSAM_derive_load( (short)args[0].ival,args[1].sval );
+}
+
+/* VSAM_shm_export( name,depth ) */
+static const iocshArg VSAM_shm_exportArg0 = { "segment name",iocshArgString };
+static const iocshArg VSAM_shm_exportArg1 = { "snapshots kept per card",iocshArgInt };
+static const iocshArg * const VSAM_shm_exportArgs[2] = { &VSAM_shm_exportArg0,&VSAM_shm_exportArg1 };
+static const iocshFuncDef VSAM_shm_exportDef = { "VSAM_shm_export",2,VSAM_shm_exportArgs };
+static void VSAM_shm_exportCall( const iocshArgBuf *args )
+{
+    VSAM_shm_export( args[0].sval,args[1].ival );
+}
+
+/* VSAM_rec_start( file,nrec ) */
+static const iocshArg VSAM_rec_startArg0 = { "file",iocshArgString };
+static const iocshArg VSAM_rec_startArg1 = { "records in the file",iocshArgInt };
+static const iocshArg * const VSAM_rec_startArgs[2] = { &VSAM_rec_startArg0,&VSAM_rec_startArg1 };
+static const iocshFuncDef VSAM_rec_startDef = { "VSAM_rec_start",2,VSAM_rec_startArgs };
+static void VSAM_rec_startCall( const iocshArgBuf *args )
+{
+    VSAM_rec_start( args[0].sval,args[1].ival );
+}
+
+/* VSAM_replay( file,speed,loop ) */
+static const iocshArg VSAM_replayArg0 = { "recording",iocshArgString };
+static const iocshArg VSAM_replayArg1 = { "speed (1=real time, 0=fastest)",iocshArgDouble };
+static const iocshArg VSAM_replayArg2 = { "loop (0/1)",iocshArgInt };
+static const iocshArg * const VSAM_replayArgs[3] = { &VSAM_replayArg0,&VSAM_replayArg1,&VSAM_replayArg2 };
+static const iocshFuncDef VSAM_replayDef = { "VSAM_replay",3,VSAM_replayArgs };
+static void VSAM_replayCall( const iocshArgBuf *args )
+{
+    VSAM_replay( args[0].sval,args[1].dval,args[2].ival );
+}
+
+/* VSAM_fault( card,kind,rate,arg,start,duration ) */
+static const iocshArg VSAM_faultArg0 = { "card (-1=all)",iocshArgInt };
+static const iocshArg VSAM_faultArg1 = { "kind (bus,latency,stuck,calib,range)",iocshArgString };
+static const iocshArg VSAM_faultArg2 = { "rate (0..1)",iocshArgDouble };
+static const iocshArg VSAM_faultArg3 = { "arg (latency usec)",iocshArgDouble };
+static const iocshArg VSAM_faultArg4 = { "start (sec from now)",iocshArgDouble };
+static const iocshArg VSAM_faultArg5 = { "duration (sec, 0=until cleared)",iocshArgDouble };
+static const iocshArg * const VSAM_faultArgs[6] = { &VSAM_faultArg0,&VSAM_faultArg1,&VSAM_faultArg2,
+                                                    &VSAM_faultArg3,&VSAM_faultArg4,&VSAM_faultArg5 };
+static const iocshFuncDef VSAM_faultDef = { "VSAM_fault",6,VSAM_faultArgs };
+static void VSAM_faultCall( const iocshArgBuf *args )
+{
+    VSAM_fault( (short)args[0].ival,args[1].sval,args[2].dval,
+                args[3].dval,args[4].dval,args[5].dval );
+}
+
+/* VSAM_fault_clear( card ) */
+static const iocshArg VSAM_fault_clearArg0 = { "card (-1=all)",iocshArgInt };
+static const iocshArg * const VSAM_fault_clearArgs[1] = { &VSAM_fault_clearArg0 };
+static const iocshFuncDef VSAM_fault_clearDef = { "VSAM_fault_clear",1,VSAM_fault_clearArgs };
+static void VSAM_fault_clearCall( const iocshArgBuf *args )
+{
+    VSAM_fault_clear( (short)args[0].ival );
+}
+
+/* VSAM_trend_config( card,depth ) */
+static const iocshArg VSAM_trend_configArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_trend_configArg1 = { "buckets per level",iocshArgInt };
+static const iocshArg * const VSAM_trend_configArgs[2] = { &VSAM_trend_configArg0,&VSAM_trend_configArg1 };
+static const iocshFuncDef VSAM_trend_configDef = { "VSAM_trend_config",2,VSAM_trend_configArgs };
+static void VSAM_trend_configCall( const iocshArgBuf *args )
+{
+    VSAM_trend_config( (short)args[0].ival,args[1].ival );
+}
+
+/* VSAM_bench( card,n ) */
+static const iocshArg VSAM_benchArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_benchArg1 = { "accesses per test (0=10000)",iocshArgInt };
+static const iocshArg * const VSAM_benchArgs[2] = { &VSAM_benchArg0,&VSAM_benchArg1 };
+static const iocshFuncDef VSAM_benchDef = { "VSAM_bench",2,VSAM_benchArgs };
+static void VSAM_benchCall( const iocshArgBuf *args )
+{
+    VSAM_bench( (short)args[0].ival,args[1].ival );
+}
+
+/* VSAM_history_config( card,kbytes ) */
+static const iocshArg VSAM_history_configArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_history_configArg1 = { "kbytes per channel",iocshArgInt };
+static const iocshArg * const VSAM_history_configArgs[2] = { &VSAM_history_configArg0,&VSAM_history_configArg1 };
+static const iocshFuncDef VSAM_history_configDef = { "VSAM_history_config",2,VSAM_history_configArgs };
+static void VSAM_history_configCall( const iocshArgBuf *args )
+{
+    VSAM_history_config( (short)args[0].ival,args[1].ival );
+}
+
+/* VSAM_history_set( card,first,last,mode,err ) */
+static const iocshArg VSAM_history_setArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_history_setArg1 = { "first channel",iocshArgInt };
+static const iocshArg VSAM_history_setArg2 = { "last channel",iocshArgInt };
+static const iocshArg VSAM_history_setArg3 = { "mode (deadband or swing)",iocshArgString };
+static const iocshArg VSAM_history_setArg4 = { "error bound",iocshArgDouble };
+static const iocshArg * const VSAM_history_setArgs[5] = { &VSAM_history_setArg0,&VSAM_history_setArg1,
+                                                          &VSAM_history_setArg2,&VSAM_history_setArg3,
+                                                          &VSAM_history_setArg4 };
+static const iocshFuncDef VSAM_history_setDef = { "VSAM_history_set",5,VSAM_history_setArgs };
+static void VSAM_history_setCall( const iocshArgBuf *args )
+{
+    VSAM_history_set( (short)args[0].ival,(short)args[1].ival,(short)args[2].ival,args[3].sval,args[4].dval );
+}
+
+/* VSAM_interleave( card,normal,fast,settle ) */
+static const iocshArg VSAM_interleaveArg0 = { "card",iocshArgInt };
+static const iocshArg VSAM_interleaveArg1 = { "sec in normal scan (0=stop)",iocshArgDouble };
+static const iocshArg VSAM_interleaveArg2 = { "sec in fast scan",iocshArgDouble };
+static const iocshArg VSAM_interleaveArg3 = { "sec for AC after normal scan",iocshArgDouble };
+static const iocshArg * const VSAM_interleaveArgs[4] = { &VSAM_interleaveArg0,&VSAM_interleaveArg1,
+                                                         &VSAM_interleaveArg2,&VSAM_interleaveArg3 };
+static const iocshFuncDef VSAM_interleaveDef = { "VSAM_interleave",4,VSAM_interleaveArgs };
+static void VSAM_interleaveCall( const iocshArgBuf *args )
+{
+    VSAM_interleave( (short)args[0].ival,args[1].dval,args[2].dval,args[3].dval );
+}
+
+static void VSAMRegister( void )
+{
+    iocshRegister( &VSAM_configDef,VSAM_configCall );
+    iocshRegister( &VSAM_io_reportDef,VSAM_io_reportCall );
+    iocshRegister( &VSAM_hist_reportDef,VSAM_hist_reportCall );
+    iocshRegister( &VSAM_hist_resetDef,VSAM_hist_resetCall );
+    iocshRegister( &VSAM_trace_dumpDef,VSAM_trace_dumpCall );
+    iocshRegister( &VSAM_trace_resetDef,VSAM_trace_resetCall );
+    iocshRegister( &VSAM_stats_dumpDef,VSAM_stats_dumpCall );
+    iocshRegister( &VSAM_stats_exportDef,VSAM_stats_exportCall );
+    iocshRegister( &VSAM_sched_setDef,VSAM_sched_setCall );
+    iocshRegister( &VSAM_bus_budgetDef,VSAM_bus_budgetCall );
+    iocshRegister( &VSAM_pool_configDef,VSAM_pool_configCall );
+    iocshRegister( &VSAM_trig_enableDef,VSAM_trig_enableCall );
+    iocshRegister( &VSAM_triggerDef,VSAM_triggerCall );
+    iocshRegister( &VSAM_capture_configDef,VSAM_capture_configCall );
+    iocshRegister( &VSAM_capture_setDef,VSAM_capture_setCall );
+    iocshRegister( &VSAM_limit_setDef,VSAM_limit_setCall );
+    iocshRegister( &VSAM_avg_setDef,VSAM_avg_setCall );
+    iocshRegister( &VSAM_filter_biquadDef,VSAM_filter_biquadCall );
+    iocshRegister( &VSAM_filter_firDef,VSAM_filter_firCall );
+    iocshRegister( &VSAM_filter_clearDef,VSAM_filter_clearCall );
+    iocshRegister( &VSAM_filter_loadDef,VSAM_filter_loadCall );
+    iocshRegister( &VSAM_fft_configDef,VSAM_fft_configCall );
+    iocshRegister( &VSAM_deriveDef,VSAM_deriveCall );
+    iocshRegister( &VSAM_derive_loadDef,VSAM_derive_loadCall );
+    iocshRegister( &VSAM_shm_exportDef,VSAM_shm_exportCall );
+    iocshRegister( &VSAM_rec_startDef,VSAM_rec_startCall );
+    iocshRegister( &VSAM_replayDef,VSAM_replayCall );
+    iocshRegister( &VSAM_faultDef,VSAM_faultCall );
+    iocshRegister( &VSAM_fault_clearDef,VSAM_fault_clearCall );
+    iocshRegister( &VSAM_benchDef,VSAM_benchCall );
+    iocshRegister( &VSAM_trend_configDef,VSAM_trend_configCall );
+    iocshRegister( &VSAM_history_configDef,VSAM_history_configCall );
+    iocshRegister( &VSAM_history_setDef,VSAM_history_setCall );
+    iocshRegister( &VSAM_interleaveDef,VSAM_interleaveCall );
+}
+epicsExportRegistrar(VSAMRegister);
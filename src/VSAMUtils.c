@@ -149,3 +149,104 @@ int VSAM_setAnalogChData(VSAMMEM * pVSAM) {
 return OK;
 }     
 
+
+/*
+ * VSAM_bench - time VME accesses to an installed card
+ *
+ *	Times n single D32 reads of data, range, AC and status words,
+ *	n sweeps reading the data, range and AC words in order, and
+ *	n writes of the mode control register with its current mode.
+ *	For each prints min, mean, p99 and max ns per access and the
+ *	MB/s that makes.  Accesses go through the driver's bus backend,
+ *	so they cost what they cost the driver.  The card is locked
+ *	while the accesses are made, which holds up its acquisition;
+ *	the results are worked out and printed after it is unlocked.
+ *
+ *	The clock is the driver's cycle counter, VSAM_cycles(), with
+ *	the rate found at driver init over at least a second.
+ */
+
+#define BENCH_DATA    0
+#define BENCH_RANGE   1
+#define BENCH_AC      2
+#define BENCH_STATUS  3
+#define BENCH_SWEEP   4
+#define BENCH_MODE    5
+#define BENCH_TESTS   6
+#define BENCH_SWEEP_WORDS  (VSAM_NUM_CHANS + VSAM_NUM_CHANS/4 + VSAM_NUM_CHANS/2)
+
+static const char *benchName_c[BENCH_TESTS] = 
+    { "data", "range", "ac", "status", "sweep", "mode wr" };
+
+static int bench_cmp( const void *a,const void *b )
+{
+    epicsUInt32 x = *(const epicsUInt32 *)a;
+    epicsUInt32 y = *(const epicsUInt32 *)b;
+    return (x<y) ? -1 : (x>y);
+}
+
+int VSAM_bench( short card,int n )
+{
+    VSAM_ID            pcard;
+    VSAMMEM           *pVSAM;
+    epicsUInt32       *pbuf,*pt,t0,mode;
+    volatile uint32_t *pword[BENCH_SWEEP_WORDS];
+    double             rate,ns,sum;
+    int                test,i,w;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present ) {
+        printf("VSAM_bench: card %hd not present\n",card);
+        return ERROR;
+    }
+    if ( n<=0 ) n = 10000;
+    pbuf = (epicsUInt32 *)malloc( BENCH_TESTS*n*sizeof(epicsUInt32) );
+    if ( !pbuf ) {
+        printf("VSAM_bench: no memory for %d samples\n",n);
+        return ERROR;
+    }
+    pVSAM = pcard->pVSAM;
+    for (i=0,w=0; i<VSAM_NUM_CHANS; i++)   pword[w++] = (volatile uint32_t *)&pVSAM->data[i];
+    for (i=0; i<VSAM_NUM_CHANS/4; i++)     pword[w++] = (volatile uint32_t *)pVSAM->range + i;
+    for (i=0; i<VSAM_NUM_CHANS/2; i++)     pword[w++] = (volatile uint32_t *)pVSAM->ac + i;
+
+    rate = VSAM_cycle_rate();
+
+    epicsMutexMustLock( pcard->lock );
+    mode = VSAM_IN32(&pVSAM->status) & MODE_MASK;
+    for (test=0; test<BENCH_TESTS; test++) {
+        pt = pbuf + test*n;
+        for (i=0; i<n; i++) {
+            t0 = VSAM_cycles();
+            switch (test) {
+              case BENCH_DATA:   (void)VSAM_IN32(pword[i%VSAM_NUM_CHANS]); break;
+              case BENCH_RANGE:  (void)VSAM_IN32((volatile uint32_t *)pVSAM->range + i%(VSAM_NUM_CHANS/4)); break;
+              case BENCH_AC:     (void)VSAM_IN32((volatile uint32_t *)pVSAM->ac + i%(VSAM_NUM_CHANS/2)); break;
+              case BENCH_STATUS: (void)VSAM_IN32(&pVSAM->status); break;
+              case BENCH_SWEEP:
+                  for (w=0; w<BENCH_SWEEP_WORDS; w++) (void)VSAM_IN32(pword[w]);
+                  break;
+              case BENCH_MODE:   VSAM_OUT32(&pVSAM->mode_control,mode); break;
+            }
+            pt[i] = VSAM_cycles() - t0;
+        }
+    }
+    epicsMutexUnlock( pcard->lock );
+
+    printf("VSAM card %hd on the %s bus, %d accesses each, clock %.3f MHz\n",
+           card,pVSAMbus->name,n,rate/1e6);
+    printf("%-8s %10s %10s %10s %10s %8s\n","","min ns","mean ns","p99 ns","max ns","MB/s");
+    for (test=0; test<BENCH_TESTS; test++) {
+        /* per access */
+        pt = pbuf + test*n;
+        qsort( pt,n,sizeof(epicsUInt32),bench_cmp );
+        for (i=0,sum=0.0; i<n; i++) sum += pt[i];
+        ns    = 1e9/rate;
+        if ( test==BENCH_SWEEP ) ns /= BENCH_SWEEP_WORDS;
+        printf("%-8s %10.0f %10.0f %10.0f %10.0f %8.2f\n",benchName_c[test],
+               pt[0]*ns,sum/n*ns,pt[(int)(0.99*(n-1))]*ns,pt[n-1]*ns,
+               4.0/(sum/n*ns)*1e3);
+    }
+    free( pbuf );
+    return OK;
+}
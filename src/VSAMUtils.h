@@ -41,6 +41,7 @@ int VSAM_setFastScan(VSAMMEM * pVSAM);
 int VSAM_setNormalScan(VSAMMEM * pVSAM);
 int VSAM_setFirmwareRev(VSAMMEM * pVSAM);
 int VSAM_setAnalogChData(VSAMMEM * pVSAM);
+int VSAM_bench(short card, int n);
 
 #ifdef __cplusplus
 }
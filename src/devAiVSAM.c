@@ -23,9 +23,14 @@
 #include	"VSAM.h"
 #include        <epicsExport.h>
 
+#ifndef epicsTimeEventDeviceTime
+#define epicsTimeEventDeviceTime -2
+#endif
+
 /* Local prototypes */
 static long init_record(struct aiRecord *pai);
 static long read_ai(struct aiRecord *pai);
+static long get_ioint_info(int cmd, struct aiRecord *pai, IOSCANPVT *ppvt);
 static long special_linconv(struct aiRecord *pai, int after);
 static void aiVSAMconvert(struct aiRecord  *pai, float rval);
 
@@ -43,7 +48,7 @@ struct {
 	NULL,
 	NULL,
 	init_record,
-	NULL,
+	get_ioint_info,
 	read_ai,
 	special_linconv};
 
@@ -105,6 +110,8 @@ static long init_record(struct aiRecord	*pai)
 		   (translateVSAMChannel(chan,spec,ppvt)==OK)) {
 	         pai->dpvt = ppvt;
                  status = OK;
+                 if ((spec != PERF_TYPE) && (spec != FFT_TYPE) && (spec != DERIV_TYPE)) 
+                   VSAM_register_use(pvmeio->card,chan,spec);
 	       }
                else {
                  status =  S_dev_noMemory;
@@ -125,14 +132,53 @@ static long init_record(struct aiRecord	*pai)
 }
 
 
+/*
+ * get_ioint_info - channels on the driver schedule are
+ *                  processed each time they are acquired
+ */
+static long get_ioint_info(int cmd, struct aiRecord *pai, IOSCANPVT *ppvt)
+{
+	struct vmeio *pvmeio;
+
+	pvmeio = (struct vmeio *)&(pai->inp.value);
+	if (VSAM_get_ioscan(pvmeio->card,pvmeio->signal,pvmeio->parm[0],ppvt) != OK) 
+	   *ppvt = NULL;
+	return(0);
+}
+
 static long read_ai(struct aiRecord  *pai)
 {
 	float         value;
+	double        count;
 	struct vmeio *pvmeio;
 	long          status;
 
 	
 	pvmeio = (struct vmeio *)&(pai->inp.value);
+	if (pvmeio->parm[0] == PERF_TYPE) {
+	   /* driver counters do not fit in a float, so skip the conversion */
+	   if (VSAM_get_counter(pvmeio->card,pvmeio->signal,&count) != OK) {
+	      recGblSetSevr(pai,READ_ALARM,INVALID_ALARM);
+	      return(2);
+	   }
+	   pai->val = count;
+	   pai->udf = FALSE;
+	   return(2);			/* don't convert */
+	}
+	if ((pvmeio->parm[0] == FFT_TYPE) || (pvmeio->parm[0] == DERIV_TYPE)) {
+	   /* dominant frequency in Hz or derived channel, no conversion either */
+	   if (pvmeio->parm[0] == FFT_TYPE)
+	      status = VSAM_get_peak(pvmeio->card,pvmeio->signal,&count);
+	   else
+	      status = VSAM_get_derived(pvmeio->card,pvmeio->signal,&count);
+	   if (status != OK) {
+	      recGblSetSevr(pai,READ_ALARM,INVALID_ALARM);
+	      return(2);
+	   }
+	   pai->val = count;
+	   pai->udf = FALSE;
+	   return(2);
+	}
 	status = ai_VSAM_read(pvmeio->card,
                               pvmeio->signal,
                               pvmeio->parm[0],
@@ -153,6 +199,10 @@ static long read_ai(struct aiRecord  *pai)
 	}
 	if(status!=OK) return(status);
 
+	/* TSE -2: time of the snapshot, ie. of the trigger */
+	if (pai->tse == epicsTimeEventDeviceTime)
+	   VSAM_get_stamp(pvmeio->card,&pai->time);
+
 	/* Do conversion here because data from VSAM is already a float */
 	aiVSAMconvert(pai, value);
 	return(2);			/* don't convert */
@@ -0,0 +1,101 @@
+/* devAoVSAM.c - Device Support Routines for VSAM analog output
+ *
+ *	The analog outputs set driver parameters.  The OUT parm
+ *	character selects what is set and the signal number which
+ *	one, eg:
+ *
+ *	  #C0 S1 @ZS   card 0 history query 1 start, sec
+ *	  #C0 S1 @ZE   card 0 history query 1 end, sec
+ *	  #C0 S1 @ZC   card 0 history query 1 channel
+ *
+ *	Start and end are seconds before now if 0 or less, else
+ *	seconds past the EPICS epoch.  VAL is written as is.
+ */
+#include        "epicsVersion.h"
+#include        <alarm.h>
+#include	<dbDefs.h>
+#include        <dbAccess.h>
+#include        <recSup.h>
+#include	<devSup.h>
+#include        <recGbl.h>
+#if (EPICS_REVISION == 14 && EPICS_MODIFICATION >= 11)
+#include  "errlog.h"
+#endif
+#include	<aoRecord.h>
+#include	"VSAM.h"
+#include        <epicsExport.h>
+
+
+/* Local prototypes */
+static long init_record(struct aoRecord *pao);
+static long write_ao(struct aoRecord *pao);
+
+/* Global variables */
+struct {
+	long		number;
+	DEVSUPFUN	report;
+	DEVSUPFUN	init;
+	DEVSUPFUN	init_record;
+	DEVSUPFUN	get_ioint_info;
+	DEVSUPFUN	write_ao;
+	DEVSUPFUN	special_linconv;
+}devAoVSAM={
+	6,
+	NULL,
+	NULL,
+	init_record,
+	NULL,
+	write_ao,
+	NULL};
+
+epicsExportAddress(dset, devAoVSAM);
+
+
+static long init_record(struct aoRecord *pao)
+{
+    struct vmeio  *pvmeio;
+    long           status = S_db_badField;
+    static char *badField_c = "devAoVSAM (init_record) Illegal OUT field";
+    static char *badType_c =  "devAoVSAM (init_record) bad card, sig, or parm";
+
+
+    switch (pao->out.type) {
+    case VME_IO:
+	pvmeio = (struct vmeio *)&(pao->out.value);
+	if (verifyVSAM(pvmeio->card,0,CSR_TYPE) != OK)
+	  status = 2;		/* card not present */
+	else if ((pvmeio->parm[0] == HISTORY_TYPE) &&
+	         ((pvmeio->parm[1] == 'S') || (pvmeio->parm[1] == 'E') ||
+	          (pvmeio->parm[1] == 'C')) &&
+	         (pvmeio->signal >= 0) && (pvmeio->signal < VSAM_HISTORY_QUERIES))
+	  status = 2;		/* VAL is not converted */
+	else
+	  recGblRecordError(status,(void *)pao,badType_c );
+	break;
+
+      default :
+	recGblRecordError(status,(void *)pao,badField_c );
+	break;
+    }
+    return(status);
+}
+
+static long write_ao(struct aoRecord *pao)
+{
+    struct vmeio *pvmeio;
+    int	          status;
+
+	
+    pvmeio = (struct vmeio *)&(pao->out.value);
+    status = VSAM_history_query(pvmeio->card,
+                                pvmeio->signal,
+                                pvmeio->parm[1],
+                                pao->oval);
+    if(status!=OK) {
+    	if ( recGblSetSevr(pao,WRITE_ALARM,INVALID_ALARM) && 
+             errVerbose &&
+	     (pao->stat!=WRITE_ALARM || pao->sevr!=INVALID_ALARM))
+	  recGblRecordError(-1,(void *)pao,"VSAM_history_query Error");
+    }
+    return(OK);
+}
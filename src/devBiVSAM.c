@@ -19,6 +19,7 @@
 
 /* Local prototypes */
 static long init_record(struct biRecord *pbi);
+static long get_ioint_info(int cmd, struct biRecord *pbi, IOSCANPVT *ppvt);
 static long read_bi(struct biRecord *pbi);
 
 /* Global variables */
@@ -34,7 +35,7 @@ struct {
 	NULL,
 	NULL,
 	init_record,
-	NULL,
+	get_ioint_info,
 	read_bi};
 
 epicsExportAddress(dset, devBiVSAM);
@@ -60,9 +61,15 @@ static long init_record(struct biRecord	*pbi)
 	bit_spec = pvmeio->parm[0];
 	if (verifyVSAM(card, channel, 'B') >= 0) {
 	  if (checkVSAMBi(channel, bit_spec) == OK) {
+	    /* comparators: "@LH" high, "@LL" low, "@L" either */
+	    if (bit_spec == LIMIT_TYPE) bit_spec = pvmeio->parm[1];
 	    if (getVSAMBitMask(channel, bit_spec, &mask) == OK) {
 	      pbi->mask = mask;
 	      status = OK;
+	      if (channel < VSAM_NUM_CHANS)
+	        VSAM_register_use(card, channel, DATA_TYPE);
+	      else
+	        VSAM_register_use(card, channel, CSR_TYPE);
 	    }
 	  }
 	}
@@ -78,6 +85,20 @@ static long init_record(struct biRecord	*pbi)
     return(status);
 }
 
+/*
+ * get_ioint_info - comparator records are posted when the
+ *                  comparator changes state
+ */
+static long get_ioint_info(int cmd, struct biRecord *pbi, IOSCANPVT *ppvt)
+{
+	struct vmeio *pvmeio;
+
+	pvmeio = (struct vmeio *)&(pbi->inp.value);
+	if (VSAM_get_ioscan(pvmeio->card,pvmeio->signal,pvmeio->parm[0],ppvt) != OK) 
+	   *ppvt = NULL;
+	return(0);
+}
+
 static long read_bi(struct biRecord  *pbi)
 {
 	unsigned long  value;
@@ -159,6 +159,8 @@ static long devCardVSAM_init( void *rec_p )
 
 
   Rem: This routine processes the input VME Card record. 
+       Only the status register is read; acquisition is
+       driven by the schedule (VSAM_sched_set) or trigger.
        
 
   Side: None
@@ -178,7 +180,8 @@ static long  devCardVSAM_read( void *rec_p )
     struct vmeCardRecord *modu_ps=NULL;             /* record info          */
     static const char    *taskName_c = "devModuVSAM( read )\n";
     struct dbCommon      *rec_ps = (struct dbCommon *)rec_p;
-    VSAMMEM              *pVSAM = NULL;
+    struct vmeio         *vmeio_ps=NULL;            /* VME info             */
+    unsigned long         sval = 0;                 /* status register      */
 
    /* 
     * If the private device infor has not been
@@ -195,8 +198,18 @@ static long  devCardVSAM_read( void *rec_p )
       status = ERROR;
     }
     else {
-        pVSAM = (VSAMMEM *)modu_ps->dpvt;
-        modu_ps->mstt = pVSAM->status;
+        /* 
+         * Read the status register through the driver,
+         * so the bus backend and counters see it.
+         */
+        vmeio_ps = &modu_ps->inp.value.vmeio;
+        if ( input_VSAM_driver( vmeio_ps->card,VSAM_NUM_CHANS,0,0xffffffff,&sval )!=OK ) {
+           recGblSetSevr( rec_ps,cur_stat,cur_sev );
+           status = ERROR;
+        }
+        else {
+           modu_ps->mstt = sval;
+        }
     }
     return( status );
 }
@@ -0,0 +1,231 @@
+/* devWfVSAM.c - Device Support Routines for VSAM waveforms
+ *
+ *	Driver information that comes as an array, such as
+ *	the latency histograms, is read through a waveform
+ *	record.  The INP parm character selects what is read
+ *	and the signal number selects which one, eg:
+ *
+ *	  #C0 S3 @H    card 0 acquisition latency histogram bins
+ *	  #C0 S3 @Q    card 0 acquisition p50,p99,max,count
+ *	  #C0 S5 @T    card 0 channel 5 of the transient capture
+ *	  #C0 S32 @T   card 0 capture sample times, sec from trigger
+ *	  #C0 S5 @F    card 0 channel 5 amplitude spectrum
+ *	  #C0 S32 @F   card 0 spectrum bin frequencies, Hz
+ *	  #C0 S0 @X    card 0 derived channels 0..NELM-1
+ *	  #C0 S5 @M2X  card 0 channel 5 max over 1 min buckets
+ *	  #C0 S32 @M2  card 0 1 min bucket times, sec before now
+ *	  #C0 S5 @Z    card 0 channel 5 compressed history values
+ *	  #C0 S5 @ZT   card 0 channel 5 history times, sec before now
+ *	  #C0 S1 @ZQ   card 0 history query 1 values, see devAoVSAM.c
+ *	  #C0 S1 @ZQT  card 0 history query 1 times, sec from the start
+ *
+ *	Capture, spectrum, derived channel and trend waveforms are
+ *	normally SCAN "I/O Intr".
+ */
+#include        "epicsVersion.h"
+#include	<string.h>
+#include	<stdlib.h>
+
+#include	<alarm.h>
+#include	<dbDefs.h>
+#include	<dbAccess.h>
+#include        <dbFldTypes.h>
+#include        <epicsTypes.h>
+#include	<recSup.h>
+#include	<devSup.h>
+#include        <recGbl.h>
+#if (EPICS_REVISION == 14 && EPICS_MODIFICATION >= 11)
+#include  "errlog.h"
+#endif
+#include	<link.h>
+#include        <devLib.h>         /* for S_dev_noMemory */
+#include	<waveformRecord.h>
+#include	"VSAM.h"
+#include        <epicsExport.h>
+
+/* Local prototypes */
+static long init_record(struct waveformRecord *pwf);
+static long get_ioint_info(int cmd, struct waveformRecord *pwf, IOSCANPVT *ppvt);
+static long read_wf(struct waveformRecord *pwf);
+static long wfVSAMcopy(struct waveformRecord *pwf, const double *pval, unsigned long nval);
+
+/* Global variables */
+struct {
+	long		number;
+	DEVSUPFUN	report;
+	DEVSUPFUN	init;
+	DEVSUPFUN	init_record;
+	DEVSUPFUN	get_ioint_info;
+	DEVSUPFUN	read_wf;
+} devWfVSAM={
+	5,
+	NULL,
+	NULL,
+	init_record,
+	get_ioint_info,
+	read_wf};
+
+epicsExportAddress(dset, devWfVSAM);
+
+
+static long init_record(struct waveformRecord *pwf)
+{
+	struct vmeio   *pvmeio;
+        long            status = S_db_badField;
+	char            spec;
+        static char *badField_c = "devWfVSAM (init_record) Illegal INP field";
+        static char *badType_c  = "devWfVSAM (init_record) bad card, sig or parm field";
+        static char *badFtvl_c  = "devWfVSAM (init_record) FTVL must be LONG, ULONG, FLOAT or DOUBLE";
+        static char *memErr_c   = "devWfVSAM (init_record) out of memory";
+
+
+	switch (pwf->inp.type) {
+	   case VME_IO:
+      	     pvmeio = (struct vmeio *)&(pwf->inp.value);
+	     spec = pvmeio->parm[0];
+	     if ((pwf->ftvl != DBF_LONG)  && (pwf->ftvl != DBF_ULONG) &&
+	         (pwf->ftvl != DBF_FLOAT) && (pwf->ftvl != DBF_DOUBLE)) {
+	       status = S_db_badChoice;
+	       recGblRecordError(status,(void *)pwf,badFtvl_c);
+	     }
+	     else if (verifyVSAM(pvmeio->card,0,CSR_TYPE) != OK) 
+	       status = OK;	/* card not present */
+	     else if (((spec == HIST_TYPE) || (spec == PCTL_TYPE)) &&
+	              (pvmeio->signal >= 0) && (pvmeio->signal < VSAM_NUM_HISTS))
+	       status = OK;
+	     else if ((((spec == CAPT_TYPE) || (spec == FFT_TYPE)) &&
+	               (pvmeio->signal >= 0) && (pvmeio->signal <= VSAM_NUM_CHANS)) ||
+	              (spec == DERIV_TYPE) ||
+	              ((spec == TREND_TYPE) &&
+	               (pvmeio->signal >= 0) && (pvmeio->signal <= VSAM_NUM_CHANS) &&
+	               (pvmeio->parm[1] >= '0') && (pvmeio->parm[1] < '0'+VSAM_TREND_LEVELS)) ||
+	              ((spec == HISTORY_TYPE) && (pvmeio->signal >= 0) &&
+	               (pvmeio->signal < ((pvmeio->parm[1] == 'Q') ? VSAM_HISTORY_QUERIES : VSAM_NUM_CHANS)))) {
+	       /* a capture channel goes on the schedule of the capture */
+	       if ((spec == CAPT_TYPE) && (pvmeio->signal < VSAM_NUM_CHANS))
+	         VSAM_capture_use(pvmeio->card,pvmeio->signal);
+	       /* capture is copied through a buffer of NELM doubles */
+	       pwf->dpvt = calloc(pwf->nelm, sizeof(double));
+	       if (pwf->dpvt == NULL) {
+	         status = S_dev_noMemory;
+	         recGblRecordError(status,(void *)pwf,memErr_c);
+	       }
+	       else
+	         status = OK;
+	     }
+	     else 
+	       recGblRecordError(status,(void *)pwf,badType_c);
+	     break;
+
+	   default :
+		recGblRecordError(status,(void *)pwf,badField_c);
+	}
+	return(status);
+}
+
+
+static long read_wf(struct waveformRecord *pwf)
+{
+	struct vmeio *pvmeio;
+	VSAMHIST      hist;
+	double        val[VSAM_HIST_BINS];
+	unsigned long nval = 0;
+	int           i;
+	long          status;
+
+
+	pvmeio = (struct vmeio *)&(pwf->inp.value);
+	if ((pvmeio->parm[0] == CAPT_TYPE) || (pvmeio->parm[0] == FFT_TYPE) ||
+	    (pvmeio->parm[0] == DERIV_TYPE) || (pvmeio->parm[0] == TREND_TYPE) ||
+	    (pvmeio->parm[0] == HISTORY_TYPE)) {
+	   if (pwf->dpvt == NULL) return(ERROR);
+	   if (pvmeio->parm[0] == CAPT_TYPE)
+	     status = VSAM_get_capture(pvmeio->card,pvmeio->signal,
+	                               (double *)pwf->dpvt,pwf->nelm,&nval);
+	   else if (pvmeio->parm[0] == DERIV_TYPE)
+	     status = VSAM_get_derived_all(pvmeio->card,
+	                                   (double *)pwf->dpvt,pwf->nelm,&nval);
+	   else if (pvmeio->parm[0] == TREND_TYPE)
+	     status = VSAM_get_trend(pvmeio->card,pvmeio->parm[1]-'0',pvmeio->signal,
+	                             pvmeio->parm[2],(double *)pwf->dpvt,pwf->nelm,&nval);
+	   else if ((pvmeio->parm[0] == HISTORY_TYPE) && (pvmeio->parm[1] == 'Q'))
+	     status = VSAM_get_history_query(pvmeio->card,pvmeio->signal,pvmeio->parm[2],
+	                                     (double *)pwf->dpvt,pwf->nelm,&nval);
+	   else if (pvmeio->parm[0] == HISTORY_TYPE)
+	     status = VSAM_get_history(pvmeio->card,pvmeio->signal,pvmeio->parm[1],
+	                               (double *)pwf->dpvt,pwf->nelm,&nval);
+	   else
+	     status = VSAM_get_spectrum(pvmeio->card,pvmeio->signal,
+	                                (double *)pwf->dpvt,pwf->nelm,&nval);
+	   if (status == OK) return(wfVSAMcopy(pwf, (double *)pwf->dpvt, nval));
+	}
+	else
+	   status = VSAM_get_hist(pvmeio->card,pvmeio->signal,&hist);
+	if (status == OK) {
+	   switch ((int)pvmeio->parm[0]) {
+	     case HIST_TYPE:
+	       for (i=0; i<VSAM_HIST_BINS; i++) val[i] = hist.bin[i];
+	       nval = VSAM_HIST_BINS;
+	       break;
+	     case PCTL_TYPE:
+	       val[0] = VSAM_hist_percentile(&hist,50.0);
+	       val[1] = VSAM_hist_percentile(&hist,99.0);
+	       val[2] = hist.max_usec;
+	       val[3] = hist.count;
+	       nval = 4;
+	       break;
+	   }
+	}
+	if (status != OK) {
+	   if ( recGblSetSevr(pwf,READ_ALARM,INVALID_ALARM) && 
+                errVerbose  && 
+                (pwf->stat!=READ_ALARM ||pwf->sevr!=INVALID_ALARM)) 
+	      recGblRecordError(-1,(void *)pwf,"devWfVSAM read Error");
+	   return(status);
+	}
+	return(wfVSAMcopy(pwf, val, nval));
+}
+
+/*
+ * get_ioint_info - capture waveforms are posted on every capture,
+ *                  spectra on every analysis, derived channels
+ *                  on every acquisition, trends when a bucket
+ *                  of their level closes
+ */
+static long get_ioint_info(int cmd, struct waveformRecord *pwf, IOSCANPVT *ppvt)
+{
+	struct vmeio *pvmeio;
+	int           status = ERROR;
+
+	pvmeio = (struct vmeio *)&(pwf->inp.value);
+	if (pvmeio->parm[0] == CAPT_TYPE)
+	   status = VSAM_capture_ioscan(pvmeio->card,ppvt);
+	else if ((pvmeio->parm[0] == FFT_TYPE) || (pvmeio->parm[0] == DERIV_TYPE))
+	   status = VSAM_get_ioscan(pvmeio->card,0,pvmeio->parm[0],ppvt);
+	else if (pvmeio->parm[0] == TREND_TYPE)
+	   status = VSAM_get_ioscan(pvmeio->card,pvmeio->parm[1]-'0',TREND_TYPE,ppvt);
+	if (status != OK)
+	   *ppvt = NULL;
+	return(0);
+}
+
+/*
+ * wfVSAMcopy - copy doubles into the waveform buffer in its FTVL type
+ */
+static long wfVSAMcopy(struct waveformRecord *pwf, const double *pval, unsigned long nval)
+{
+	unsigned long i;
+
+	if (nval > pwf->nelm) nval = pwf->nelm;
+	for (i=0; i<nval; i++) {
+	   switch (pwf->ftvl) {
+	     case DBF_LONG:   ((epicsInt32 *)pwf->bptr)[i]   = (epicsInt32)pval[i];   break;
+	     case DBF_ULONG:  ((epicsUInt32 *)pwf->bptr)[i]  = (epicsUInt32)pval[i];  break;
+	     case DBF_FLOAT:  ((epicsFloat32 *)pwf->bptr)[i] = (epicsFloat32)pval[i]; break;
+	     default:         ((epicsFloat64 *)pwf->bptr)[i] = pval[i];               break;
+	   }
+	}
+	pwf->nord = nval;
+	pwf->udf  = FALSE;
+	return(OK);
+}
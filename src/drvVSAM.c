@@ -8,17 +8,16 @@
 
 #include        "dbDefs.h"
 #include        "errMdef.h"        /* errMessage()         */
-#include        "devLib.h"         /* devRegisterAddress() */
+#include        "devLib.h"         /* S_dev_addrMapFail    */
 #include        "errlog.h"         /* epicslogPrintf()     */
-#include        "basicIoOps.h"     /* in_be32()            */
 #include	"VSAM.h"           /* VSAM_NUM_CHANS,etc   */
 #include        "VSAMUtils.h"      /* for VSAM_testMem()   */
 #include        "epicsExport.h"
 #include        "epicsThread.h"
 
 /* Messages - informational and error */
-static char *noCard_c    = "VSAM Card %hd not found at (A24) address 0x%8.8lx\n";
-static char *cardFound_c = "VSAM Card %hd found at (A24) address 0x%8.8lx\n";
+static char *noCard_c    = "VSAM Card %d not found at (A24) address %p\n";
+static char *cardFound_c = "VSAM Card %d found at (A24) address %p\n";
 static char *cardNotFound_c   = "verifyVSAM: card %hd not found\n";
 static char *chanOutOfRange   = "verifyVSAM: chan limit %d but chan %d\n";
 static char *invParam_c       = "verifyVSAM: unknown param char %c\n";
@@ -39,9 +38,23 @@ static short           ai_cards_found   = 0;
 static long    init();
 static long    report(int level);
 static int     VSAM_clear( VSAMMEM *pVSAM );
-static int     VSAM_calibrateCheck( VSAMMEM *pMem );
-static VSAM_ID VSAM_getByCard( short  card );
+static int     VSAM_calibrateCheck( short card,VSAMMEM *pMem );
 static VSAM_ID VSAM_getByAddr( unsigned long baseAddr );
+static void    VSAM_counter_report( VSAM_ID pcard );
+static int     VSAM_ai_read( VSAM_ID pcard,short channel,char type,VSAMPVT *ppvt,float *prval );
+static int     VSAM_input( VSAM_ID pcard,short lchan,char type,unsigned long mask,unsigned long *pval );
+static int     VSAM_output( VSAM_ID pcard,short channel,unsigned long mask,unsigned long *pval );
+static int     VSAM_snap_read( VSAM_ID pcard,short channel,char type,VSAMPVT *ppvt,float *prval );
+static int     VSAM_snap_range( VSAMSNAP *psnap,VSAMPVT *ppvt,float *pval );
+static void    VSAM_limit_eval( VSAM_ID pcard,unsigned long dmask );
+static int     VSAM_acquire_pass( VSAM_ID pcard,unsigned long dmask,unsigned long rmask,
+                                  unsigned long amask,int sched,int claimed );
+
+static const float ranges[] = { 10.24, 5.12, 2.56, 1.28, 0.64, 
+                                0.32,  0.16, 0.08, 0.04, 0.02, 
+                                0.01 };
+
+static char *histName_c[VSAM_NUM_HISTS] = { "ai read", "input", "output", "acquire" };
 
 /* Global variables        */
 /* VSAM driver entry table */
@@ -66,7 +79,9 @@ static long init()
 
     for( pcard=(VSAM_ID)ellFirst((ELLLIST *)&VSAM_card_list); pcard; pcard = (VSAM_ID)ellNext((ELLNODE *)pcard)) 
     {
+       VSAM_trace( pcard->card,VSAM_TRC_INIT,0 );
        status = VSAM_init( pcard );
+       VSAM_trace( pcard->card,VSAM_TRC_INIT|VSAM_TRC_END,status );
        if ( status==OK )  {
 	  pcard->present = 1;
           if (VSAM_DRV_DEBUG) 
@@ -75,9 +90,20 @@ static long init()
        }
        else {
           printf( "DRVSUP: VSAM card %d found, initialization failed\n", pcard->card);
+          VSAM_trace( pcard->card,VSAM_TRC_QUARANTINE,status );
        } 
+       /* these only see data that is acquired, nothing reads it for them */
+       if ( (pcard->ptrend || pcard->phistory || pcard->pderive || pcard->psubs) &&
+            !pcard->psched && !pcard->triggered )
+          errlogPrintf("VSAM: card %hd keeps trends, history, derived or subscribed data "
+                       "but is not acquired, use VSAM_sched_set() or VSAM_trig_enable()\n",pcard->card);
     } /* End of i_card FOR loop */  
 
+    /* start acquisition for the cards that have a schedule */
+    VSAM_clock_init();
+    VSAM_pool_start();
+    VSAM_replay_start();
+    VSAM_mode_start();
     return( status );
 }
 
@@ -103,8 +129,8 @@ int VSAM_config( short card, unsigned long addr)
     int               status=ERROR;
     size_t            len = sizeof(VSAMCNFG); 
     unsigned long     ioBase = 0;
-    epicsAddressType  space = atVMEA24;   /* A24/D32 address space */
     char              name_c[40];
+    short             i,chan;
     VSAM_ID           pcard = NULL;
 
 
@@ -131,8 +157,15 @@ int VSAM_config( short card, unsigned long addr)
 
     /* Allocate memory for VSAM card */
     pcard = callocMustSucceed(1, len,"VSAM_create");
+    pcard->lock = epicsMutexMustCreate();
+    for (i=0; i<VSAM_NUM_IDX; i++) {
+      for (chan=0; chan<VSAM_NUM_CHANS; chan++) 
+        scanIoInit( &pcard->ioscan[i][chan] );
+    }
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++) 
+      scanIoInit( &pcard->limit_ioscan[chan] );
     sprintf(name_c,"VSAM-%.2hd",card );
-    status = devRegisterAddress(name_c, space, addr, sizeof(VSAMMEM),(void *)&pcard->pVSAM);
+    status = (*pVSAMbus->map)(name_c, card, addr, &pcard->pVSAM);
     if ( status == OK ) 
     {
       pcard->card       = card;
@@ -140,6 +173,7 @@ int VSAM_config( short card, unsigned long addr)
       ellAdd( (ELLLIST *)&VSAM_card_list, (ELLNODE *)pcard);
       pcard->registered = 1;
       status = OK;
+      VSAM_trace( card,VSAM_TRC_CONFIG,addr );
     }
     else
     {
@@ -153,7 +187,7 @@ int VSAM_config( short card, unsigned long addr)
 /*****************************************************************/
 /* Find VSAM by card number from link list                       */
 /*****************************************************************/
-static VSAM_ID VSAM_getByCard( short  card )
+VSAM_ID VSAM_getByCard( short  card )
 {
     VSAM_ID  pcard = NULL;
 
@@ -167,6 +201,16 @@ static VSAM_ID VSAM_getByCard( short  card )
     return pcard;
 }
 
+/*****************************************************************/
+/* Walk the link list, starting from the first card if NULL      */
+/*****************************************************************/
+VSAM_ID VSAM_next_card( VSAM_ID pcard )
+{
+    if( !card_list_inited ) return NULL;
+    if( !pcard ) return (VSAM_ID)ellFirst((ELLLIST *)&VSAM_card_list);
+    return (VSAM_ID)ellNext((ELLNODE *)pcard);
+}
+
 /****************************************************************/
 /* Find VSAM by base address from link list                     */
 /****************************************************************/
@@ -211,7 +255,7 @@ int   VSAM_init( VSAM_ID pcard )
      int	     status = OK;
      unsigned long   val;
      short           chan;
-     unsigned        len  = sizeof(val);
+     epicsUInt32     probe;
      VSAMMEM        *pVSAM = NULL;
      volatile uint32_t *ptr=NULL;
      double          nsec  = 0.2;
@@ -222,14 +266,16 @@ int   VSAM_init( VSAM_ID pcard )
      /*    val   = in_be32( (volatile void *)pVSAM );
 	   printf("VSAM init: ch0=0x%lx\n",val); */
     
-     status = devReadProbe(len,(volatile void *)pVSAM,(void*)&val); 
+     VSAM_trace( pcard->card,VSAM_TRC_PROBE,0 );
+     status = VSAM_PROBE(pVSAM,&probe); 
+     VSAM_trace( pcard->card,VSAM_TRC_PROBE|VSAM_TRC_END,status );
      if (status) {
-        errlogPrintf(noCard_c,(int)pcard->card,(int)pVSAM,0,0,0,0);
+        errlogPrintf(noCard_c,(int)pcard->card,(void *)pVSAM);
         return(status);
      }   
     
      if (VSAM_DRV_DEBUG) {
-       errlogPrintf(cardFound_c,(int)pcard->card,(int)pVSAM,0,0,0,0);
+       errlogPrintf(cardFound_c,(int)pcard->card,(void *)pVSAM);
      }
 
     /* Before doing anything, ensure that data and registers 
@@ -245,7 +291,9 @@ int   VSAM_init( VSAM_ID pcard )
        printf("\nBefore the clear\n");
        VSAM_testMem( (const VSAMMEM *)pVSAM );
      }
+     VSAM_trace( pcard->card,VSAM_TRC_CLEAR,0 );
      VSAM_clear( pVSAM );
+     VSAM_trace( pcard->card,VSAM_TRC_CLEAR|VSAM_TRC_END,0 );
      if (VSAM_DRV_DEBUG) { 
         printf("\nAfter the clear\n");
         VSAM_testMem( (const VSAMMEM *)pVSAM );
@@ -266,30 +314,32 @@ int   VSAM_init( VSAM_ID pcard )
      *  already set. 03/28/02 
      *
      */
-     val = in_be32((volatile void *)&pVSAM->mode_control); 
+     VSAM_trace( pcard->card,VSAM_TRC_FWREAD,0 );
+     val = VSAM_IN32(&pVSAM->mode_control); 
      val |= SET_FIRMWARE;
-     out_be32((volatile void *)&pVSAM->mode_control,val);
+     VSAM_OUT32(&pVSAM->mode_control,val);
 
 
      if (VSAM_DRV_DEBUG)
         printf("Wait of %f seconds before reading fw version\n",nsec);
      epicsThreadSleep(nsec);         
      for ( chan=0,ptr=(volatile uint32_t *)pVSAM->data; chan<VSAM_NUM_CHANS; chan++,ptr++ ) { 
-          pcard->fw_version[chan] = in_be32((volatile void *)ptr);
+          pcard->fw_version[chan] = VSAM_IN32(ptr);
      }
 
     /* 
      * Reset the MODE CONTROL register to 
      * normal scan, analog data and big-endian mode.
      */
-     out_be32((volatile void *)&pVSAM->mode_control,0);
+     VSAM_OUT32(&pVSAM->mode_control,0);
+     VSAM_trace( pcard->card,VSAM_TRC_FWREAD|VSAM_TRC_END,(unsigned long)pcard->fw_version[0] );
      status = OK;
   
-     VSAM_calibrateCheck( pVSAM );
+     VSAM_calibrateCheck( pcard->card,pVSAM );
      return( status );
 }
 
-static int VSAM_calibrateCheck( VSAMMEM *pVSAM )
+static int VSAM_calibrateCheck( short card,VSAMMEM *pVSAM )
 {
    int     status = OK;
    int     attempts=0;
@@ -303,7 +353,8 @@ static int VSAM_calibrateCheck( VSAMMEM *pVSAM )
        so this code could be removed. dayle 03/29/02
      */     
     /* then the calibration bit is set, so fine */ 
-     val = in_be32((volatile void *)&pVSAM->status);
+     VSAM_trace( card,VSAM_TRC_CALIB,0 );
+     val = VSAM_IN32(&pVSAM->status);
      if ( val & CALIB_SUCCESS ){
         if (VSAM_DRV_DEBUG)  
            printf("Calibration bit is set. Proceed as normal.\n"); 
@@ -311,7 +362,8 @@ static int VSAM_calibrateCheck( VSAMMEM *pVSAM )
      else {
        /* then the calibration bit is not set, so retry */
        for (attempts=0; !calib && (attempts<10); attempts++) {
-	 val= in_be32((volatile void *)&pVSAM->status);
+	 val= VSAM_IN32(&pVSAM->status);
+         VSAM_trace( card,VSAM_TRC_CALIB_TRY,val );
          if (val &= CALIB_SUCCESS){ 
            printf("Calibration: status register = 0x%lx\n",val);
            calib=1;
@@ -329,6 +381,7 @@ static int VSAM_calibrateCheck( VSAMMEM *pVSAM )
          printf("Detected calibration successful after %2d seconds\n",attempts);
        }
      }/* end of if */ 
+     VSAM_trace( card,VSAM_TRC_CALIB|VSAM_TRC_END,status );
      return( status );
 }
 
@@ -341,20 +394,20 @@ int VSAM_clear( VSAMMEM *pVSAM )
    double  nsec = 2.0;
 
     for (i=0,ptr=(volatile uint32_t *)pVSAM->data; i<32; i++,ptr++) {
-      out_be32((volatile void *)ptr,0);
+      VSAM_OUT32(ptr,0);
     }
 
     /* There are 32 range values of type char, but they are accessed via A24/D32 address space */
     for (i=0,ptr=(volatile uint32_t *)pVSAM->range ; i<8; i++,ptr++) {
-        out_be32((volatile void *)ptr,0);  
+        VSAM_OUT32(ptr,0);  
     }
 
     /* There are 32 ac values of type short, but they are accessed via A24/D32 address space */
     for (i=0,ptr=(volatile uint32_t *)pVSAM->ac; i<16; i++,ptr++) {
-        out_be32((volatile void *)ptr,0); 
+        VSAM_OUT32(ptr,0); 
     }
     /* 2 seconds after a reset valid data is available */
-    out_be32((volatile void *)&pVSAM->reset,0);
+    VSAM_OUT32(&pVSAM->reset,0);
      if (VSAM_DRV_DEBUG)
        printf("Wait of %f seconds after reset\n",nsec);
      epicsThreadSleep(nsec);
@@ -365,13 +418,13 @@ int VSAM_clear( VSAMMEM *pVSAM )
      * D2: 0= Big endian mode, 1= Little endian mode
      * D3: 0= Internal Calibration failed, 1= Internal calibration successful
      */
-    out_be32((volatile void *)&pVSAM->mode_control,0);
+    VSAM_OUT32(&pVSAM->mode_control,0);
 
     /* Note: can't zero status register because it's read-only */
-    out_be32((volatile void *)&pVSAM->pad,0);
-    out_be32((volatile void *)&pVSAM->diag_mode,0);
+    VSAM_OUT32(&pVSAM->pad,0);
+    VSAM_OUT32(&pVSAM->diag_mode,0);
     for (i=0; i<3; i++) {
-        out_be32((volatile void *)&pVSAM->padding[i],0);
+        VSAM_OUT32(&pVSAM->padding[i],0);
     } 
     return OK;
 }
@@ -391,7 +444,7 @@ int verifyVSAM( short  card, short channel,char   parm)
     /* verify that specified card is present */
     pcard = VSAM_getByCard( card );
     if ( pcard && pcard->present ) {
-      if ((channel >= VSAM_NUM_CHANS+4) || (channel < 0)) {
+      if ((channel >= VSAM_NUM_CHANS+5) || (channel < 0)) {
 	if (VSAM_DRV_DEBUG>1) printf(chanOutOfRange,VSAM_NUM_CHANS,channel);
 	status = -2;
       }
@@ -399,6 +452,15 @@ int verifyVSAM( short  card, short channel,char   parm)
       {
 	status = OK;
       }
+      else if (parm == PERF_TYPE) {
+        status = (channel < VSAM_NUM_COUNTERS) ? OK : -2;
+      }
+      else if (parm == FFT_TYPE) {
+        status = (channel < VSAM_NUM_CHANS) ? OK : -2;
+      }
+      else if (parm == DERIV_TYPE) {
+        status = (channel < VSAM_NUM_DERIVED) ? OK : -2;
+      }
       else {
          status = -2;
 	 if (VSAM_DRV_DEBUG) printf(invParam_c,parm);
@@ -433,6 +495,7 @@ int checkVSAMAi(short channel)
  */
 int checkVSAMBi( short channel,char parm )
 {
+   if ((parm == LIMIT_TYPE) && (channel < VSAM_NUM_CHANS)) return(0);
    if (channel != STATUS_CHANNEL) return(-2);
    return(0);
 }
@@ -464,6 +527,7 @@ int bo_VSAM_read( short	        card,
     int        status = OK;
     VSAMMEM   *pVSAM = NULL;
     unsigned long val=0;
+    VSAM_ID    pcard = NULL;
 
 
     status = VSAM_get_adrs( card,&pVSAM );
@@ -472,8 +536,10 @@ int bo_VSAM_read( short	        card,
 	if (pVSAM == 0)  
            status = ERROR;
         else {
-	  val   = in_be32((volatile void *)&pVSAM->status);
+	  val   = VSAM_IN32(&pVSAM->status);
           *pval = val & mask;
+          pcard = VSAM_getByCard( card );
+          pcard->stats.csr_reads++;
 	}
       }
       else {
@@ -487,7 +553,8 @@ int bo_VSAM_read( short	        card,
  * getVSAMBitMask - get single bit mask from bit specification.
  *
  * Bit specification is character for bit number: '0', '1', etc.
- * This is only relevant for the Mode Control and Status Registers.
+ * This is only relevant for the Mode Control and Status Registers,
+ * and for the comparators of a channel: 'H' high, 'L' low, else both.
  */
 int getVSAMBitMask( short          channel,
                     char           spec,
@@ -495,6 +562,12 @@ int getVSAMBitMask( short          channel,
 {
     int	shift,max_shift;
 
+    if ((channel >= 0) && (channel < VSAM_NUM_CHANS)) {
+      if (spec == 'H')      *pmask = VSAM_LIMIT_HIGH;
+      else if (spec == 'L') *pmask = VSAM_LIMIT_LOW;
+      else                  *pmask = VSAM_LIMIT_HIGH|VSAM_LIMIT_LOW;
+      return(0);
+    }
     if (channel == MODE_CHANNEL) max_shift = 2;
     else if (channel == STATUS_CHANNEL) max_shift = 3;
     else return(0);
@@ -564,6 +637,25 @@ int ai_VSAM_read( short	    card,
                   char      type,
                   VSAMPVT  *ppvt,
                   float	   *prval)
+{
+    int              status;
+    epicsUInt32      start;
+    VSAM_ID          pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present ) return(ERROR);
+
+    start  = VSAM_cycles();
+    status = VSAM_ai_read( pcard,channel,type,ppvt,prval );
+    VSAM_hist_add( &pcard->hist[VSAM_HIST_AI_READ],start );
+    return(status);
+}
+
+static int VSAM_ai_read( VSAM_ID   pcard,
+                         short	   channel,
+                         char      type,
+                         VSAMPVT  *ppvt,
+                         float	  *prval)
 {
     int              status = OK;
     unsigned long    rlong;
@@ -571,30 +663,53 @@ int ai_VSAM_read( short	    card,
     float	     rfloat;
     double	     dfactor,
 	             dpp;
-    VSAMMEM         *pVSAM;
+    VSAMMEM         *pVSAM = pcard->pVSAM;
+    int              idx = VSAM_type_index( type );
 
 
-    status = VSAM_get_adrs( card,&pVSAM );
-    if ( status ==OK ) {
+    pcard->stats.records++;
 
-      /* VSAM is D32 only, so bytes and shorts must be extracted here */
-      switch ((int)type) {
+    /* 
+     * channels acquired by the scheduler, triggered cards and
+     * averaged or filtered channels are served from the snapshot 
+     */
+    if ( pcard->pavg && (type==DATA_TYPE) && (pcard->pavg->mask & (1UL<<channel)) )
+        return( VSAM_snap_read(pcard,channel,type,ppvt,prval) );
+    if ( pcard->pfilt && (type==DATA_TYPE) && (pcard->pfilt->mask & (1UL<<channel)) )
+        return( VSAM_snap_read(pcard,channel,type,ppvt,prval) );
+    if ( pcard->triggered && (idx>=0) ) 
+        return( VSAM_snap_read(pcard,channel,type,ppvt,prval) );
+    if ( pcard->psched && (idx>=0) && (pcard->psched->mask[idx] & (1UL<<channel)) )
+        return( VSAM_snap_read(pcard,channel,type,ppvt,prval) );
+    /* interleaved cards give AC and range of the last normal scan */
+    if ( pcard->pmode && pcard->pmode->on && ((type==AC_TYPE) || (type==RANGE_TYPE)) )
+        return( VSAM_snap_read(pcard,channel,type,ppvt,prval) );
+
+    /* AC needs status, range and AC words */
+    VSAM_bus_claim( pcard,(type==AC_TYPE) ? 3 : 1 );
+
+    /* VSAM is D32 only, so bytes and shorts must be extracted here */
+    switch ((int)type) {
 	case RANGE_TYPE:
+	    pcard->stats.range_reads++;
 	    return(getVSAMRange(pVSAM, ppvt, prval));
 	    break;
 
 	case AC_TYPE:
    	    /* AC peak-to-peak voltage is ranges[range]*ac/(2**14)     */
 	    /* no AC info unless normal scan and analog data requested */
-	    if (pVSAM->status & (FAST_SCAN_MODE|FIRMWARE_REV)) return(-1);
+	    pcard->stats.csr_reads++;
+	    if (VSAM_IN32(&pVSAM->status) & (FAST_SCAN_MODE|FIRMWARE_REV)) return(-1);
 
 	    /* first get range... */
+	    pcard->stats.range_reads++;
 	    if (getVSAMRange(pVSAM, ppvt->prange, &rfloat) != 0) return(-1);
 
 	    dfactor = (double)rfloat/(double)AC_DIVISOR;
 
 	    /* now get AC measurement */
-	    rlong  = in_be32((volatile void *)&pVSAM->ac[ppvt->lchan]);
+	    rlong  = VSAM_IN32(&pVSAM->ac[ppvt->lchan]);
+	    pcard->stats.ac_reads++;
 	    rshort = (short)((rlong & ppvt->mask) >> ppvt->shift);
 	    dpp    = dfactor * (double)rshort;
 	    *prval = (float)dpp;
@@ -602,14 +717,271 @@ int ai_VSAM_read( short	    card,
 
 	default:
 	    /* rfloat = (float)in_be32((volatile void *)&pVSAM->data[channel]); */ /* This line is incorrect?  Dereferencing a float as a uint32_t. */
-	    rfloat = pVSAM->data[channel]; /* pVSAM->data[channel] is already a float */
+	    rfloat = VSAM_INF(&pVSAM->data[channel]); /* pVSAM->data[channel] is already a float */
 	    *prval = rfloat; 
+	    pcard->stats.data_reads++;
+	    break;
+    }
+    return(status);
+}
+
+/*
+ * VSAM_snap_read - ai_VSAM_read() from the snapshot instead of the bus
+ */
+static int VSAM_snap_read( VSAM_ID   pcard,
+                           short     channel,
+                           char      type,
+                           VSAMPVT  *ppvt,
+                           float    *prval)
+{
+    int              status = OK;
+    unsigned long    rlong;
+    short	     rshort;
+    float	     rfloat;
+    VSAMSNAP        *psnap = &pcard->snap;
+
+    epicsMutexMustLock( pcard->lock );
+    if ( pcard->triggered ) psnap = &pcard->trig_snap;
+    if ( pcard->pmode && pcard->pmode->on && (type!=DATA_TYPE) ) {
+        if ( !pcard->pmode->valid ) {
+            epicsMutexUnlock( pcard->lock );
+            return(-1);
+        }
+        psnap = &pcard->pmode->cache;
+    }
+    switch ((int)type) {
+	case RANGE_TYPE:
+	    status = VSAM_snap_range(psnap, ppvt, prval);
+	    break;
+
+	case AC_TYPE:
+	    if ((psnap->status & (FAST_SCAN_MODE|FIRMWARE_REV)) ||
+	        (VSAM_snap_range(psnap, ppvt->prange, &rfloat) != 0)) {
+	        status = -1;
+	        break;
+	    }
+	    rlong  = psnap->ac[ppvt->lchan/2];
+	    rshort = (short)((rlong & ppvt->mask) >> ppvt->shift);
+	    *prval = (float)((double)rfloat/(double)AC_DIVISOR * (double)rshort);
+	    break;
+
+	default:
+	    /* the average is taken of the filtered data */
+	    if ( pcard->pavg && (pcard->pavg->valid & (1UL<<channel)) &&
+	         !(psnap->status & FIRMWARE_REV) )
+	        *prval = pcard->pavg->value[channel];
+	    else if ( pcard->pfilt && (pcard->pfilt->valid & (1UL<<channel)) &&
+	              !(psnap->status & FIRMWARE_REV) )
+	        *prval = pcard->pfilt->out[channel];
+	    else
+	        *prval = psnap->data[channel];
 	    break;
-      }
     }
+    epicsMutexUnlock( pcard->lock );
     return(status);
 }
 
+/*
+ * VSAM_snap_range - getVSAMRange() from the snapshot
+ */
+static int VSAM_snap_range( VSAMSNAP *psnap,VSAMPVT *ppvt,float *pval )
+{
+    unsigned long  i_range;
+
+    i_range = (char)((psnap->range[ppvt->lchan/4] & ppvt->mask) >> ppvt->shift);
+    if ( i_range>MAX_RANGE_BYTE ) return(-1);
+    *pval = ranges[ i_range ];
+    return(0);
+}
+
+/*
+ * VSAM_limit_set - set the comparators of channels first..last
+ *
+ *  which is "H", "L", "HL" for the comparators to use, or "0"
+ *  to turn them off.  The channels are put on the acquisition
+ *  schedule at period, which is then how often the comparators
+ *  are evaluated; a period is needed to turn comparators on, and
+ *  a period of zero takes them off the schedule again.
+ */
+long VSAM_limit_set( short card,short first,short last,const char *which,
+                     double low,double high,double hyst,double period )
+{
+    VSAM_ID     pcard = NULL;
+    VSAMLIMIT  *plim = NULL;
+    short       chan;
+    int         use_high,use_low;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !which || (first<0) || (last>=VSAM_NUM_CHANS) || (first>last) || 
+         (hyst<0.0) || (period<0.0) ) {
+       errlogPrintf("VSAM_limit_set: bad card %hd, channels %hd..%hd or hysteresis\n",card,first,last);
+       return(ERROR);
+    }
+    use_high = (strchr(which,'H')!=NULL);
+    use_low  = (strchr(which,'L')!=NULL);
+    if ( (use_high || use_low) && (period<=0.0) ) {
+       errlogPrintf("VSAM_limit_set: comparators need a period to be evaluated at\n");
+       return(ERROR);
+    }
+    if ( use_high && use_low && (low>=high) ) {
+       errlogPrintf("VSAM_limit_set: low %g must be below high %g\n",low,high);
+       return(ERROR);
+    }
+
+    if ( VSAM_sched_claim(card,DATA_TYPE,VSAM_CHAN_RANGE(first,last),period,VSAM_SCHED_LIMIT)!=OK )
+       return(ERROR);
+
+    plim = &pcard->limit;
+    epicsMutexMustLock( pcard->lock );
+    for (chan=first; chan<=last; chan++) {
+       plim->high[chan] = (float)high;
+       plim->low[chan]  = (float)low;
+       plim->hyst[chan] = (float)hyst;
+       if ( use_high ) plim->high_on |=  (1UL<<chan);
+       else            plim->high_on &= ~(1UL<<chan);
+       if ( use_low )  plim->low_on  |=  (1UL<<chan);
+       else            plim->low_on  &= ~(1UL<<chan);
+       plim->high_state &= ~(1UL<<chan);
+       plim->low_state  &= ~(1UL<<chan);
+    }
+    epicsMutexUnlock( pcard->lock );
+
+    for (chan=first; chan<=last; chan++) {
+       VSAM_register_use( card,chan,DATA_TYPE );
+       scanIoRequest( pcard->limit_ioscan[chan] );
+    }
+    return(OK);
+}
+
+/*
+ * VSAM_limit_eval - run the comparators of the channels just read
+ *
+ *  Called by VSAM_acquire_mask() with the card locked.  bi records
+ *  of a channel whose state changed are posted at once.
+ */
+static void VSAM_limit_eval( VSAM_ID pcard,unsigned long dmask )
+{
+    VSAMLIMIT      *plim = &pcard->limit;
+    unsigned long   bit,old;
+    float           val;
+    short           chan;
+
+    if ( pcard->snap.status & FIRMWARE_REV ) return;
+    dmask &= (plim->high_on | plim->low_on);
+    for (chan=0; dmask && (chan<VSAM_NUM_CHANS); chan++) {
+       bit = 1UL<<chan;
+       if ( !(dmask & bit) ) continue;
+       dmask &= ~bit;
+       val = pcard->snap.data[chan];
+       old = (plim->high_state | plim->low_state) & bit;
+
+       if ( plim->high_on & bit ) {
+          if ( val>=plim->high[chan] ) plim->high_state |= bit;
+          else if ( val<plim->high[chan]-plim->hyst[chan] ) plim->high_state &= ~bit;
+       }
+       if ( plim->low_on & bit ) {
+          if ( val<=plim->low[chan] ) plim->low_state |= bit;
+          else if ( val>plim->low[chan]+plim->hyst[chan] ) plim->low_state &= ~bit;
+       }
+       if ( old != ((plim->high_state | plim->low_state) & bit) ) {
+          if ( !old ) plim->trips++;
+          scanIoRequest( pcard->limit_ioscan[chan] );
+       }
+    }
+}
+
+/*
+ * VSAM_snap_decode - values of all channels of one type (DATA_TYPE,
+ *                    RANGE_TYPE or AC_TYPE) from a snapshot.
+ *
+ *  Returns -1 if the snapshot holds no such values, ie. firmware
+ *  revision instead of data, or AC in fast scan mode.  A channel
+ *  with a bad range byte reads 0.
+ */
+int VSAM_snap_decode( const VSAMSNAP *psnap,char type,float *pval )
+{
+    short          chan;
+    unsigned long  i_range;
+    short          rshort;
+
+    if ( psnap->status & FIRMWARE_REV ) return(-1);
+    switch ((int)type) {
+	case DATA_TYPE:
+	    for (chan=0; chan<VSAM_NUM_CHANS; chan++) pval[chan] = psnap->data[chan];
+	    break;
+
+	case RANGE_TYPE:
+	case AC_TYPE:
+	    if ( (type==AC_TYPE) && (psnap->status & FAST_SCAN_MODE) ) return(-1);
+	    for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+	        i_range = (psnap->range[chan/4] >> ((chan%4)*8)) & 0xff;
+	        if ( i_range>MAX_RANGE_BYTE ) {
+	            pval[chan] = 0.0;
+	            continue;
+	        }
+	        pval[chan] = ranges[ i_range ];
+	        if ( type==AC_TYPE ) {
+	            rshort = (short)((psnap->ac[chan/2] >> ((chan%2)*16)) & 0xffff);
+	            pval[chan] = (float)((double)pval[chan]/(double)AC_DIVISOR * (double)rshort);
+	        }
+	    }
+	    break;
+
+	default:
+	    return(-1);
+    }
+    return(0);
+}
+
+/*
+ * VSAM_type_index - index of a data type in the per-type tables
+ */
+int VSAM_type_index( char type )
+{
+    switch ((int)type) {
+	case DATA_TYPE:  return(VSAM_IDX_DATA);
+	case RANGE_TYPE: return(VSAM_IDX_RANGE);
+	case AC_TYPE:    return(VSAM_IDX_AC);
+    }
+    return(-1);
+}
+
+/*
+ * VSAM_get_ioscan - I/O Intr scan list of a channel and data type
+ */
+int VSAM_get_ioscan( short card,short channel,char type,IOSCANPVT *ppvt )
+{
+    int      idx;
+    VSAM_ID  pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    idx   = VSAM_type_index( type );
+    if ( !pcard || (channel<0) || (channel>=VSAM_NUM_CHANS) ) return(ERROR);
+    if ( type==LIMIT_TYPE ) {
+        *ppvt = pcard->limit_ioscan[channel];
+        return(OK);
+    }
+    if ( type==FFT_TYPE ) {
+        if ( !pcard->pfft ) return(ERROR);
+        *ppvt = pcard->pfft->ioscan;
+        return(OK);
+    }
+    if ( type==DERIV_TYPE ) {
+        if ( !pcard->pderive ) return(ERROR);
+        *ppvt = pcard->pderive->ioscan;
+        return(OK);
+    }
+    if ( type==TREND_TYPE ) {
+        /* channel is the level */
+        if ( !pcard->ptrend || (channel>=VSAM_TREND_LEVELS) ) return(ERROR);
+        *ppvt = pcard->ptrend->lvl[channel].ioscan;
+        return(OK);
+    }
+    if ( idx<0 ) return(ERROR);
+    *ppvt = pcard->ioscan[idx][channel];
+    return(OK);
+}
+
 /*
  * getVSAMRange - derive floating-point range value for channel
  */
@@ -619,11 +991,8 @@ int getVSAMRange( VSAMMEM  *pMem,
 {
     int                 status = 0;
     unsigned long	rlong,i_range;
-    static const float  ranges[] = { 10.24, 5.12, 2.56, 1.28, 0.64, 
-                                     0.32,  0.16, 0.08, 0.04, 0.02, 
-                                     0.01 };
 
-    rlong = in_be32((volatile void *) &pMem->range[ppvt->lchan] );
+    rlong = VSAM_IN32(&pMem->range[ppvt->lchan]);
     i_range = (char)((rlong & ppvt->mask) >> ppvt->shift);
     if ( i_range>MAX_RANGE_BYTE ) 
       status = -1;
@@ -641,29 +1010,60 @@ int input_VSAM_driver( short           card,
                        unsigned long   mask,
                        unsigned long  *pval)
 {
-    int                 status=OK;
-    unsigned long	lval = 0;
-    VSAMMEM		*pVSAM;
+    int                 status;
+    epicsUInt32         start;
+    VSAM_ID             pcard = NULL;
 
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present ) return(ERROR);
 
-    status = VSAM_get_adrs( card,&pVSAM );
-    if ( status ==OK ) {
-      if (lchan < VSAM_NUM_CHANS) {
+    start  = VSAM_cycles();
+    status = VSAM_input( pcard,lchan,type,mask,pval );
+    VSAM_hist_add( &pcard->hist[VSAM_HIST_INPUT],start );
+    return(status);
+}
+
+static int VSAM_input( VSAM_ID         pcard,
+                       short           lchan,
+                       char            type,
+                       unsigned long   mask,
+                       unsigned long  *pval)
+{
+    int                 status=OK;
+    unsigned long	lval = 0;
+    VSAMMEM		*pVSAM = pcard->pVSAM;
+
+
+    pcard->stats.records++;
+    if (type == LIMIT_TYPE) {
+	/* comparator state, no bus access */
+	if ((lchan < 0) || (lchan >= VSAM_NUM_CHANS)) return(-2);
+	epicsMutexMustLock( pcard->lock );
+	lval = ((pcard->limit.high_state>>lchan) & 1) ? VSAM_LIMIT_HIGH : 0;
+	if ((pcard->limit.low_state>>lchan) & 1) lval |= VSAM_LIMIT_LOW;
+	epicsMutexUnlock( pcard->lock );
+	*pval = lval & mask;
+	return(status);
+    }
+    VSAM_bus_claim( pcard,1 );
+    if (lchan < VSAM_NUM_CHANS) {
 	if (type == RANGE_TYPE) {
-	  lval = in_be32((volatile void *)&pVSAM->range[lchan]);
+	  lval = VSAM_IN32(&pVSAM->range[lchan]);
+	  pcard->stats.range_reads++;
 	}
 	else if (type == AC_TYPE) {
-	  lval = in_be32( (volatile void *)&pVSAM->ac[lchan]);
+	  lval = VSAM_IN32(&pVSAM->ac[lchan]);
+	  pcard->stats.ac_reads++;
 	}
 	else {
 	   return(-2);
 	}
-      }
-      else {
-	  lval = in_be32((volatile void *)&pVSAM->status);
-      }
-      *pval = lval & mask;
     }
+    else {
+	  lval = VSAM_IN32(&pVSAM->status);
+	  pcard->stats.csr_reads++;
+    }
+    *pval = lval & mask;
     return(status);
 }
 
@@ -674,26 +1074,55 @@ int output_VSAM_driver( short		card,
                         short		channel,
                         unsigned long	mask,
                         unsigned long	*pval)
+{
+    int             status;
+    epicsUInt32     start;
+    VSAM_ID         pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present ) return(ERROR);
+
+    start  = VSAM_cycles();
+    status = VSAM_output( pcard,channel,mask,pval );
+    VSAM_hist_add( &pcard->hist[VSAM_HIST_OUTPUT],start );
+    return(status);
+}
+
+static int VSAM_output( VSAM_ID         pcard,
+                        short		channel,
+                        unsigned long	mask,
+                        unsigned long	*pval)
 {
     int            status=OK;
     unsigned long   sval,
 		    lval,
 		    rval;
-    VSAMMEM         *pVSAM = NULL;
+    VSAMMEM         *pVSAM = pcard->pVSAM;
 
 
-    status = VSAM_get_adrs( card,&pVSAM );
-    if ( status ==OK ) {
-      switch ((int)channel) {
+    pcard->stats.records++;
+    switch ((int)channel) {
+	case TRIGGER_CHANNEL:
+	    /* no bus access here, the cards are read by the trigger task */
+	    VSAM_trigger();
+	    break;
 	case RESET_CHANNEL:
-	    out_be32((volatile void *)&pVSAM->reset, 0);
+	    VSAM_bus_claim( pcard,1 );
+	    VSAM_OUT32(&pVSAM->reset,0);
+	    pcard->stats.reset_writes++;
+	    VSAM_trace( pcard->card,VSAM_TRC_RESET,0 );
 	    break;
 	case DIAG_CHANNEL:
-	    out_be32((volatile void *)&pVSAM->diag_mode,0);
+	    VSAM_bus_claim( pcard,1 );
+	    VSAM_OUT32(&pVSAM->diag_mode,0);
+	    pcard->stats.diag_writes++;
+	    VSAM_trace( pcard->card,VSAM_TRC_DIAG,0 );
 	    break;
 	default:
 	    /* Only three bits of mode control register are used */
-	    sval = in_be32((volatile void *)&pVSAM->status);
+	    VSAM_bus_claim( pcard,2 );
+	    sval = VSAM_IN32(&pVSAM->status);
+	    pcard->stats.csr_reads++;
 	    sval &= MODE_MASK;
 	    rval = *pval;
 	    if (mask == MODE_MASK) lval = rval & mask;	/* multi-bit output */
@@ -701,9 +1130,10 @@ int output_VSAM_driver( short		card,
 		if (rval & mask) lval = sval | mask;	/* set single bit */
 		else lval = sval & ~mask;		/* clear single bit */
 	    }
-	    out_be32((volatile void *)&pVSAM->mode_control,lval);
+	    VSAM_OUT32(&pVSAM->mode_control,lval);
+	    pcard->stats.mode_writes++;
+	    VSAM_trace( pcard->card,VSAM_TRC_MODE,lval );
 	    break;
-      }
     }
     return(status);
 }
@@ -718,6 +1148,7 @@ static long report(int	level)
 /*
  * VSAM_io_report - report VSAM's present.  For level 1 report,
  *			print raw data for each channel.
+ *			Level 3 adds the driver counters.
  */
 long VSAM_io_report( char level )
 {
@@ -728,6 +1159,14 @@ long VSAM_io_report( char level )
         printf("No VSAM Modules present\n");
         return(OK);
     }
+    if ( level>=3 ) {
+        VSAM_budget_report();
+        VSAM_pool_report();
+        VSAM_trig_report();
+        VSAM_shm_report();
+        VSAM_rec_report();
+        VSAM_replay_report();
+    }
 
     for(pcard=(VSAM_ID)ellFirst((ELLLIST *)&VSAM_card_list); pcard; pcard = (VSAM_ID)ellNext((ELLNODE *)pcard))
     {
@@ -742,7 +1181,8 @@ long VSAM_io_report( char level )
 	 printf("VSAM:\tcard %hd\tA24: %p\t status: 0x%x\n", 
                  pcard->card, 
                  pcard->pVSAM, 
-                 in_be32((volatile void *)&pVSAM->status));
+                 VSAM_IN32(&pVSAM->status));
+         VSAM_counter_report( pcard );
       }
     }/* End of FOR loop */
     return OK;
@@ -767,12 +1207,12 @@ void VSAM_rval_report( short int card, short int flag )
      pcard = VSAM_getByCard( card );
      if ( pcard && pcard->present ) {
        pVSAM = pcard->pVSAM;
-       printf("STATUS reg: 0x%x\n",in_be32((volatile void *)&pVSAM->status)); 
+       printf("STATUS reg: 0x%x\n",VSAM_IN32(&pVSAM->status)); 
        for (i=0,ptr=(volatile uint32_t *)pVSAM->data; i<VSAM_NUM_CHANS; i++,ptr++)
        {
          if ( flag ) {
            version_frac  = modf((double)pcard->fw_version[i],&version_base); 
-           val = (double)in_be32((volatile void *)ptr);
+           val = (double)VSAM_IN32(ptr);
 	   printf("\tch %2hd: data %e\t firmware ver: 0x%X\n", 
                   i, 
                   val,
@@ -780,7 +1220,7 @@ void VSAM_rval_report( short int card, short int flag )
 	}
 	 else
 	 {
-           val = (double)in_be32((volatile void *)ptr);
+           val = (double)VSAM_IN32(ptr);
 	   printf("\tch %2hd: data %e\n",i, val);
 	 }
       }/* End of Channel FOR loop */
@@ -841,3 +1281,459 @@ int VSAM_version( short card,unsigned short *pversion )
     }
     return(status);
 }
+
+/*
+ * VSAM_register_use - note that a record uses a channel and data type.
+ *
+ *  Called from init_record() in device support.  VSAM_acquire()
+ *  reads only the words holding the channels registered here.
+ *  An AC record needs the range byte of its channel as well.
+ */
+int VSAM_register_use( short card,short channel,char type )
+{
+    VSAMUSE  *puse = NULL;
+    VSAM_ID   pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard ) return(ERROR);
+
+    puse = &pcard->use;
+    epicsMutexMustLock( pcard->lock );
+    if ( channel>=VSAM_NUM_CHANS ) {
+        puse->csr = 1;
+    }
+    else if ( channel>=0 ) {
+        switch ((int)type) {
+          case DATA_TYPE:
+            puse->data_mask  |= 1UL<<channel;
+            break;
+          case AC_TYPE:
+            puse->ac_mask    |= 1UL<<channel;
+            puse->range_mask |= 1UL<<channel;
+            break;
+          case RANGE_TYPE:
+            puse->range_mask |= 1UL<<channel;
+            break;
+          default:
+            break;
+        }
+    }
+    epicsMutexUnlock( pcard->lock );
+    return(OK);
+}
+
+/*
+ * VSAM_acquire - read the whole card into the snapshot buffer.
+ *
+ *  If records have registered their channels, only the words
+ *  holding those channels are read.
+ */
+int VSAM_acquire( short card )
+{
+    VSAMUSE  *puse = NULL;
+    VSAM_ID   pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present ) return(ERROR);
+
+    puse = &pcard->use;
+    if ( puse->data_mask || puse->range_mask || puse->ac_mask || puse->csr ) 
+        return( VSAM_acquire_mask(pcard,puse->data_mask,puse->range_mask,puse->ac_mask) );
+    return( VSAM_acquire_mask(pcard,0xffffffff,0xffffffff,0xffffffff) );
+}
+
+/*
+ * VSAM_acquire_mask - read the status register and the D32 words
+ *                     holding the channels in the masks into the
+ *                     snapshot buffer.
+ *
+ *  The status register is probed first so that a missing or
+ *  faulty card is counted as a bus error rather than trapping.
+ *  The words are then read back-to-back with the snapshot locked.
+ *  Four range bytes share a word and two AC values share a word.
+ */
+int VSAM_acquire_mask( VSAM_ID       pcard,
+                       unsigned long dmask,
+                       unsigned long rmask,
+                       unsigned long amask )
+{
+    return( VSAM_acquire_pass(pcard,dmask,rmask,amask,0,0) );
+}
+
+/*
+ * VSAM_acquire_sched - VSAM_acquire_mask() for a pass of the
+ *                      scheduler; stages that run at the schedule
+ *                      period see pcard->sched_pass set.
+ */
+int VSAM_acquire_sched( VSAM_ID       pcard,
+                        unsigned long dmask,
+                        unsigned long rmask,
+                        unsigned long amask )
+{
+    return( VSAM_acquire_pass(pcard,dmask,rmask,amask,1,0) );
+}
+
+/*
+ * VSAM_acquire_claimed - VSAM_acquire_mask() for a caller that has
+ *                        claimed VSAM_acquire_words() from the bus
+ *                        budget already, so it can hold the card
+ *                        lock around it without sleeping in it
+ */
+int VSAM_acquire_claimed( VSAM_ID       pcard,
+                          unsigned long dmask,
+                          unsigned long rmask,
+                          unsigned long amask )
+{
+    return( VSAM_acquire_pass(pcard,dmask,rmask,amask,0,1) );
+}
+
+/*
+ * VSAM_acquire_words - bus accesses of an acquisition: the status
+ *                      and the words holding the channels in the masks
+ */
+unsigned long VSAM_acquire_words( unsigned long dmask,
+                                  unsigned long rmask,
+                                  unsigned long amask )
+{
+    unsigned long  n;
+    short          i;
+
+    for (i=0,n=1; i<VSAM_NUM_CHANS; i++) {
+        if ( dmask & (1UL<<i) ) n++;
+        if ( !(i%4) && (rmask & (0xfUL<<i)) ) n++;
+        if ( !(i%2) && (amask & (0x3UL<<i)) ) n++;
+    }
+    return(n);
+}
+
+static int VSAM_acquire_pass( VSAM_ID       pcard,
+                              unsigned long dmask,
+                              unsigned long rmask,
+                              unsigned long amask,
+                              int           sched,
+                              int           claimed )
+{
+    int                status = OK;
+    short              i;
+    unsigned long      val = 0;
+    unsigned long      nwords[3];
+    epicsUInt32        probe,start;
+    volatile uint32_t *ptr = NULL;
+    VSAMMEM           *pVSAM = NULL;
+    VSAMSNAP          *psnap = NULL;
+
+    if ( !pcard || !pcard->present ) return(ERROR);
+
+    pVSAM = pcard->pVSAM;
+    psnap = &pcard->snap;
+
+    /* wait for the bus budget before taking the lock */
+    if ( !claimed ) VSAM_bus_claim( pcard,VSAM_acquire_words(dmask,rmask,amask) );
+
+    nwords[0] = nwords[1] = nwords[2] = 0;
+    epicsMutexMustLock( pcard->lock );
+    pcard->sched_pass = sched;
+    epicsTimeGetCurrent( &psnap->stamp );
+    start = VSAM_cycles();
+    if ( VSAM_PROBE(&pVSAM->status,&probe) ) {
+        pcard->stats.bus_errors++;
+        VSAM_trace( pcard->card,VSAM_TRC_BUSERR,0 );
+        status = -1;
+    }
+    else {
+        val = probe;
+        psnap->status = val;
+        for (i=0; i<VSAM_NUM_CHANS; i++) {
+            if ( !(dmask & (1UL<<i)) ) continue;
+            psnap->data[i] = VSAM_INF(&pVSAM->data[i]);
+            nwords[0]++;
+        }
+        for (i=0,ptr=(volatile uint32_t *)pVSAM->range; i<VSAM_NUM_CHANS/4; i++,ptr++) {
+            if ( !(rmask & (0xfUL<<(i*4))) ) continue;
+            psnap->range[i] = VSAM_IN32(ptr);
+            nwords[1]++;
+        }
+        for (i=0,ptr=(volatile uint32_t *)pVSAM->ac; i<VSAM_NUM_CHANS/2; i++,ptr++) {
+            if ( !(amask & (0x3UL<<(i*2))) ) continue;
+            psnap->ac[i] = VSAM_IN32(ptr);
+            nwords[2]++;
+        }
+
+        pcard->stats.csr_reads++;
+        pcard->stats.data_reads  += nwords[0];
+        pcard->stats.range_reads += nwords[1];
+        pcard->stats.ac_reads    += nwords[2];
+        pcard->stats.snapshots++;
+        pcard->stats.acq_usec = (unsigned long)VSAM_cycle_usec( start );
+        VSAM_hist_add( &pcard->hist[VSAM_HIST_ACQUIRE],start );
+        if ( nwords[0] && !(val & FIRMWARE_REV) ) pcard->stats.fresh = psnap->stamp;
+        if ( nwords[0] && pcard->pfft ) 
+            VSAM_fft_sample( pcard,dmask );
+        if ( nwords[0] && pcard->pfilt ) 
+            VSAM_filter_run( pcard,dmask );
+        if ( nwords[0] && pcard->pavg ) 
+            VSAM_avg_sample( pcard,dmask );
+        if ( nwords[0] && (pcard->limit.high_on|pcard->limit.low_on) ) 
+            VSAM_limit_eval( pcard,dmask );
+        if ( nwords[0] && pcard->ptrend ) 
+            VSAM_trend_sample( pcard,dmask );
+        if ( nwords[0] && pcard->phistory ) 
+            VSAM_history_sample( pcard,dmask );
+        if ( pcard->pcapt && nwords[VSAM_type_index(pcard->pcapt->type)] ) 
+            VSAM_capture_sample( pcard,(pcard->pcapt->type==AC_TYPE) ? amask : dmask );
+        if ( (nwords[0] || nwords[2]) && pcard->pderive ) 
+            VSAM_derive_run( pcard,nwords[0] ? dmask : 0,nwords[2] ? amask : 0 );
+        if ( pcard->psubs && pcard->psubs->nsub ) 
+            VSAM_sub_notify( pcard,nwords[0] ? dmask : 0,nwords[1] ? rmask : 0,nwords[2] ? amask : 0 );
+    }
+    epicsMutexUnlock( pcard->lock );
+    return(status);
+}
+
+/*
+ * VSAM_get_snapshot - copy out the last whole-card acquisition
+ */
+int VSAM_get_snapshot( short card,VSAMSNAP *psnap )
+{
+    VSAM_ID  pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present || !psnap ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    *psnap = pcard->snap;
+    epicsMutexUnlock( pcard->lock );
+    return(OK);
+}
+
+/*
+ * VSAM_get_stamp - time of the last snapshot; for a triggered
+ *                  snapshot this is the time of the trigger
+ */
+int VSAM_get_stamp( short card,epicsTimeStamp *pstamp )
+{
+    VSAM_ID  pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    *pstamp = pcard->triggered ? pcard->trig_snap.stamp : pcard->snap.stamp;
+    epicsMutexUnlock( pcard->lock );
+    return(OK);
+}
+
+/*
+ * VSAM_get_counter - return one of the VSAM_CNT_xxx driver counters
+ */
+int VSAM_get_counter( short card,short counter,double *pval )
+{
+    int             status = OK;
+    unsigned long   count = 0;
+    epicsTimeStamp  now;
+    VSAMSTATS      *pstats = NULL;
+    VSAM_ID         pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present ) return(ERROR);
+
+    pstats = &pcard->stats;
+    switch ( counter ) {
+      case VSAM_CNT_DATA_READS:   *pval = pstats->data_reads;   break;
+      case VSAM_CNT_RANGE_READS:  *pval = pstats->range_reads;  break;
+      case VSAM_CNT_AC_READS:     *pval = pstats->ac_reads;     break;
+      case VSAM_CNT_CSR_READS:    *pval = pstats->csr_reads;    break;
+      case VSAM_CNT_MODE_WRITES:  *pval = pstats->mode_writes;  break;
+      case VSAM_CNT_RESET_WRITES: *pval = pstats->reset_writes; break;
+      case VSAM_CNT_DIAG_WRITES:  *pval = pstats->diag_writes;  break;
+      case VSAM_CNT_BUS_ERRORS:   *pval = pstats->bus_errors;   break;
+      case VSAM_CNT_SNAPSHOTS:    *pval = pstats->snapshots;    break;
+      case VSAM_CNT_RECORDS:      *pval = pstats->records;      break;
+      case VSAM_CNT_ACQ_TIME:     *pval = pstats->acq_usec;     break;
+      case VSAM_CNT_THROTTLED:    *pval = pstats->throttled;    break;
+      case VSAM_CNT_THROTTLE_TIME:*pval = pstats->throttle_usec;break;
+      case VSAM_CNT_TRIGGERS:     VSAM_trig_stats( &count,NULL ); *pval = count; break;
+      case VSAM_CNT_TRIG_SKEW:    VSAM_trig_stats( NULL,&count ); *pval = count; break;
+      case VSAM_CNT_TRIG_OFFSET:  *pval = pstats->trig_usec;    break;
+      case VSAM_CNT_LIMIT_TRIPS:  *pval = pcard->limit.trips;   break;
+      case VSAM_CNT_CAPTURES:
+      case VSAM_CNT_CAPT_CHAN:
+          if ( !pcard->pcapt ) return(ERROR);
+          epicsMutexMustLock( pcard->lock );
+          *pval = (counter==VSAM_CNT_CAPTURES) ? pcard->pcapt->count : pcard->pcapt->chan;
+          epicsMutexUnlock( pcard->lock );
+          break;
+      case VSAM_CNT_DATA_AGE:
+          /* never read is reported as -1 */
+          if ( !pstats->fresh.secPastEpoch ) 
+             *pval = -1.0;
+          else {
+             epicsTimeGetCurrent( &now );
+             *pval = epicsTimeDiffInSeconds( &now,&pstats->fresh );
+          }
+          break;
+      default:
+          status = -2;
+          break;
+    }
+    return(status);
+}
+
+/*
+ * VSAM_counter_report - print driver counters for one card
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+static void VSAM_counter_report( VSAM_ID pcard )
+{
+    double  age = 0.0;
+
+    VSAM_get_counter( pcard->card,VSAM_CNT_DATA_AGE,&age );
+    printf("\treads:  data %lu  range %lu  ac %lu  status %lu\n",
+           pcard->stats.data_reads,
+           pcard->stats.range_reads,
+           pcard->stats.ac_reads,
+           pcard->stats.csr_reads);
+    printf("\twrites: mode %lu  reset %lu  diag %lu\n",
+           pcard->stats.mode_writes,
+           pcard->stats.reset_writes,
+           pcard->stats.diag_writes);
+    printf("\tbus errors %lu  snapshots %lu  records served %lu\n",
+           pcard->stats.bus_errors,
+           pcard->stats.snapshots,
+           pcard->stats.records);
+    printf("\tlast acquisition %lu usec  data age %.3f sec\n",
+           pcard->stats.acq_usec,
+           age);
+    printf("\tbus budget waits %lu  total %lu usec\n",
+           pcard->stats.throttled,
+           pcard->stats.throttle_usec);
+    if ( pcard->triggered )
+       printf("\ttriggered, last snapshot %lu usec after trigger\n",pcard->stats.trig_usec);
+    printf("\tchannels used: data 0x%08lx  range 0x%08lx  ac 0x%08lx\n",
+           pcard->use.data_mask,
+           pcard->use.range_mask,
+           pcard->use.ac_mask);
+    if ( pcard->limit.high_on || pcard->limit.low_on )
+       printf("\tlimits: high 0x%08lx  low 0x%08lx  tripped 0x%08lx 0x%08lx  trips %lu\n",
+              pcard->limit.high_on,pcard->limit.low_on,
+              pcard->limit.high_state,pcard->limit.low_state,
+              pcard->limit.trips);
+    if ( pcard->psched ) VSAM_sched_report( pcard );
+    if ( pcard->pfilt )  VSAM_filter_report( pcard );
+    if ( pcard->pfft )   VSAM_fft_report( pcard );
+    if ( pcard->pderive ) VSAM_derive_report( pcard );
+    if ( pcard->pavg )   VSAM_avg_report( pcard );
+    if ( pcard->ptrend ) VSAM_trend_report( pcard );
+    if ( pcard->phistory ) VSAM_history_report( pcard );
+    if ( pcard->pmode )  VSAM_mode_report( pcard );
+    if ( pcard->pcapt )  VSAM_capture_report( pcard );
+    if ( pcard->psubs )  VSAM_sub_report( pcard );
+    if ( pcard->pfault ) VSAM_fault_report( pcard );
+}
+
+/*
+ * VSAM_hist_add - add the time elapsed since start, a VSAM_cycles()
+ *                 value, to a histogram
+ */
+void VSAM_hist_add( VSAMHIST *phist,epicsUInt32 start )
+{
+    int             n;
+    double          usec;
+
+    usec = VSAM_cycle_usec( start );
+    for (n=0; (n<VSAM_HIST_BINS-1) && (usec>(double)(1UL<<n)); n++);
+    phist->bin[n]++;
+    phist->count++;
+    phist->sum_usec += usec;
+    if ( usec>phist->max_usec ) phist->max_usec = (unsigned long)ceil( usec );
+}
+
+/*
+ * VSAM_hist_percentile - upper edge (usec) of the bin holding the pct percentile
+ */
+unsigned long VSAM_hist_percentile( const VSAMHIST *phist,double pct )
+{
+    int            n;
+    unsigned long  sum = 0;
+    double         limit;
+
+    if ( !phist->count ) return(0);
+    limit = phist->count * pct / 100.0;
+    for (n=0; n<VSAM_HIST_BINS-1; n++) {
+        sum += phist->bin[n];
+        if ( sum>=limit ) break;
+    }
+    /* never report more than the largest time actually seen */
+    if ( (1UL<<n)>phist->max_usec ) return(phist->max_usec);
+    return(1UL<<n);
+}
+
+/*
+ * VSAM_get_hist - copy out one of the VSAM_HIST_xxx histograms
+ */
+int VSAM_get_hist( short card,short hist,VSAMHIST *phist )
+{
+    VSAM_ID  pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present ) return(ERROR);
+    if ( (hist<0) || (hist>=VSAM_NUM_HISTS) ) return(-2);
+    *phist = pcard->hist[hist];
+    return(OK);
+}
+
+/*
+ * VSAM_hist_report - print p50/p99/max for every histogram of a card,
+ *                    or of all cards if card is negative.
+ *                    Level 1 adds the bin contents.
+ */
+long VSAM_hist_report( short card,int level )
+{
+    short       h;
+    int         n;
+    VSAMHIST   *phist = NULL;
+    VSAM_ID     pcard = NULL;
+
+    if ( !card_list_inited ) {
+        printf("No VSAM Modules present\n");
+        return(OK);
+    }
+    for(pcard=(VSAM_ID)ellFirst((ELLLIST *)&VSAM_card_list); pcard; pcard = (VSAM_ID)ellNext((ELLNODE *)pcard))
+    {
+      if ( ((card>=0) && (pcard->card!=card)) || !pcard->present ) continue;
+      printf("VSAM:\tcard %hd latency (usec)\n",pcard->card);
+      for (h=0; h<VSAM_NUM_HISTS; h++) {
+        phist = &pcard->hist[h];
+        printf("\t%-8s count %10lu  p50 %8lu  p99 %8lu  max %8lu\n",
+               histName_c[h],
+               phist->count,
+               VSAM_hist_percentile(phist,50.0),
+               VSAM_hist_percentile(phist,99.0),
+               phist->max_usec);
+        if ( level>0 ) {
+          for (n=0; n<VSAM_HIST_BINS; n++) {
+            if ( phist->bin[n] )
+              printf("\t\t<= %8lu usec: %lu\n",1UL<<n,phist->bin[n]);
+          }
+        }
+      }
+    }
+    return(OK);
+}
+
+/*
+ * VSAM_hist_reset - clear the histograms of a card, or of all cards
+ */
+long VSAM_hist_reset( short card )
+{
+    VSAM_ID     pcard = NULL;
+
+    if ( !card_list_inited ) return(OK);
+    for(pcard=(VSAM_ID)ellFirst((ELLLIST *)&VSAM_card_list); pcard; pcard = (VSAM_ID)ellNext((ELLNODE *)pcard))
+    {
+      if ( (card<0) || (pcard->card==card) )
+        memset( pcard->hist,0,sizeof(pcard->hist) );
+    }
+    return(OK);
+}
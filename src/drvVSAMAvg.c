@@ -0,0 +1,149 @@
+/* drvVSAMAvg.c - Oversampling and averaging of VSAM channel data
+ *
+ *	VSAM_avg_set(card,first,last,n,mode,period) averages the data
+ *	of channels first..last over n acquisitions.  The channels are
+ *	put on the acquisition schedule at period, which should match
+ *	the refresh of the card in its scan mode so that every sample
+ *	is new; a period is needed to turn averaging on, and a period
+ *	of zero takes the channels off the schedule again.
+ *
+ *	Mode "B" is a boxcar: the mean of the last n samples, updated
+ *	on every sample.  Mode "D" decimates: the mean of n samples,
+ *	updated every n samples.  ai records of an averaged channel
+ *	read the mean instead of the last sample, at whatever rate
+ *	they scan.  n of 0 or 1 turns averaging off.  Filtered
+ *	channels (drvVSAMFilt.c) are averaged after the filter.
+ *
+ *	All averaging state is guarded by the card lock.  Samples are
+ *	taken by VSAM_acquire_mask() with the lock held.
+ */
+
+#include        <stdlib.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include	"VSAM.h"           /* VSAMAVG, etc         */
+#include        "epicsExport.h"
+
+/*
+ * VSAM_avg_set - average channels first..last over n samples
+ */
+long VSAM_avg_set( short card,short first,short last,int n,const char *mode,double period )
+{
+    VSAM_ID    pcard = NULL;
+    VSAMAVG   *pavg = NULL;
+    short      chan;
+    int        decimate;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || (first<0) || (last>=VSAM_NUM_CHANS) || (first>last) ||
+         (n<0) || (n>VSAM_AVG_MAX) || (period<0.0) ) {
+       errlogPrintf("VSAM_avg_set: bad card %hd, channels %hd..%hd or n (at most %d)\n",
+                    card,first,last,VSAM_AVG_MAX);
+       return(ERROR);
+    }
+    if ( (n>1) && (period<=0.0) ) {
+       errlogPrintf("VSAM_avg_set: averaging needs the period samples are taken at\n");
+       return(ERROR);
+    }
+    decimate = (mode && (mode[0]=='D'));
+    if ( VSAM_sched_claim(card,DATA_TYPE,VSAM_CHAN_RANGE(first,last),period,VSAM_SCHED_AVG)!=OK )
+       return(ERROR);
+
+    if ( !pcard->pavg ) {
+       pavg = callocMustSucceed( 1,sizeof(VSAMAVG),"VSAM_avg_set" );
+       pavg->ring = callocMustSucceed( VSAM_NUM_CHANS*VSAM_AVG_MAX,sizeof(float),"VSAM_avg_set" );
+       epicsMutexMustLock( pcard->lock );
+       pcard->pavg = pavg;
+       epicsMutexUnlock( pcard->lock );
+    }
+    pavg = pcard->pavg;
+
+    epicsMutexMustLock( pcard->lock );
+    for (chan=first; chan<=last; chan++) {
+       pavg->n[chan]     = (n>1) ? n : 0;
+       pavg->count[chan] = 0;
+       pavg->next[chan]  = 0;
+       pavg->sum[chan]   = 0.0;
+       pavg->valid      &= ~(1UL<<chan);
+       if ( n>1 ) pavg->mask |=  (1UL<<chan);
+       else       pavg->mask &= ~(1UL<<chan);
+       if ( decimate ) pavg->decimate |=  (1UL<<chan);
+       else            pavg->decimate &= ~(1UL<<chan);
+    }
+    epicsMutexUnlock( pcard->lock );
+
+    for (chan=first; chan<=last; chan++) VSAM_register_use( card,chan,DATA_TYPE );
+    return(OK);
+}
+
+/*
+ * VSAM_avg_sample - add the data just read to the averages
+ *
+ *  Called by VSAM_acquire_mask() with the card locked.
+ *  The boxcar sum is rebuilt every n samples so that
+ *  rounding errors do not pile up.
+ */
+void VSAM_avg_sample( VSAM_ID pcard,unsigned long dmask )
+{
+    VSAMAVG        *pavg = pcard->pavg;
+    float          *pring;
+    float           val;
+    unsigned long   bit;
+    short           chan;
+    int             i,n;
+
+    if ( pcard->snap.status & FIRMWARE_REV ) return;
+    dmask &= pavg->mask;
+    for (chan=0; dmask && (chan<VSAM_NUM_CHANS); chan++) {
+       bit = 1UL<<chan;
+       if ( !(dmask & bit) ) continue;
+       dmask &= ~bit;
+       if ( pcard->pfilt && (pcard->pfilt->valid & bit) ) val = pcard->pfilt->out[chan];
+       else val = pcard->snap.data[chan];
+       n   = pavg->n[chan];
+
+       if ( pavg->decimate & bit ) {
+          pavg->sum[chan] += val;
+          if ( ++pavg->count[chan] >= n ) {
+             pavg->value[chan] = (float)(pavg->sum[chan]/n);
+             pavg->valid      |= bit;
+             pavg->sum[chan]   = 0.0;
+             pavg->count[chan] = 0;
+          }
+          continue;
+       }
+
+       /* boxcar */
+       pring = &pavg->ring[chan*VSAM_AVG_MAX];
+       if ( pavg->count[chan] < n ) pavg->count[chan]++;
+       else pavg->sum[chan] -= pring[pavg->next[chan]];
+       pring[pavg->next[chan]] = val;
+       pavg->sum[chan] += val;
+       if ( ++pavg->next[chan] >= n ) {
+          pavg->next[chan] = 0;
+          for (i=0,pavg->sum[chan]=0.0; i<pavg->count[chan]; i++) pavg->sum[chan] += pring[i];
+       }
+       pavg->value[chan] = (float)(pavg->sum[chan]/pavg->count[chan]);
+       pavg->valid      |= bit;
+    }
+}
+
+/*
+ * VSAM_avg_report - print the averaged channels of a card
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_avg_report( VSAM_ID pcard )
+{
+    VSAMAVG  *pavg = pcard->pavg;
+    short     chan;
+
+    epicsMutexMustLock( pcard->lock );
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+       if ( !(pavg->mask & (1UL<<chan)) ) continue;
+       printf("\tch %2hd: %s of %d  ",chan,(pavg->decimate & (1UL<<chan)) ? "decimated mean" : "boxcar",pavg->n[chan]);
+       if ( pavg->valid & (1UL<<chan) ) printf("%g\n",pavg->value[chan]);
+       else printf("no value yet\n");
+    }
+    epicsMutexUnlock( pcard->lock );
+}
@@ -0,0 +1,114 @@
+/* drvVSAMBudget.c - VME bus budget for all VSAM cards
+ *
+ *	The VSAM cards share the bus with other modules, so the
+ *	number of D32 accesses the driver makes can be limited
+ *	crate-wide with VSAM_bus_budget(per_sec,per_ms).  Two token
+ *	buckets enforce the limits: one refilled at per_sec tokens
+ *	per second holding at most one second's worth, one refilled
+ *	at per_ms tokens per millisecond holding at most per_ms.
+ *
+ *	Buckets are refilled in proportion to the time since the
+ *	last claim, read on the CPU cycle counter, up to their size,
+ *	which caps the burst after an idle time.
+ *
+ *	A caller that finds too few tokens takes them anyway,
+ *	leaving the bucket in debt.  A debt worth less than a clock
+ *	tick is left for later callers, since a sleep cannot be
+ *	shorter than a tick; once it is worth a tick or more the
+ *	caller sleeps until it is paid back.  Callers are thus served
+ *	in order and their accesses held to the limits when averaged
+ *	over a tick.  Every wait is counted against the card that had
+ *	to wait.
+ */
+
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include	"VSAM.h"           /* VSAM_bus_claim, etc  */
+#include        "epicsExport.h"
+
+typedef struct VSAMBUCKET {
+    double  rate;                  /* tokens per second, 0 = no limit */
+    double  size;                  /* most tokens held                */
+    double  tokens;                /* may go negative (debt)          */
+} VSAMBUCKET;
+
+/* Local variables */
+static epicsMutexId    budget_lock = NULL;
+static int             budget_on = 0;
+static VSAMBUCKET      bucket[2];  /* per second, per millisecond */
+static double          last_fill;  /* VSAM_clock_sec() */
+
+/*
+ * VSAM_bus_budget - set the crate-wide limit of VSAM bus accesses,
+ *                   per second and per millisecond. 0 is no limit.
+ */
+long VSAM_bus_budget( double per_sec,double per_ms )
+{
+    int  i;
+
+    if ( (per_sec<0.0) || (per_ms<0.0) ) {
+       errlogPrintf("VSAM_bus_budget: limits must not be negative\n");
+       return(ERROR);
+    }
+    if ( !budget_lock ) budget_lock = epicsMutexMustCreate();
+
+    epicsMutexMustLock( budget_lock );
+    bucket[0].rate = per_sec;
+    bucket[0].size = per_sec;
+    bucket[1].rate = per_ms*1000.0;
+    bucket[1].size = per_ms;
+    for (i=0; i<2; i++) bucket[i].tokens = bucket[i].size;
+    last_fill = VSAM_clock_sec();
+    budget_on = (per_sec>0.0) || (per_ms>0.0);
+    epicsMutexUnlock( budget_lock );
+    return(OK);
+}
+
+/*
+ * VSAM_bus_claim - take nwords bus accesses from the budget,
+ *                  waiting if the debt is a clock tick or more.
+ */
+void VSAM_bus_claim( VSAM_ID pcard,unsigned long nwords )
+{
+    int             i;
+    double          now,dt,wait = 0.0;
+    VSAMBUCKET     *pb;
+
+    if ( !budget_on || !nwords ) return;
+
+    epicsMutexMustLock( budget_lock );
+    now = VSAM_clock_sec();
+    dt  = now - last_fill;
+    last_fill = now;
+    for (i=0; i<2; i++) {
+       pb = &bucket[i];
+       if ( pb->rate<=0.0 ) continue;
+       pb->tokens += dt*pb->rate;
+       if ( pb->tokens>pb->size ) pb->tokens = pb->size;
+       pb->tokens -= nwords;
+       if ( (pb->tokens<0.0) && (-pb->tokens/pb->rate>wait) ) wait = -pb->tokens/pb->rate;
+    }
+    epicsMutexUnlock( budget_lock );
+
+    /* less than a tick is left as debt, a sleep would take the tick */
+    if ( wait>=epicsThreadSleepQuantum() ) {
+       pcard->stats.throttled++;
+       pcard->stats.throttle_usec += (unsigned long)(wait*1e6);
+       epicsThreadSleep( wait );
+    }
+}
+
+/*
+ * VSAM_budget_report - print the bus budget
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_budget_report( void )
+{
+    if ( !budget_on ) {
+       printf("VSAM bus budget: none\n");
+       return;
+    }
+    printf("VSAM bus budget: %g accesses/sec, %g accesses/msec\n",
+           bucket[0].rate,bucket[1].size);
+}
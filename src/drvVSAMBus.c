@@ -0,0 +1,68 @@
+/* drvVSAMBus.c - Bus backends for the VSAM driver
+ *
+ *	All access to card memory by the driver goes through the
+ *	backend pVSAMbus points at, see VSAMBUS in VSAM.h.  The
+ *	default is the VME bus.  Other backends (drvVSAMReplay.c)
+ *	are selected with VSAM_bus_set() before any VSAM_config(),
+ *	since the backend also maps the card memory.
+ */
+
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include        "devLib.h"         /* devRegisterAddress() */
+#include        "basicIoOps.h"     /* in_be32()            */
+#include	"VSAM.h"           /* VSAMBUS, etc         */
+#include        "epicsExport.h"
+
+static long        vme_map( const char *name,short card,unsigned long addr,VSAMMEM **ppVSAM );
+static int         vme_probe( volatile void *paddr,epicsUInt32 *pval );
+static epicsUInt32 vme_in32( volatile void *paddr );
+static void        vme_out32( volatile void *paddr,epicsUInt32 val );
+static float       vme_inf( volatile void *paddr );
+
+VSAMBUS VSAM_vme_bus = { "VME",vme_map,vme_probe,vme_in32,vme_out32,vme_inf };
+
+/* Global variables */
+VSAMBUS *pVSAMbus = &VSAM_vme_bus;
+
+/*
+ * VSAM_bus_set - use another bus backend
+ */
+long VSAM_bus_set( VSAMBUS *pbus )
+{
+    if ( !pbus ) return(ERROR);
+    if ( VSAM_next_card(NULL) ) {
+       errlogPrintf("VSAM_bus_set: cards already configured on the %s bus\n",pVSAMbus->name);
+       return(ERROR);
+    }
+    pVSAMbus = pbus;
+    return(OK);
+}
+
+/* VME backend: A24/D32, big-endian registers */
+
+static long vme_map( const char *name,short card,unsigned long addr,VSAMMEM **ppVSAM )
+{
+    return( devRegisterAddress(name,atVMEA24,addr,sizeof(VSAMMEM),(volatile void **)ppVSAM) );
+}
+
+static int vme_probe( volatile void *paddr,epicsUInt32 *pval )
+{
+    return( (int)devReadProbe(sizeof(*pval),paddr,(void *)pval) );
+}
+
+static epicsUInt32 vme_in32( volatile void *paddr )
+{
+    return( in_be32(paddr) );
+}
+
+static void vme_out32( volatile void *paddr,epicsUInt32 val )
+{
+    out_be32( paddr,val );
+}
+
+/* data words are floats in the byte order of the host */
+static float vme_inf( volatile void *paddr )
+{
+    return( *(volatile float *)paddr );
+}
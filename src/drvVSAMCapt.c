@@ -0,0 +1,333 @@
+/* drvVSAMCapt.c - Pre/post-trigger transient capture for the VSAM driver
+ *
+ *	VSAM_capture_config(card,type,pre,post,period) keeps the last
+ *	pre+post acquisitions of all 32 data ("D") or AC ("A") values
+ *	of a card in a ring.  With period non-zero the channels in
+ *	use, those with a capture waveform or a trigger edge, are put
+ *	on the acquisition schedule at that period, which then is the
+ *	sample interval, and only passes that read all of them are
+ *	samples; otherwise every acquisition of the type, by whatever
+ *	means, is a sample.  Channels a sample did not read are NaN in
+ *	it and are not looked at for a crossing.
+ *
+ *	VSAM_capture_set(card,first,last,level,edge) sets the level
+ *	and edge that trigger a capture on each channel.  When a
+ *	channel crosses its level, post-1 more samples are taken and
+ *	the ring is frozen: all 32 channels, pre samples before the
+ *	trigger sample and post from it on.  The frozen capture is
+ *	read by waveform records (parm T, signal is the channel, or
+ *	32 for the sample times in seconds from the trigger), which
+ *	are posted through I/O Intr.  The ring keeps running, so
+ *	capture re-arms by itself.  Call VSAM_capture_config() before
+ *	iocInit so that the records find the I/O Intr list.
+ *
+ *	All capture state is guarded by the card lock.  Samples are
+ *	taken by VSAM_acquire_mask() with the lock held.
+ */
+
+#include        <stdlib.h>
+#include        <string.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include        "dbScan.h"         /* scanIoRequest()      */
+#include        "epicsMath.h"      /* epicsNAN             */
+#include	"VSAM.h"           /* VSAMCAPT, etc        */
+#include        "epicsExport.h"
+
+static int  VSAM_capture_crossed( VSAMCAPT *pcapt,short chan,float val );
+static void VSAM_capture_freeze( VSAMCAPT *pcapt );
+
+/*
+ * VSAM_capture_config - set up transient capture of a card
+ *
+ *  Can be called again to change the sizes; a capture in
+ *  progress is dropped.
+ */
+long VSAM_capture_config( short card,const char *type,int pre,int post,double period )
+{
+    VSAM_ID     pcard = NULL;
+    VSAMCAPT   *pcapt = NULL;
+    VSAMCAPT   *pold = NULL;
+    unsigned long  use;
+    char        spec,ospec;
+
+    pcard = VSAM_getByCard( card );
+    spec  = (type) ? type[0] : 0;
+    if ( !pcard || ((spec!=DATA_TYPE) && (spec!=AC_TYPE)) ) {
+       errlogPrintf("VSAM_capture_config: bad card %hd or type (D or A)\n",card);
+       return(ERROR);
+    }
+    if ( (pre<0) || (post<1) || (pre+post>VSAM_CAPT_MAX) || (period<0.0) ) {
+       errlogPrintf("VSAM_capture_config: need pre >= 0, post >= 1, pre+post <= %d\n",VSAM_CAPT_MAX);
+       return(ERROR);
+    }
+
+    /* move the channels in use to the new period and type */
+    epicsMutexMustLock( pcard->lock );
+    use   = pcard->pcapt ? pcard->pcapt->use : 0;
+    ospec = pcard->pcapt ? pcard->pcapt->type : spec;
+    epicsMutexUnlock( pcard->lock );
+    if ( VSAM_sched_claim(card,spec,use,period,VSAM_SCHED_CAPT)!=OK ) return(ERROR);
+    if ( ospec!=spec ) VSAM_sched_claim( card,ospec,use,0.0,VSAM_SCHED_CAPT );
+
+    pcapt = callocMustSucceed( 1,sizeof(VSAMCAPT),"VSAM_capture_config" );
+    pcapt->type   = spec;
+    pcapt->pre    = pre;
+    pcapt->post   = post;
+    pcapt->size   = pre+post;
+    pcapt->chan   = -1;
+    pcapt->period = period;
+    pcapt->trig_chan   = -1;
+    pcapt->ring        = callocMustSucceed( pcapt->size*VSAM_NUM_CHANS,sizeof(float),"VSAM_capture_config" );
+    pcapt->ring_stamp  = callocMustSucceed( pcapt->size,sizeof(epicsTimeStamp),"VSAM_capture_config" );
+    pcapt->frozen      = callocMustSucceed( pcapt->size*VSAM_NUM_CHANS,sizeof(float),"VSAM_capture_config" );
+    pcapt->frozen_time = callocMustSucceed( pcapt->size,sizeof(double),"VSAM_capture_config" );
+
+    epicsMutexMustLock( pcard->lock );
+    pold = pcard->pcapt;
+    if ( pold ) {
+       /* keep the levels and the records of the old setup */
+       memcpy( pcapt->level,pold->level,sizeof(pcapt->level) );
+       memcpy( pcapt->edge,pold->edge,sizeof(pcapt->edge) );
+       pcapt->ioscan = pold->ioscan;
+       pcapt->count  = pold->count;
+       pcapt->use    = pold->use;
+    }
+    else scanIoInit( &pcapt->ioscan );
+    pcapt->mask = (period>0.0) ? pcapt->use : 0;
+    pcard->pcapt = pcapt;
+    epicsMutexUnlock( pcard->lock );
+
+    if ( pold ) {
+       free( pold->ring );
+       free( pold->ring_stamp );
+       free( pold->frozen );
+       free( pold->frozen_time );
+       free( pold );
+    }
+    return(OK);
+}
+
+/*
+ * VSAM_capture_set - trigger level and edge of channels first..last
+ *
+ *  edge is VSAM_EDGE_RISING (1), VSAM_EDGE_FALLING (-1),
+ *  VSAM_EDGE_BOTH (2) or VSAM_EDGE_OFF (0).
+ */
+long VSAM_capture_set( short card,short first,short last,double level,int edge )
+{
+    VSAM_ID  pcard = NULL;
+    short    chan;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->pcapt ) {
+       errlogPrintf("VSAM_capture_set: card %hd has no capture, use VSAM_capture_config first\n",card);
+       return(ERROR);
+    }
+    if ( (first<0) || (last>=VSAM_NUM_CHANS) || (first>last) ||
+         ((edge!=VSAM_EDGE_OFF) && (edge!=VSAM_EDGE_RISING) &&
+          (edge!=VSAM_EDGE_FALLING) && (edge!=VSAM_EDGE_BOTH)) ) {
+       errlogPrintf("VSAM_capture_set: bad channels %hd..%hd or edge %d\n",first,last,edge);
+       return(ERROR);
+    }
+    for (chan=first; (chan<=last) && (edge!=VSAM_EDGE_OFF); chan++) 
+       if ( VSAM_capture_use(card,chan)!=OK ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    for (chan=first; chan<=last; chan++) {
+       pcard->pcapt->level[chan] = (float)level;
+       pcard->pcapt->edge[chan]  = edge;
+    }
+    epicsMutexUnlock( pcard->lock );
+    return(OK);
+}
+
+/*
+ * VSAM_capture_use - a channel has a capture waveform or a trigger,
+ *                    put it on the schedule of the capture
+ */
+long VSAM_capture_use( short card,short chan )
+{
+    VSAM_ID        pcard = NULL;
+    VSAMCAPT      *pcapt = NULL;
+    unsigned long  bit = 1UL<<chan;
+    double         period = 0.0;
+    char           spec = 0;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->pcapt || (chan<0) || (chan>=VSAM_NUM_CHANS) ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    pcapt = pcard->pcapt;
+    if ( !(pcapt->use & bit) ) {
+       spec   = pcapt->type;
+       period = pcapt->period;
+    }
+    epicsMutexUnlock( pcard->lock );
+    if ( !spec ) return(OK);
+    if ( (period>0.0) && (VSAM_sched_claim(card,spec,bit,period,VSAM_SCHED_CAPT)!=OK) ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    pcapt = pcard->pcapt;
+    pcapt->use |= bit;
+    if ( pcapt->period>0.0 ) pcapt->mask = pcapt->use;
+    epicsMutexUnlock( pcard->lock );
+    return(OK);
+}
+
+/*
+ * VSAM_capture_sample - add the channels in mask, just read into
+ *                       the snapshot of a card, to its ring
+ *
+ *  Called by VSAM_acquire_mask() with the card locked.
+ */
+void VSAM_capture_sample( VSAM_ID pcard,unsigned long mask )
+{
+    VSAMCAPT  *pcapt = pcard->pcapt;
+    float      val[VSAM_NUM_CHANS];
+    float     *pslot;
+    short      chan;
+
+    /* on a schedule, only its own passes are samples */
+    if ( (mask & pcapt->mask)!=pcapt->mask ) return;
+    if ( VSAM_snap_decode(&pcard->snap,pcapt->type,val) ) return;
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++)
+       if ( !(mask & (1UL<<chan)) ) val[chan] = epicsNAN;
+
+    pslot = &pcapt->ring[pcapt->head*VSAM_NUM_CHANS];
+    memcpy( pslot,val,sizeof(val) );
+    pcapt->ring_stamp[pcapt->head] = pcard->snap.stamp;
+
+    /* look for a crossing once there are pre samples before this one,
+       on channels that have a last sample to cross from */
+    if ( !pcapt->remain && (pcapt->filled>=pcapt->pre) ) {
+       for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+          if ( !(mask & pcapt->primed & (1UL<<chan)) ) continue;
+          if ( VSAM_capture_crossed(pcapt,chan,val[chan]) ) {
+             pcapt->trig_chan = chan;
+             pcapt->trig_slot = pcapt->head;
+             pcapt->remain    = pcapt->post;
+             break;
+          }
+       }
+    }
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++)
+       if ( mask & (1UL<<chan) ) pcapt->last[chan] = val[chan];
+    pcapt->primed |= mask;
+    pcapt->filled++;
+    pcapt->head = (pcapt->head+1) % pcapt->size;
+
+    if ( pcapt->remain && !--pcapt->remain ) {
+       VSAM_capture_freeze( pcapt );
+       scanIoRequest( pcapt->ioscan );
+    }
+}
+
+/*
+ * VSAM_capture_crossed - TRUE if a channel crossed its level
+ *                        between the last sample and this one
+ */
+static int VSAM_capture_crossed( VSAMCAPT *pcapt,short chan,float val )
+{
+    float  level = pcapt->level[chan];
+    float  last  = pcapt->last[chan];
+
+    switch ( pcapt->edge[chan] ) {
+      case VSAM_EDGE_RISING:  return( (last<level) && (val>=level) );
+      case VSAM_EDGE_FALLING: return( (last>level) && (val<=level) );
+      case VSAM_EDGE_BOTH:    return( ((last<level) && (val>=level)) ||
+                                      ((last>level) && (val<=level)) );
+    }
+    return(FALSE);
+}
+
+/*
+ * VSAM_capture_freeze - copy the ring, oldest sample first, into
+ *                       the published buffer
+ *
+ *  The ring has just been filled up to the last post sample, so
+ *  the oldest sample is at the head.
+ */
+static void VSAM_capture_freeze( VSAMCAPT *pcapt )
+{
+    unsigned long  n,slot;
+    short          chan;
+
+    pcapt->stamp = pcapt->ring_stamp[pcapt->trig_slot];
+    for (n=0; n<pcapt->size; n++) {
+       slot = (pcapt->head+n) % pcapt->size;
+       for (chan=0; chan<VSAM_NUM_CHANS; chan++)
+          pcapt->frozen[chan*pcapt->size+n] = pcapt->ring[slot*VSAM_NUM_CHANS+chan];
+       pcapt->frozen_time[n] = epicsTimeDiffInSeconds( &pcapt->ring_stamp[slot],&pcapt->stamp );
+    }
+    pcapt->chan = pcapt->trig_chan;
+    pcapt->count++;
+}
+
+/*
+ * VSAM_get_capture - copy out one channel of the frozen capture,
+ *                    or the sample times if signal is VSAM_NUM_CHANS
+ */
+int VSAM_get_capture( short card,short signal,double *pval,unsigned long nmax,unsigned long *pnval )
+{
+    VSAM_ID         pcard = NULL;
+    VSAMCAPT       *pcapt = NULL;
+    unsigned long   n,nval;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present || !pcard->pcapt ) return(ERROR);
+    if ( (signal<0) || (signal>VSAM_NUM_CHANS) ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    pcapt = pcard->pcapt;
+    nval  = pcapt->count ? pcapt->size : 0;
+    if ( nval>nmax ) nval = nmax;
+    for (n=0; n<nval; n++) {
+       if ( signal==VSAM_NUM_CHANS ) pval[n] = pcapt->frozen_time[n];
+       else pval[n] = pcapt->frozen[signal*pcapt->size+n];
+    }
+    epicsMutexUnlock( pcard->lock );
+    *pnval = nval;
+    return(OK);
+}
+
+/*
+ * VSAM_capture_ioscan - I/O Intr list posted on every capture
+ */
+int VSAM_capture_ioscan( short card,IOSCANPVT *ppvt )
+{
+    VSAM_ID  pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->pcapt ) return(ERROR);
+    *ppvt = pcard->pcapt->ioscan;
+    return(OK);
+}
+
+/*
+ * VSAM_capture_report - print the capture setup of a card
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_capture_report( VSAM_ID pcard )
+{
+    VSAMCAPT  *pcapt = NULL;
+    char       buf[40];
+    short      chan;
+
+    epicsMutexMustLock( pcard->lock );
+    pcapt = pcard->pcapt;
+    printf("\tcapture %c: %lu pre  %lu post  %lu captures",pcapt->type,pcapt->pre,pcapt->post,pcapt->count);
+    if ( pcapt->count ) {
+       epicsTimeToStrftime( buf,sizeof(buf),"%Y-%m-%d %H:%M:%S.%06f",&pcapt->stamp );
+       printf("  last on ch %hd at %s",pcapt->chan,buf);
+    }
+    printf("%s\n",pcapt->remain ? "  (taking post samples)" : "");
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+       if ( pcapt->edge[chan]==VSAM_EDGE_OFF ) continue;
+       printf("\t\tch %2hd: level %g %s\n",chan,pcapt->level[chan],
+              (pcapt->edge[chan]==VSAM_EDGE_RISING) ? "rising" :
+              (pcapt->edge[chan]==VSAM_EDGE_FALLING) ? "falling" : "both");
+    }
+    epicsMutexUnlock( pcard->lock );
+}
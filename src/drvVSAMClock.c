@@ -0,0 +1,182 @@
+/* drvVSAMClock.c - CPU cycle counter for VSAM timing
+ *
+ *	Latencies, trace events and short waits are timed with the
+ *	CPU cycle counter, the time base on PowerPC and the TSC on
+ *	x86, which reads in a few ns and takes no lock.  The system
+ *	clock, epicsTimeGetCurrent(), is kept for wall clock stamps.
+ *
+ *	VSAM_cycles() gives the low 32 bits, so an interval timed with
+ *	it must be shorter than they take to wrap: over a second on
+ *	x86, minutes on PowerPC.  VSAM_clock_sec() gives the whole
+ *	counter in sec past the EPICS epoch, for events that are kept
+ *	and compared later; VSAM_clock_wall() turns that into a time
+ *	stamp.  The rate is found once against the system clock by
+ *	VSAM_clock_init() at driver init, over CLOCK_CALIB seconds
+ *	started and ended just after the clock ticks, so the clock
+ *	resolution does not count.  Until then, and on other targets,
+ *	the system clock is counted in ns instead; an interval that
+ *	spans the calibration is not right.
+ *
+ *	The calibration is published by setting clock_ready after
+ *	everything else, so readers need no lock.
+ */
+
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include	"VSAM.h"           /* VSAM_cycles, etc     */
+#include        "epicsExport.h"
+
+#define CLOCK_CALIB   1.0       /* sec to calibrate over              */
+#define CLOCK_STEP    0.1       /* sec between reads, less than a wrap */
+
+/* Local variables */
+static volatile int clock_ready = 0;  /* counter calibrated               */
+static double  clock_rate = 1e9;   /* counts per sec                     */
+static double  clock_usec = 1e-3;  /* usec per count                     */
+static double  clock_base = 0.0;   /* whole count at calibration         */
+static double  clock_sec0 = 0.0;   /* sec past the epoch at calibration  */
+
+/* the system clock in ns, the counter until calibration */
+static epicsUInt32 clock_sys_cycles( void )
+{
+    epicsTimeStamp t;
+    epicsTimeGetCurrent( &t );
+    return (epicsUInt32)(t.secPastEpoch*1000000000UL + t.nsec);
+}
+static double clock_sys_count( void )
+{
+    epicsTimeStamp t;
+    epicsTimeGetCurrent( &t );
+    return t.secPastEpoch*1e9 + t.nsec;
+}
+
+#if defined(__GNUC__) && (defined(__powerpc__) || defined(__PPC__))
+static epicsUInt32 clock_cycles( void )
+{
+    epicsUInt32 tb;
+    __asm__ __volatile__ ( "mftb %0" : "=r" (tb) );
+    return tb;
+}
+static double clock_count( void )
+{
+    epicsUInt32 hi,lo,hi2;
+    do {
+       __asm__ __volatile__ ( "mftbu %0" : "=r" (hi) );
+       __asm__ __volatile__ ( "mftb %0"  : "=r" (lo) );
+       __asm__ __volatile__ ( "mftbu %0" : "=r" (hi2) );
+    } while ( hi!=hi2 );
+    return hi*4294967296.0 + lo;
+}
+#define CLOCK_COUNTER 1
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+static epicsUInt32 clock_cycles( void )
+{
+    epicsUInt32 lo,hi;
+    __asm__ __volatile__ ( "rdtsc" : "=a" (lo), "=d" (hi) );
+    return lo;
+}
+static double clock_count( void )
+{
+    epicsUInt32 lo,hi;
+    __asm__ __volatile__ ( "rdtsc" : "=a" (lo), "=d" (hi) );
+    return hi*4294967296.0 + lo;
+}
+#define CLOCK_COUNTER 1
+#else
+#define clock_cycles  clock_sys_cycles
+#define clock_count   clock_sys_count
+#define CLOCK_COUNTER 0
+#endif
+
+/*
+ * VSAM_cycles - low 32 bits of the cycle counter
+ */
+epicsUInt32 VSAM_cycles( void )
+{
+    if ( !clock_ready ) return( clock_sys_cycles() );
+    return( clock_cycles() );
+}
+
+/*
+ * VSAM_clock_init - find the rate of the cycle counter
+ *
+ *  Called once by init(), before the acquisition tasks start.
+ */
+int VSAM_clock_init( void )
+{
+    epicsTimeStamp  t,t0,t1;
+    epicsUInt32     c0,c1;
+    double          counts,sec,base;
+
+    if ( clock_ready || !CLOCK_COUNTER ) return(OK);
+
+    epicsTimeGetCurrent( &t );
+    do {
+       epicsTimeGetCurrent( &t0 );
+       c0 = clock_cycles();
+    } while ( epicsTimeEqual(&t0,&t) );
+
+    /* add up in steps, each shorter than the counter wraps */
+    for (counts=0.0,sec=0.0; sec<CLOCK_CALIB; sec+=CLOCK_STEP) {
+       epicsThreadSleep( CLOCK_STEP );
+       c1 = clock_cycles();
+       counts += (epicsUInt32)(c1-c0);
+       c0 = c1;
+    }
+    epicsTimeGetCurrent( &t );
+    do {
+       epicsTimeGetCurrent( &t1 );
+       c1   = clock_cycles();
+       base = clock_count();
+    } while ( epicsTimeEqual(&t1,&t) );
+    counts += (epicsUInt32)(c1-c0);
+
+    sec = epicsTimeDiffInSeconds( &t1,&t0 );
+    if ( (sec<=0.0) || (counts<=0.0) ) {
+       errlogPrintf("VSAM_clock_init: cannot calibrate the cycle counter, using the system clock\n");
+       return(ERROR);
+    }
+    clock_base  = base;
+    clock_sec0  = t1.secPastEpoch + t1.nsec*1e-9;
+    clock_usec  = sec*1e6/counts;
+    clock_rate  = counts/sec;
+    clock_ready = 1;
+    return(OK);
+}
+
+/*
+ * VSAM_cycle_rate - cycle counter counts per sec
+ */
+double VSAM_cycle_rate( void )
+{
+    if ( !clock_ready ) return( 1e9 );
+    return( clock_rate );
+}
+
+/*
+ * VSAM_cycle_usec - usec from a cycle counter value to now
+ */
+double VSAM_cycle_usec( epicsUInt32 start )
+{
+    if ( !clock_ready ) return( (epicsUInt32)(clock_sys_cycles()-start) * 1e-3 );
+    return( (epicsUInt32)(clock_cycles()-start) * clock_usec );
+}
+
+/*
+ * VSAM_clock_sec - sec past the EPICS epoch on the cycle counter
+ */
+double VSAM_clock_sec( void )
+{
+    if ( !clock_ready ) return( clock_sys_count() * 1e-9 );
+    return( clock_sec0 + (clock_count()-clock_base) * clock_usec * 1e-6 );
+}
+
+/*
+ * VSAM_clock_wall - wall clock time of a VSAM_clock_sec() value
+ */
+void VSAM_clock_wall( double sec,epicsTimeStamp *pstamp )
+{
+    pstamp->secPastEpoch = (epicsUInt32)sec;
+    pstamp->nsec         = (epicsUInt32)((sec - pstamp->secPastEpoch)*1e9);
+    if ( pstamp->nsec>=1000000000 ) pstamp->nsec = 999999999;
+}
@@ -0,0 +1,516 @@
+/* drvVSAMDerive.c - Derived channels computed from VSAM snapshots
+ *
+ *	A card can have up to VSAM_NUM_DERIVED derived channels, each
+ *	given by an expression over the channels of the card:
+ *	    VSAM_derive(card,index,"max(0-3)")
+ *	or read from a file with VSAM_derive_load(card,file), one
+ *	"index expression" per line, # for comments.
+ *
+ *	Expressions have numbers, channels Dn (data) and An (AC), the
+ *	operators + - * / and ( ), and the group functions
+ *	sum() min() max() mean() over a list of channels such as
+ *	(0-3), (A4,A6) or (D0-7,12).  A bare number in a group is a
+ *	data channel.  Examples:
+ *	    mean(0-3)          D4 - D5          D6 / D7 * 100
+ *
+ *	The expressions of a card are compiled into one flat list of
+ *	stack instructions, each ending in a store to its derived
+ *	channel.  The list is run over the snapshot on every
+ *	acquisition that reads data or AC.  A derived channel is only
+ *	stored by an acquisition that read all of the channels its
+ *	expression uses; others keep their last value, so values are
+ *	never made from channels of different acquisitions.  A result
+ *	that divides by zero, or uses AC in fast scan mode, is invalid.  ai records
+ *	read derived channels with parm X (signal is the index), and
+ *	a waveform with parm X reads all of them; both are posted
+ *	through I/O Intr.  db/vsam_derive.template loads the waveform.
+ */
+
+#include        <stdlib.h>
+#include        <stdio.h>
+#include        <string.h>
+#include        <ctype.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include        "dbScan.h"         /* scanIoRequest()      */
+#include	"VSAM.h"           /* VSAMDERIVE, etc      */
+#include        "epicsExport.h"
+
+/* instructions */
+#define DRV_OP_CONST    1          /* push val                    */
+#define DRV_OP_CHAN     2          /* push channel chan of type   */
+#define DRV_OP_ADD      3
+#define DRV_OP_SUB      4
+#define DRV_OP_MUL      5
+#define DRV_OP_DIV      6
+#define DRV_OP_NEG      7
+#define DRV_OP_SUM      8          /* push sum of channels in mask */
+#define DRV_OP_MIN      9
+#define DRV_OP_MAX      10
+#define DRV_OP_MEAN     11
+#define DRV_OP_STORE    12         /* pop into derived channel chan */
+
+#define DRV_STACK_SIZE  16
+#define DRV_LINE_SIZE   256
+
+/* compiler state */
+typedef struct DRVCOMP {
+    const char     *pc;            /* next character              */
+    VSAMINSN       *prog;
+    int             len;
+    int             size;
+    int             depth;         /* of the stack at run time    */
+    unsigned long   use[2];        /* data, AC channels referenced */
+    const char     *err;
+} DRVCOMP;
+
+static int  VSAM_derive_compile( VSAMDERIVE *pder,unsigned long *puse );
+static int  DRV_expr( DRVCOMP *pcomp );
+static int  DRV_term( DRVCOMP *pcomp );
+static int  DRV_factor( DRVCOMP *pcomp );
+static int  DRV_group( DRVCOMP *pcomp,unsigned char *ptype,unsigned long *pmask );
+static int  DRV_emit( DRVCOMP *pcomp,unsigned char op,unsigned char type,short chan,
+                      unsigned long mask,double val,int push );
+static void DRV_skip( DRVCOMP *pcomp );
+
+/*
+ * VSAM_derive - define derived channel index of a card;
+ *               an empty expression removes it
+ */
+long VSAM_derive( short card,short index,const char *expr )
+{
+    VSAM_ID        pcard = NULL;
+    VSAMDERIVE    *pder = NULL;
+    VSAMDERIVE    *pwork = NULL;
+    unsigned long  use[2];
+    short          chan;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || (index<0) || (index>=VSAM_NUM_DERIVED) ||
+         (expr && (strlen(expr)>=VSAM_DERIVE_EXPR)) ) {
+       errlogPrintf("VSAM_derive: bad card %hd, index %hd or expression too long\n",card,index);
+       return(ERROR);
+    }
+    if ( !pcard->pderive ) {
+       pder = callocMustSucceed( 1,sizeof(VSAMDERIVE),"VSAM_derive" );
+       scanIoInit( &pder->ioscan );
+       epicsMutexMustLock( pcard->lock );
+       pcard->pderive = pder;
+       epicsMutexUnlock( pcard->lock );
+    }
+    pder = pcard->pderive;
+
+    /* compile a copy, so that a bad expression changes nothing */
+    pwork = callocMustSucceed( 1,sizeof(VSAMDERIVE),"VSAM_derive" );
+    epicsMutexMustLock( pcard->lock );
+    *pwork = *pder;
+    epicsMutexUnlock( pcard->lock );
+    strcpy( pwork->expr[index],expr ? expr : "" );
+    if ( pwork->expr[index][0] ) pwork->defined |=  (1UL<<index);
+    else                         pwork->defined &= ~(1UL<<index);
+    if ( VSAM_derive_compile(pwork,use) ) {
+       free( pwork );
+       return(ERROR);
+    }
+
+    epicsMutexMustLock( pcard->lock );
+    strcpy( pder->expr[index],pwork->expr[index] );
+    memcpy( pder->prog,pwork->prog,sizeof(pwork->prog) );
+    memcpy( pder->use,pwork->use,sizeof(pwork->use) );
+    pder->len     = pwork->len;
+    pder->defined = pwork->defined;
+    pder->use_ac  = (use[1]!=0);
+    pder->valid  &= ~(1UL<<index);
+    epicsMutexUnlock( pcard->lock );
+    free( pwork );
+
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+       if ( use[0] & (1UL<<chan) ) VSAM_register_use( card,chan,DATA_TYPE );
+       if ( use[1] & (1UL<<chan) ) VSAM_register_use( card,chan,AC_TYPE );
+    }
+    return(OK);
+}
+
+/*
+ * VSAM_derive_load - read derived channels of a card from a file
+ */
+long VSAM_derive_load( short card,const char *file )
+{
+    FILE   *fp = NULL;
+    char    line[DRV_LINE_SIZE];
+    char   *pc;
+    int     index,n,lineno = 0;
+    long    status = OK;
+
+    if ( !file || !(fp=fopen(file,"r")) ) {
+       errlogPrintf("VSAM_derive_load: cannot open %s\n",file ? file : "(null)");
+       return(ERROR);
+    }
+    while ( fgets(line,sizeof(line),fp) ) {
+       lineno++;
+       if ( (pc=strchr(line,'#')) ) *pc = '\0';
+       if ( (pc=strchr(line,'\n')) ) *pc = '\0';
+       if ( sscanf(line,"%d %n",&index,&n)<1 ) continue;
+       if ( VSAM_derive(card,(short)index,line+n)!=OK ) {
+          errlogPrintf("VSAM_derive_load: %s line %d not used\n",file,lineno);
+          status = ERROR;
+       }
+    }
+    fclose( fp );
+    return(status);
+}
+
+/*
+ * VSAM_derive_run - run the instruction list over the snapshot,
+ *                   storing the channels whose inputs were all in
+ *                   the data and AC masks just read
+ *
+ *  Called by VSAM_acquire_mask() with the card locked.
+ */
+void VSAM_derive_run( VSAM_ID pcard,unsigned long dmask,unsigned long amask )
+{
+    VSAMDERIVE     *pder = pcard->pderive;
+    VSAMINSN       *pi;
+    float           val[2][VSAM_NUM_CHANS];
+    double          st[DRV_STACK_SIZE];
+    double          x;
+    unsigned long   m,run = 0;
+    int             sp = 0,bad = 0,ac_ok,n,i;
+    short           chan;
+
+    if ( !pder->len ) return;
+    for (i=0; i<VSAM_NUM_DERIVED; i++) {
+       if ( (pder->defined & (1UL<<i)) &&
+            ((pder->use[i][0] & dmask)==pder->use[i][0]) &&
+            ((pder->use[i][1] & amask)==pder->use[i][1]) ) run |= (1UL<<i);
+    }
+    if ( !run ) return;
+    if ( VSAM_snap_decode(&pcard->snap,DATA_TYPE,val[0]) ) return;
+    ac_ok = pder->use_ac && !VSAM_snap_decode(&pcard->snap,AC_TYPE,val[1]);
+    if ( !ac_ok ) memset( val[1],0,sizeof(val[1]) );
+
+    for (i=0,pi=pder->prog; i<pder->len; i++,pi++) {
+       switch ( pi->op ) {
+         case DRV_OP_CONST: st[sp++] = pi->val; break;
+         case DRV_OP_CHAN:
+           if ( pi->type && !ac_ok ) bad = 1;
+           st[sp++] = val[pi->type][pi->chan];
+           break;
+         case DRV_OP_ADD:   sp--; st[sp-1] += st[sp]; break;
+         case DRV_OP_SUB:   sp--; st[sp-1] -= st[sp]; break;
+         case DRV_OP_MUL:   sp--; st[sp-1] *= st[sp]; break;
+         case DRV_OP_DIV:
+           sp--;
+           if ( st[sp]==0.0 ) bad = 1;
+           else st[sp-1] /= st[sp];
+           break;
+         case DRV_OP_NEG:   st[sp-1] = -st[sp-1]; break;
+         case DRV_OP_SUM:
+         case DRV_OP_MIN:
+         case DRV_OP_MAX:
+         case DRV_OP_MEAN:
+           if ( pi->type && !ac_ok ) bad = 1;
+           for (chan=0,n=0,m=pi->mask,x=0.0; m; chan++,m>>=1) {
+              if ( !(m & 1) ) continue;
+              if ( !n++ ) x = val[pi->type][chan];
+              else if ( pi->op==DRV_OP_MIN ) { if ( val[pi->type][chan]<x ) x = val[pi->type][chan]; }
+              else if ( pi->op==DRV_OP_MAX ) { if ( val[pi->type][chan]>x ) x = val[pi->type][chan]; }
+              else x += val[pi->type][chan];
+           }
+           if ( (pi->op==DRV_OP_MEAN) && n ) x /= n;
+           st[sp++] = x;
+           break;
+         case DRV_OP_STORE:
+           sp--;
+           if ( run & (1UL<<pi->chan) ) {
+              pder->value[pi->chan] = st[sp];
+              if ( bad ) pder->valid &= ~(1UL<<pi->chan);
+              else       pder->valid |=  (1UL<<pi->chan);
+           }
+           sp = bad = 0;
+           break;
+       }
+    }
+    pder->count++;
+    scanIoRequest( pder->ioscan );
+}
+
+/*
+ * VSAM_get_derived - value of a derived channel
+ */
+int VSAM_get_derived( short card,short index,double *pval )
+{
+    VSAM_ID  pcard = NULL;
+    int      status = OK;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present || !pcard->pderive ) return(ERROR);
+    if ( (index<0) || (index>=VSAM_NUM_DERIVED) ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    if ( pcard->pderive->valid & (1UL<<index) ) *pval = pcard->pderive->value[index];
+    else status = ERROR;
+    epicsMutexUnlock( pcard->lock );
+    return(status);
+}
+
+/*
+ * VSAM_get_derived_all - values of derived channels 0..nmax-1;
+ *                        invalid ones read 0
+ */
+int VSAM_get_derived_all( short card,double *pval,unsigned long nmax,unsigned long *pnval )
+{
+    VSAM_ID        pcard = NULL;
+    unsigned long  i;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present || !pcard->pderive ) return(ERROR);
+    if ( nmax>VSAM_NUM_DERIVED ) nmax = VSAM_NUM_DERIVED;
+
+    epicsMutexMustLock( pcard->lock );
+    for (i=0; i<nmax; i++)
+       pval[i] = (pcard->pderive->valid & (1UL<<i)) ? pcard->pderive->value[i] : 0.0;
+    epicsMutexUnlock( pcard->lock );
+    *pnval = nmax;
+    return(OK);
+}
+
+/*
+ * VSAM_derive_report - print the derived channels of a card
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_derive_report( VSAM_ID pcard )
+{
+    VSAMDERIVE  *pder = pcard->pderive;
+    short        i;
+
+    epicsMutexMustLock( pcard->lock );
+    printf("\tderived: %d instructions  %lu runs\n",pder->len,pder->count);
+    for (i=0; i<VSAM_NUM_DERIVED; i++) {
+       if ( !(pder->defined & (1UL<<i)) ) continue;
+       printf("\t\tX%-2hd = %-40s ",i,pder->expr[i]);
+       if ( pder->valid & (1UL<<i) ) printf("%g\n",pder->value[i]);
+       else printf("invalid\n");
+    }
+    epicsMutexUnlock( pcard->lock );
+}
+
+/*
+ * VSAM_derive_compile - compile all defined expressions into pder->prog
+ */
+static int VSAM_derive_compile( VSAMDERIVE *pder,unsigned long *puse )
+{
+    DRVCOMP        comp;
+    unsigned long  use[2] = { 0,0 };
+    short          i;
+
+    memset( &comp,0,sizeof(comp) );
+    comp.prog = pder->prog;
+    comp.size = VSAM_DERIVE_PROG;
+    for (i=0; i<VSAM_NUM_DERIVED; i++) {
+       if ( !(pder->defined & (1UL<<i)) ) continue;
+       comp.pc     = pder->expr[i];
+       comp.depth  = 0;
+       comp.err    = NULL;
+       comp.use[0] = comp.use[1] = 0;
+       if ( !DRV_expr(&comp) ) {
+          DRV_skip( &comp );
+          if ( *comp.pc ) comp.err = "unexpected character";
+       }
+       if ( !comp.err ) DRV_emit( &comp,DRV_OP_STORE,0,i,0,0.0,-1 );
+       if ( comp.err ) {
+          errlogPrintf("VSAM_derive: X%hd: %s at \"%s\"\n",i,comp.err,comp.pc);
+          return(ERROR);
+       }
+       pder->use[i][0] = comp.use[0];
+       pder->use[i][1] = comp.use[1];
+       use[0] |= comp.use[0];
+       use[1] |= comp.use[1];
+    }
+    pder->len = comp.len;
+    puse[0] = use[0];
+    puse[1] = use[1];
+    return(OK);
+}
+
+/* expr := term { (+|-) term } */
+static int DRV_expr( DRVCOMP *pcomp )
+{
+    char  op;
+
+    if ( DRV_term(pcomp) ) return(ERROR);
+    for (;;) {
+       DRV_skip( pcomp );
+       op = *pcomp->pc;
+       if ( (op!='+') && (op!='-') ) return(OK);
+       pcomp->pc++;
+       if ( DRV_term(pcomp) ) return(ERROR);
+       if ( DRV_emit(pcomp,(op=='+') ? DRV_OP_ADD : DRV_OP_SUB,0,0,0,0.0,-1) ) return(ERROR);
+    }
+}
+
+/* term := factor { (*|/) factor } */
+static int DRV_term( DRVCOMP *pcomp )
+{
+    char  op;
+
+    if ( DRV_factor(pcomp) ) return(ERROR);
+    for (;;) {
+       DRV_skip( pcomp );
+       op = *pcomp->pc;
+       if ( (op!='*') && (op!='/') ) return(OK);
+       pcomp->pc++;
+       if ( DRV_factor(pcomp) ) return(ERROR);
+       if ( DRV_emit(pcomp,(op=='*') ? DRV_OP_MUL : DRV_OP_DIV,0,0,0,0.0,-1) ) return(ERROR);
+    }
+}
+
+/* factor := number | Dn | An | -factor | (expr) | func(group) */
+static int DRV_factor( DRVCOMP *pcomp )
+{
+    static const struct { const char *name; unsigned char op; } funcs[] = {
+       { "sum",DRV_OP_SUM }, { "min",DRV_OP_MIN }, { "max",DRV_OP_MAX }, { "mean",DRV_OP_MEAN }
+    };
+    unsigned char  type;
+    unsigned long  mask;
+    char          *pend;
+    double         val;
+    long           chan;
+    int            i;
+
+    DRV_skip( pcomp );
+    if ( *pcomp->pc=='-' ) {
+       pcomp->pc++;
+       if ( DRV_factor(pcomp) ) return(ERROR);
+       return( DRV_emit(pcomp,DRV_OP_NEG,0,0,0,0.0,0) );
+    }
+    if ( *pcomp->pc=='(' ) {
+       pcomp->pc++;
+       if ( DRV_expr(pcomp) ) return(ERROR);
+       DRV_skip( pcomp );
+       if ( *pcomp->pc!=')' ) {
+          pcomp->err = "missing )";
+          return(ERROR);
+       }
+       pcomp->pc++;
+       return(OK);
+    }
+    if ( isdigit((int)*pcomp->pc) || (*pcomp->pc=='.') ) {
+       val = strtod( pcomp->pc,&pend );
+       pcomp->pc = pend;
+       return( DRV_emit(pcomp,DRV_OP_CONST,0,0,0,val,1) );
+    }
+    if ( ((*pcomp->pc=='D') || (*pcomp->pc=='A')) && isdigit((int)pcomp->pc[1]) ) {
+       type = (*pcomp->pc=='A');
+       chan = strtol( pcomp->pc+1,&pend,10 );
+       if ( chan>=VSAM_NUM_CHANS ) {
+          pcomp->err = "no such channel";
+          return(ERROR);
+       }
+       pcomp->pc = pend;
+       pcomp->use[type] |= (1UL<<chan);
+       return( DRV_emit(pcomp,DRV_OP_CHAN,type,(short)chan,0,0.0,1) );
+    }
+    for (i=0; i<(int)(sizeof(funcs)/sizeof(funcs[0])); i++) {
+       if ( strncmp(pcomp->pc,funcs[i].name,strlen(funcs[i].name)) ) continue;
+       pcomp->pc += strlen(funcs[i].name);
+       if ( DRV_group(pcomp,&type,&mask) ) return(ERROR);
+       return( DRV_emit(pcomp,funcs[i].op,type,0,mask,0.0,1) );
+    }
+    pcomp->err = "expected a number, channel or function";
+    return(ERROR);
+}
+
+/* group := ( item { , item } ), item := [D|A]n[-m], all of one type */
+static int DRV_group( DRVCOMP *pcomp,unsigned char *ptype,unsigned long *pmask )
+{
+    char   *pend;
+    long    first,last,chan;
+    int     type,n = 0;
+
+    DRV_skip( pcomp );
+    if ( *pcomp->pc!='(' ) {
+       pcomp->err = "expected (";
+       return(ERROR);
+    }
+    pcomp->pc++;
+    *pmask = 0;
+    *ptype = 0;
+    do {
+       DRV_skip( pcomp );
+       type = 0;
+       if ( *pcomp->pc=='A' )      { type = 1; pcomp->pc++; }
+       else if ( *pcomp->pc=='D' ) pcomp->pc++;
+       if ( n++ && (type!=*ptype) ) {
+          pcomp->err = "data and AC in one group";
+          return(ERROR);
+       }
+       *ptype = type;
+       first = last = strtol( pcomp->pc,&pend,10 );
+       if ( pend==pcomp->pc ) {
+          pcomp->err = "expected a channel";
+          return(ERROR);
+       }
+       pcomp->pc = pend;
+       DRV_skip( pcomp );
+       if ( *pcomp->pc=='-' ) {
+          pcomp->pc++;
+          DRV_skip( pcomp );
+          if ( (*pcomp->pc=='A') || (*pcomp->pc=='D') ) pcomp->pc++;
+          last = strtol( pcomp->pc,&pend,10 );
+          if ( pend==pcomp->pc ) {
+             pcomp->err = "expected a channel";
+             return(ERROR);
+          }
+          pcomp->pc = pend;
+       }
+       if ( (first<0) || (last>=VSAM_NUM_CHANS) || (first>last) ) {
+          pcomp->err = "no such channels";
+          return(ERROR);
+       }
+       for (chan=first; chan<=last; chan++) *pmask |= (1UL<<chan);
+       DRV_skip( pcomp );
+       if ( *pcomp->pc!=',' ) break;
+       pcomp->pc++;
+    } while ( TRUE );
+
+    if ( *pcomp->pc!=')' ) {
+       pcomp->err = "missing )";
+       return(ERROR);
+    }
+    pcomp->pc++;
+    pcomp->use[*ptype] |= *pmask;
+    return(OK);
+}
+
+/*
+ * DRV_emit - add an instruction; push is its effect on the stack depth
+ */
+static int DRV_emit( DRVCOMP *pcomp,unsigned char op,unsigned char type,short chan,
+                     unsigned long mask,double val,int push )
+{
+    VSAMINSN  *pi;
+
+    if ( pcomp->len>=pcomp->size ) {
+       pcomp->err = "too many instructions";
+       return(ERROR);
+    }
+    pcomp->depth += push;
+    if ( pcomp->depth>DRV_STACK_SIZE ) {
+       pcomp->err = "expression too deep";
+       return(ERROR);
+    }
+    pi = &pcomp->prog[pcomp->len++];
+    pi->op   = op;
+    pi->type = type;
+    pi->chan = chan;
+    pi->mask = mask;
+    pi->val  = val;
+    return(OK);
+}
+
+static void DRV_skip( DRVCOMP *pcomp )
+{
+    while ( isspace((int)*pcomp->pc) ) pcomp->pc++;
+}
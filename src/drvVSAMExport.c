@@ -0,0 +1,281 @@
+/* drvVSAMExport.c - Machine-readable statistics export for the VSAM driver
+ *
+ *	Serializes card configuration, health, firmware version,
+ *	driver counters and latency histograms as JSON or as
+ *	Prometheus exposition text.  The snapshot is written on
+ *	demand with VSAM_stats_dump(), or periodically to a file
+ *	with VSAM_stats_export() for a local collector to scrape.
+ */
+
+#include        <stdio.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include        "epicsMath.h"      /* isnan(), isinf()     */
+#include        "epicsThread.h"
+#include	"VSAM.h"           /* VSAM_next_card, etc  */
+#include        "epicsExport.h"
+
+typedef struct VSAMEXPORT {
+    int      format;
+    char    *file;
+    double   period;
+} VSAMEXPORT;
+
+/* Local variables */
+static int  export_started = 0;
+
+static const char *histKey_c[VSAM_NUM_HISTS]  = { "ai_read", "input", "output", "acquire" };
+static const char *readKey_c[4]  = { "data", "range", "ac", "status" };
+static const char *writeKey_c[3] = { "mode", "reset", "diag" };
+
+static void VSAM_json_write( FILE *fp );
+static void VSAM_prom_write( FILE *fp );
+static void VSAM_export_task( void *parm );
+
+/*
+ * VSAM_stats_write - write one snapshot of the driver statistics
+ */
+int VSAM_stats_write( FILE *fp,int format )
+{
+    if ( format==VSAM_EXPORT_JSON )      VSAM_json_write( fp );
+    else if ( format==VSAM_EXPORT_PROM ) VSAM_prom_write( fp );
+    else return(ERROR);
+    return(OK);
+}
+
+/*
+ * VSAM_stats_dump - write the statistics to a file, or to stdout
+ *                   if no file is given
+ */
+long VSAM_stats_dump( int format,const char *file )
+{
+    int    status;
+    FILE  *fp;
+
+    if ( !file || !file[0] ) 
+       return( VSAM_stats_write(stdout,format) );
+
+    fp = fopen( file,"w" );
+    if ( !fp ) {
+       errlogPrintf("VSAM_stats_dump: can't open %s\n",file);
+       return(ERROR);
+    }
+    status = VSAM_stats_write( fp,format );
+    fclose( fp );
+    return(status);
+}
+
+/*
+ * VSAM_stats_export - start a task which rewrites the file every period
+ *                     seconds.  The file is written under a temporary
+ *                     name and renamed, so a reader never sees it half done.
+ *                     Only one export task is started.
+ */
+long VSAM_stats_export( int format,const char *file,double period )
+{
+    VSAMEXPORT  *pexp;
+
+    if ( !file || !file[0] || (period<=0.0) ||
+         ((format!=VSAM_EXPORT_JSON) && (format!=VSAM_EXPORT_PROM)) ) {
+       errlogPrintf("VSAM_stats_export: need format 0 (JSON) or 1 (Prometheus), file and period\n");
+       return(ERROR);
+    }
+    if ( export_started ) {
+       errlogPrintf("VSAM_stats_export: already exporting, one file per IOC\n");
+       return(ERROR);
+    }
+    export_started = 1;
+    pexp = callocMustSucceed( 1,sizeof(VSAMEXPORT),"VSAM_stats_export" );
+    pexp->format = format;
+    pexp->file   = epicsStrDup( file );
+    pexp->period = period;
+    epicsThreadMustCreate( "VSAMexport",
+                           epicsThreadPriorityLow,
+                           epicsThreadGetStackSize(epicsThreadStackMedium),
+                           VSAM_export_task,
+                           pexp );
+    return(OK);
+}
+
+static void VSAM_export_task( void *parm )
+{
+    VSAMEXPORT  *pexp = (VSAMEXPORT *)parm;
+    char        *tmp_c;
+    FILE        *fp;
+
+    tmp_c = callocMustSucceed( 1,strlen(pexp->file)+5,"VSAM_export_task" );
+    sprintf( tmp_c,"%s.tmp",pexp->file );
+    for (;;) {
+       fp = fopen( tmp_c,"w" );
+       if ( fp ) {
+          VSAM_stats_write( fp,pexp->format );
+          fclose( fp );
+          rename( tmp_c,pexp->file );
+       }
+       epicsThreadSleep( pexp->period );
+    }
+}
+
+static void VSAM_json_write( FILE *fp )
+{
+    short         h;
+    int           n;
+    double        age;
+    VSAMSNAP      snap;
+    VSAMSTATS    *pstats;
+    VSAMHIST      hist;
+    VSAM_ID       pcard;
+    const char   *sep = "";
+    char          status_c[16],calib_c[8],fast_c[8],fw_c[32];
+
+    fprintf(fp,"{\"driver\":\"%s\",\"cards\":[",VSAM_DRV_VERSION);
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       pstats = &pcard->stats;
+       /* no snapshot yet, the card state is unknown */
+       if ( (VSAM_get_snapshot(pcard->card,&snap)!=OK) || !pstats->snapshots ) {
+          strcpy( status_c,"null" );
+          strcpy( calib_c,"null" );
+          strcpy( fast_c,"null" );
+       }
+       else {
+          sprintf( status_c,"%lu",snap.status );
+          sprintf( calib_c,"%d",(snap.status & CALIB_SUCCESS) ? 1 : 0 );
+          sprintf( fast_c,"%d",(snap.status & FAST_SCAN_MODE) ? 1 : 0 );
+       }
+       if ( VSAM_get_counter(pcard->card,VSAM_CNT_DATA_AGE,&age)!=OK ) age = -1.0;
+       /* JSON has no NaN, a revision that did not read back is null */
+       if ( isnan(pcard->fw_version[0]) || isinf(pcard->fw_version[0]) ) strcpy( fw_c,"null" );
+       else sprintf( fw_c,"%g",(double)pcard->fw_version[0] );
+
+       fprintf(fp,"%s\n {\"card\":%hd,\"a24\":%lu,\"registered\":%hu,\"present\":%hu,",
+               sep,pcard->card,pcard->bus_addr,pcard->registered,pcard->present);
+       fprintf(fp,"\"firmware\":%s,\"status\":%s,\"calibrated\":%s,\"fast_scan\":%s,\"data_age\":%g,",
+               fw_c,status_c,calib_c,fast_c,age);
+       fprintf(fp,"\n  \"reads\":{\"data\":%lu,\"range\":%lu,\"ac\":%lu,\"status\":%lu},",
+               pstats->data_reads,pstats->range_reads,pstats->ac_reads,pstats->csr_reads);
+       fprintf(fp,"\n  \"writes\":{\"mode\":%lu,\"reset\":%lu,\"diag\":%lu},",
+               pstats->mode_writes,pstats->reset_writes,pstats->diag_writes);
+       fprintf(fp,"\n  \"bus_errors\":%lu,\"snapshots\":%lu,\"records\":%lu,\"acq_usec\":%lu,",
+               pstats->bus_errors,pstats->snapshots,pstats->records,pstats->acq_usec);
+       fprintf(fp,"\n  \"throttled\":%lu,\"throttle_usec\":%lu,\"triggered\":%d,\"trig_usec\":%lu,",
+               pstats->throttled,pstats->throttle_usec,pcard->triggered,pstats->trig_usec);
+       fprintf(fp,"\n  \"latency_usec\":{");
+       for (h=0; h<VSAM_NUM_HISTS; h++) {
+          hist = pcard->hist[h];
+          fprintf(fp,"%s\n   \"%s\":{\"count\":%lu,\"sum\":%.0f,\"p50\":%lu,\"p99\":%lu,\"max\":%lu,\"bins\":[",
+                  h ? "," : "",histKey_c[h],hist.count,hist.sum_usec,
+                  VSAM_hist_percentile(&hist,50.0),
+                  VSAM_hist_percentile(&hist,99.0),
+                  hist.max_usec);
+          for (n=0; n<VSAM_HIST_BINS; n++)
+             fprintf(fp,"%s%lu",n ? "," : "",hist.bin[n]);
+          fprintf(fp,"]}");
+       }
+       fprintf(fp,"}}");
+       sep = ",";
+    }
+    fprintf(fp,"\n]}\n");
+}
+
+static void VSAM_prom_write( FILE *fp )
+{
+    short         h;
+    int           n;
+    unsigned long cum;
+    double        age;
+    VSAMSNAP      snap;
+    VSAMSTATS    *pstats;
+    VSAMHIST      hist;
+    VSAM_ID       pcard;
+    unsigned long reads[4],writes[3];
+
+    fprintf(fp,"# HELP vsam_card_info VSAM card configuration\n# TYPE vsam_card_info gauge\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+       fprintf(fp,"vsam_card_info{card=\"%hd\",a24=\"0x%06lx\",firmware=\"%g\"} 1\n",
+               pcard->card,pcard->bus_addr,(double)pcard->fw_version[0]);
+
+    fprintf(fp,"# HELP vsam_card_present 1 if the card initialized\n# TYPE vsam_card_present gauge\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+       fprintf(fp,"vsam_card_present{card=\"%hd\"} %hu\n",pcard->card,pcard->present);
+
+    fprintf(fp,"# HELP vsam_card_calibrated calibration bit of the last snapshot, NaN before one\n# TYPE vsam_card_calibrated gauge\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       if ( (VSAM_get_snapshot(pcard->card,&snap)!=OK) || !pcard->stats.snapshots )
+          fprintf(fp,"vsam_card_calibrated{card=\"%hd\"} NaN\n",pcard->card);
+       else
+          fprintf(fp,"vsam_card_calibrated{card=\"%hd\"} %d\n",pcard->card,(snap.status & CALIB_SUCCESS) ? 1 : 0);
+    }
+
+    fprintf(fp,"# HELP vsam_data_age_seconds time since fresh analog data\n# TYPE vsam_data_age_seconds gauge\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       if ( VSAM_get_counter(pcard->card,VSAM_CNT_DATA_AGE,&age)!=OK ) continue;
+       fprintf(fp,"vsam_data_age_seconds{card=\"%hd\"} %g\n",pcard->card,age);
+    }
+
+    fprintf(fp,"# HELP vsam_reads_total D32 reads by type\n# TYPE vsam_reads_total counter\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       pstats = &pcard->stats;
+       reads[0] = pstats->data_reads;  reads[1] = pstats->range_reads;
+       reads[2] = pstats->ac_reads;    reads[3] = pstats->csr_reads;
+       for (n=0; n<4; n++)
+          fprintf(fp,"vsam_reads_total{card=\"%hd\",type=\"%s\"} %lu\n",pcard->card,readKey_c[n],reads[n]);
+    }
+
+    fprintf(fp,"# HELP vsam_writes_total register writes by type\n# TYPE vsam_writes_total counter\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       pstats = &pcard->stats;
+       writes[0] = pstats->mode_writes; writes[1] = pstats->reset_writes; writes[2] = pstats->diag_writes;
+       for (n=0; n<3; n++)
+          fprintf(fp,"vsam_writes_total{card=\"%hd\",type=\"%s\"} %lu\n",pcard->card,writeKey_c[n],writes[n]);
+    }
+
+    fprintf(fp,"# HELP vsam_bus_errors_total failed bus probes\n# TYPE vsam_bus_errors_total counter\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+       fprintf(fp,"vsam_bus_errors_total{card=\"%hd\"} %lu\n",pcard->card,pcard->stats.bus_errors);
+
+    fprintf(fp,"# HELP vsam_snapshots_total whole-card acquisitions\n# TYPE vsam_snapshots_total counter\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+       fprintf(fp,"vsam_snapshots_total{card=\"%hd\"} %lu\n",pcard->card,pcard->stats.snapshots);
+
+    fprintf(fp,"# HELP vsam_records_total record reads and writes served\n# TYPE vsam_records_total counter\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+       fprintf(fp,"vsam_records_total{card=\"%hd\"} %lu\n",pcard->card,pcard->stats.records);
+
+    fprintf(fp,"# HELP vsam_throttled_total waits for the bus budget\n# TYPE vsam_throttled_total counter\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+       fprintf(fp,"vsam_throttled_total{card=\"%hd\"} %lu\n",pcard->card,pcard->stats.throttled);
+
+    fprintf(fp,"# HELP vsam_throttled_seconds_total time spent waiting for the bus budget\n# TYPE vsam_throttled_seconds_total counter\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+       fprintf(fp,"vsam_throttled_seconds_total{card=\"%hd\"} %g\n",pcard->card,pcard->stats.throttle_usec*1e-6);
+
+    fprintf(fp,"# HELP vsam_trigger_offset_seconds last trigger to the snapshot of the card\n# TYPE vsam_trigger_offset_seconds gauge\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+       if ( pcard->triggered )
+          fprintf(fp,"vsam_trigger_offset_seconds{card=\"%hd\"} %g\n",pcard->card,pcard->stats.trig_usec*1e-6);
+
+    fprintf(fp,"# HELP vsam_acquisition_seconds duration of the last acquisition\n# TYPE vsam_acquisition_seconds gauge\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+       fprintf(fp,"vsam_acquisition_seconds{card=\"%hd\"} %g\n",pcard->card,pcard->stats.acq_usec*1e-6);
+
+    fprintf(fp,"# HELP vsam_latency_seconds driver hot path latency\n# TYPE vsam_latency_seconds histogram\n");
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       for (h=0; h<VSAM_NUM_HISTS; h++) {
+          /* bin n holds up to 2**n usec, so it is the le bucket of that,
+             counted from a copy so the buckets add up to +Inf */
+          hist = pcard->hist[h];
+          for (n=0,cum=0; n<VSAM_HIST_BINS-1; n++) {
+             cum += hist.bin[n];
+             fprintf(fp,"vsam_latency_seconds_bucket{card=\"%hd\",path=\"%s\",le=\"%g\"} %lu\n",
+                     pcard->card,histKey_c[h],(double)(1UL<<n)*1e-6,cum);
+          }
+          cum += hist.bin[VSAM_HIST_BINS-1];
+          fprintf(fp,"vsam_latency_seconds_bucket{card=\"%hd\",path=\"%s\",le=\"+Inf\"} %lu\n",
+                  pcard->card,histKey_c[h],cum);
+          fprintf(fp,"vsam_latency_seconds_sum{card=\"%hd\",path=\"%s\"} %g\n",
+                  pcard->card,histKey_c[h],hist.sum_usec*1e-6);
+          fprintf(fp,"vsam_latency_seconds_count{card=\"%hd\",path=\"%s\"} %lu\n",
+                  pcard->card,histKey_c[h],cum);
+       }
+    }
+}
@@ -0,0 +1,397 @@
+/* drvVSAMFault.c - Fault injection on the VSAM bus
+ *
+ *	VSAM_fault(card,kind,rate,arg,start,duration) makes the bus
+ *	backend (drvVSAMBus.c) misbehave for one card, or all cards
+ *	if card is -1, so the recovery paths of the driver can be
+ *	exercised and timed.  The kinds are:
+ *
+ *	    "bus"      probes fail and reads return all ones, as if
+ *	               the card did not answer; the reads are
+ *	               counted as bus errors of the card
+ *	    "latency"  accesses take arg usec longer, under a second
+ *	    "stuck"    data words keep the value they had when the
+ *	               fault started
+ *	    "calib"    the status register loses CALIB_SUCCESS
+ *	    "range"    a range byte reads 0xff, above MAX_RANGE_BYTE
+ *
+ *	Each access is hit with probability rate (1 for always).  The
+ *	fault starts start seconds after the call and lasts duration
+ *	seconds, or until VSAM_fault_clear(card) if duration is 0.
+ *	The injector wraps the backend in use when called, so call
+ *	it after VSAM_replay() if replaying, and puts the backend back
+ *	once every fault is over and, if it hit, has seen its
+ *	recovery, so that the bus is not slowed after.  It can be turned on
+ *	and off while the IOC runs; called before iocInit it also hits
+ *	VSAM_init().
+ *
+ *	The report gives, per fault, how often it hit, and the time
+ *	from the end of the fault to the first read of the card that
+ *	no fault spoiled after it, if the fault had hit at all.
+ */
+
+#include        <stdlib.h>
+#include        <string.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include	"VSAM.h"           /* VSAMFAULT, etc       */
+#include        "epicsExport.h"
+
+static long        fault_map( const char *name,short card,unsigned long addr,VSAMMEM **ppVSAM );
+static int         fault_probe( volatile void *paddr,epicsUInt32 *pval );
+static epicsUInt32 fault_in32( volatile void *paddr );
+static void        fault_out32( volatile void *paddr,epicsUInt32 val );
+static float       fault_inf( volatile void *paddr );
+static int         VSAM_fault_busy( VSAMFAULT *pf,const epicsTimeStamp *pnow,unsigned long *pactive );
+static void        VSAM_fault_retire( VSAMFAULT *pf,const epicsTimeStamp *pnow );
+static VSAM_ID     VSAM_fault_card( volatile void *paddr,VSAMFAULT **ppf,
+                                    unsigned long *pactive,epicsTimeStamp *pnow );
+static int         VSAM_fault_hit( VSAMFAULT *pf,unsigned long active,int kind,const epicsTimeStamp *pnow );
+static void        VSAM_fault_good( VSAMFAULT *pf,const epicsTimeStamp *pnow );
+static void        fault_delay( VSAMFAULT *pf,unsigned long active,const epicsTimeStamp *pnow );
+
+static VSAMBUS fault_bus = { "fault",fault_map,fault_probe,fault_in32,fault_out32,fault_inf };
+
+static const char *faultName_c[VSAM_NUM_FAULTS] = { "bus", "latency", "stuck", "calib", "range" };
+
+/* Local variables */
+static VSAMBUS        *fault_inner = NULL;   /* the backend wrapped      */
+static epicsMutexId    fault_lock  = NULL;   /* guards the wrapping      */
+static unsigned long   fault_seed  = 12345;
+
+/*
+ * VSAM_fault - inject a fault on one card, or all cards (-1)
+ */
+long VSAM_fault( short card,const char *kind,double rate,double arg,double start,double duration )
+{
+    VSAM_ID         pcard;
+    VSAMFAULT      *pf;
+    VSAMFAULTSPEC  *ps;
+    epicsTimeStamp  now;
+    int             k,found = 0;
+
+    for (k=0; k<VSAM_NUM_FAULTS; k++)
+       if ( kind && !strcmp(kind,faultName_c[k]) ) break;
+    if ( (k>=VSAM_NUM_FAULTS) || (rate<0.0) || (rate>1.0) || (arg<0.0) ||
+         ((k==VSAM_FAULT_LATENCY) && (arg>=1e6)) || (start<0.0) || (duration<0.0) ) {
+       errlogPrintf("VSAM_fault: need kind bus, latency, stuck, calib or range, rate 0..1,\n"
+                    "\tand arg (latency under 1e6 usec), start and duration >= 0\n");
+       return(ERROR);
+    }
+
+    if ( !fault_lock ) fault_lock = epicsMutexMustCreate();
+
+    epicsMutexMustLock( fault_lock );
+    epicsTimeGetCurrent( &now );
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       if ( (card>=0) && (pcard->card!=card) ) continue;
+       if ( !pcard->pfault )
+          pcard->pfault = callocMustSucceed( 1,sizeof(VSAMFAULT),"VSAM_fault" );
+       pf = pcard->pfault;
+       ps = &pf->spec[k];
+       ps->on    = 0;
+       ps->rate  = rate;
+       ps->arg   = arg;
+       ps->hits  = 0;
+       ps->begin = now;
+       epicsTimeAddSeconds( &ps->begin,start );
+       ps->end   = ps->begin;
+       epicsTimeAddSeconds( &ps->end,duration );
+       ps->forever = (duration==0.0);
+       ps->stuck_valid = 0;
+       ps->recovered   = 0;
+       ps->on    = 1;
+       pf->done  = 0;
+       found++;
+    }
+    if ( found && (pVSAMbus!=&fault_bus) ) {
+       fault_inner = pVSAMbus;
+       pVSAMbus    = &fault_bus;
+    }
+    epicsMutexUnlock( fault_lock );
+    if ( !found ) {
+       errlogPrintf("VSAM_fault: card %hd not configured\n",card);
+       return(ERROR);
+    }
+    return(OK);
+}
+
+/*
+ * VSAM_fault_clear - end all faults of one card, or all cards (-1)
+ */
+long VSAM_fault_clear( short card )
+{
+    VSAM_ID         pcard;
+    epicsTimeStamp  now;
+    int             k;
+
+    epicsTimeGetCurrent( &now );
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       if ( ((card>=0) && (pcard->card!=card)) || !pcard->pfault ) continue;
+       for (k=0; k<VSAM_NUM_FAULTS; k++) {
+          if ( !pcard->pfault->spec[k].on ) continue;
+          pcard->pfault->spec[k].forever = 0;
+          if ( epicsTimeGreaterThan(&pcard->pfault->spec[k].end,&now) )
+             pcard->pfault->spec[k].end = now;
+       }
+    }
+    return(OK);
+}
+
+/*
+ * VSAM_fault_card - card and faults of a bus address, and the
+ *                   faults whose window the access falls in
+ */
+static VSAM_ID VSAM_fault_card( volatile void *paddr,VSAMFAULT **ppf,
+                                unsigned long *pactive,epicsTimeStamp *pnow )
+{
+    VSAM_ID         pcard;
+    char           *p = (char *)paddr;
+
+    *pactive = 0;
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       if ( (p<(char *)pcard->pVSAM) || (p>=(char *)(pcard->pVSAM+1)) ) continue;
+       *ppf = pcard->pfault;
+       if ( !pcard->pfault || pcard->pfault->done ) return(pcard);
+
+       /* the clock is read once per access, for all kinds,
+          while any fault is on or waits for its recovery */
+       epicsTimeGetCurrent( pnow );
+       if ( !VSAM_fault_busy(pcard->pfault,pnow,pactive) ) VSAM_fault_retire( pcard->pfault,pnow );
+       return(pcard);
+    }
+    *ppf = NULL;
+    return(NULL);
+}
+
+/*
+ * VSAM_fault_busy - TRUE while a fault of a card has not started,
+ *                   is active or waits for its recovery; sets the
+ *                   active ones in *pactive
+ */
+static int VSAM_fault_busy( VSAMFAULT *pf,const epicsTimeStamp *pnow,unsigned long *pactive )
+{
+    VSAMFAULTSPEC  *ps;
+    int             k,busy = 0;
+
+    for (k=0; k<VSAM_NUM_FAULTS; k++) {
+       ps = &pf->spec[k];
+       if ( !ps->on ) continue;
+       if ( epicsTimeLessThan(pnow,&ps->begin) ) busy = 1;
+       else if ( ps->forever || epicsTimeLessThan(pnow,&ps->end) ) {
+          *pactive |= (1UL<<k);
+          busy = 1;
+       }
+       else if ( ps->hits && !ps->recovered ) busy = 1;
+    }
+    return(busy);
+}
+
+/*
+ * VSAM_fault_retire - a card is done with its faults; once all
+ *                     cards are, put the wrapped backend back
+ *
+ *  Looked at again under the lock, VSAM_fault() may just have
+ *  set up another.
+ */
+static void VSAM_fault_retire( VSAMFAULT *pf,const epicsTimeStamp *pnow )
+{
+    VSAM_ID        pcard;
+    unsigned long  active = 0;
+
+    epicsMutexMustLock( fault_lock );
+    if ( !VSAM_fault_busy(pf,pnow,&active) ) {
+       pf->done = 1;
+       for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+          if ( pcard->pfault && !pcard->pfault->done ) break;
+       if ( !pcard && (pVSAMbus==&fault_bus) ) pVSAMbus = fault_inner;
+    }
+    epicsMutexUnlock( fault_lock );
+}
+
+/*
+ * VSAM_fault_hit - TRUE if a fault is active and hits this access
+ */
+static int VSAM_fault_hit( VSAMFAULT *pf,unsigned long active,int kind,const epicsTimeStamp *pnow )
+{
+    VSAMFAULTSPEC  *ps;
+
+    if ( !pf || !(active & (1UL<<kind)) ) return(FALSE);
+    ps = &pf->spec[kind];
+    if ( ps->rate<1.0 ) {
+       /* xorshift, good enough to spread the hits */
+       fault_seed ^= fault_seed << 13;
+       fault_seed ^= fault_seed >> 17;
+       fault_seed ^= fault_seed << 5;
+       if ( (double)(fault_seed & 0xffffff)/(double)0x1000000 >= ps->rate ) return(FALSE);
+    }
+    ps->hits++;
+    ps->last = *pnow;
+    return(TRUE);
+}
+
+/*
+ * VSAM_fault_good - a read no fault spoiled; the first after a
+ *                   fault that hit has ended is its recovery
+ */
+static void VSAM_fault_good( VSAMFAULT *pf,const epicsTimeStamp *pnow )
+{
+    VSAMFAULTSPEC  *ps;
+    int             k;
+
+    if ( !pf ) return;
+    for (k=0; k<VSAM_NUM_FAULTS; k++) {
+       ps = &pf->spec[k];
+       if ( ps->on && ps->hits && !ps->forever && !ps->recovered &&
+            !epicsTimeLessThan(pnow,&ps->end) ) {
+          ps->recovery  = *pnow;
+          ps->recovered = 1;
+       }
+    }
+}
+
+/*
+ * fault_delay - add latency to an access, spinning on the cycle
+ *               counter since the delays are shorter than a clock
+ *               tick
+ */
+static void fault_delay( VSAMFAULT *pf,unsigned long active,const epicsTimeStamp *pnow )
+{
+    epicsUInt32  start;
+
+    if ( !VSAM_fault_hit(pf,active,VSAM_FAULT_LATENCY,pnow) ) return;
+    start = VSAM_cycles();
+    while ( VSAM_cycle_usec(start) < pf->spec[VSAM_FAULT_LATENCY].arg ) ;
+}
+
+/* Fault backend: calls the wrapped backend, then spoils the result */
+
+static long fault_map( const char *name,short card,unsigned long addr,VSAMMEM **ppVSAM )
+{
+    return( (*fault_inner->map)(name,card,addr,ppVSAM) );
+}
+
+static int fault_probe( volatile void *paddr,epicsUInt32 *pval )
+{
+    VSAM_ID         pcard;
+    VSAMFAULT      *pf;
+    unsigned long   active;
+    epicsTimeStamp  now;
+    int             status;
+
+    pcard = VSAM_fault_card( paddr,&pf,&active,&now );
+    fault_delay( pf,active,&now );
+    if ( VSAM_fault_hit(pf,active,VSAM_FAULT_BUS,&now) ) return(ERROR);
+    status = (*fault_inner->probe)( paddr,pval );
+    if ( !status && pcard && (paddr==(volatile void *)&pcard->pVSAM->status) &&
+         VSAM_fault_hit(pf,active,VSAM_FAULT_CALIB,&now) )
+       *pval &= ~CALIB_SUCCESS;
+    else if ( !status ) VSAM_fault_good( pf,&now );
+    return(status);
+}
+
+static epicsUInt32 fault_in32( volatile void *paddr )
+{
+    VSAM_ID         pcard;
+    VSAMFAULT      *pf;
+    unsigned long   active;
+    epicsTimeStamp  now;
+    epicsUInt32     val;
+    char           *p = (char *)paddr;
+
+    pcard = VSAM_fault_card( paddr,&pf,&active,&now );
+    fault_delay( pf,active,&now );
+    if ( pcard && VSAM_fault_hit(pf,active,VSAM_FAULT_BUS,&now) ) {
+       /* a read the card does not answer gives all ones */
+       pcard->stats.bus_errors++;
+       return(0xffffffff);
+    }
+    val = (*fault_inner->in32)( paddr );
+    if ( !pcard || !pf ) return(val);
+
+    if ( paddr==(volatile void *)&pcard->pVSAM->status ) {
+       if ( VSAM_fault_hit(pf,active,VSAM_FAULT_CALIB,&now) ) return(val & ~CALIB_SUCCESS);
+    }
+    else if ( (p>=(char *)pcard->pVSAM->range) && (p<(char *)pcard->pVSAM->ac) ) {
+       if ( VSAM_fault_hit(pf,active,VSAM_FAULT_RANGE,&now) ) return(val | (0xffUL << (8*(fault_seed & 3))));
+    }
+    VSAM_fault_good( pf,&now );
+    return(val);
+}
+
+static void fault_out32( volatile void *paddr,epicsUInt32 val )
+{
+    VSAMFAULT       *pf;
+    unsigned long    active;
+    epicsTimeStamp   now;
+
+    VSAM_fault_card( paddr,&pf,&active,&now );
+    fault_delay( pf,active,&now );
+    (*fault_inner->out32)( paddr,val );
+}
+
+static float fault_inf( volatile void *paddr )
+{
+    VSAM_ID         pcard;
+    VSAMFAULT      *pf;
+    VSAMFAULTSPEC  *ps;
+    unsigned long   active;
+    epicsTimeStamp  now;
+    union { epicsUInt32 u; float f; } poison;
+    float           val;
+    int             chan;
+
+    pcard = VSAM_fault_card( paddr,&pf,&active,&now );
+    fault_delay( pf,active,&now );
+    if ( pcard && VSAM_fault_hit(pf,active,VSAM_FAULT_BUS,&now) ) {
+       /* all ones, a NaN */
+       pcard->stats.bus_errors++;
+       poison.u = 0xffffffff;
+       return(poison.f);
+    }
+    val = (*fault_inner->inf)( paddr );
+    if ( !pcard || !pf ) return(val);
+
+    chan = (int)((volatile float *)paddr - pcard->pVSAM->data);
+    ps = &pf->spec[VSAM_FAULT_STUCK];
+    if ( (chan>=0) && (chan<VSAM_NUM_CHANS) && VSAM_fault_hit(pf,active,VSAM_FAULT_STUCK,&now) ) {
+       if ( !(ps->stuck_valid & (1UL<<chan)) ) {
+          ps->stuck[chan]  = val;
+          ps->stuck_valid |= (1UL<<chan);
+       }
+       return(ps->stuck[chan]);
+    }
+    VSAM_fault_good( pf,&now );
+    return(val);
+}
+
+/*
+ * VSAM_fault_report - print the faults of a card
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_fault_report( VSAM_ID pcard )
+{
+    VSAMFAULTSPEC  *ps;
+    epicsTimeStamp  now;
+    int             k;
+
+    epicsTimeGetCurrent( &now );
+    for (k=0; k<VSAM_NUM_FAULTS; k++) {
+       ps = &pcard->pfault->spec[k];
+       if ( !ps->on ) continue;
+       printf("\tfault %-7s rate %g",faultName_c[k],ps->rate);
+       if ( k==VSAM_FAULT_LATENCY ) printf(" of %g usec",ps->arg);
+       printf(": %lu hits, ",ps->hits);
+       if ( epicsTimeLessThan(&now,&ps->begin) )
+          printf("starts in %.3f sec\n",epicsTimeDiffInSeconds(&ps->begin,&now));
+       else if ( ps->forever || epicsTimeLessThan(&now,&ps->end) )
+          printf("active\n");
+       else if ( !ps->hits )
+          printf("over, never hit\n");
+       else if ( ps->recovered )
+          printf("over, good data %.6f sec after the end\n",
+                 epicsTimeDiffInSeconds(&ps->recovery,&ps->end));
+       else
+          printf("over, no good data since\n");
+    }
+}
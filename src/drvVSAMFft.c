@@ -0,0 +1,405 @@
+/* drvVSAMFft.c - Spectra of VSAM channel data taken in fast scan
+ *
+ *	VSAM_fft_config(card,first,last,n,period,sample_period) keeps
+ *	the last n (a power of 2) samples of channels first..last
+ *	while the card is in fast scan mode.  A sample is taken on
+ *	every acquisition that reads all of these channels; with
+ *	sample_period non-zero they are put on the acquisition
+ *	schedule at that period, and channels analyzed before but
+ *	not now are taken off it.  Leaving fast scan starts the
+ *	history over.
+ *
+ *	Every period seconds a low priority task takes a real FFT of
+ *	the history of each channel, after removing the mean and
+ *	applying a Hann window, and publishes
+ *	    - the amplitude spectrum, n/2+1 bins, waveform parm F,
+ *	      signal is the channel, or 32 for the frequencies (Hz)
+ *	    - the frequency of the largest bin, interpolated between
+ *	      bins, ai parm F, signal is the channel
+ *	The records are posted through I/O Intr.  The frequency axis
+ *	comes from the time stamps of the samples.
+ *
+ *	The history and the results are guarded by the card lock;
+ *	the FFT itself is done with the card unlocked.  So a history
+ *	replaced by a new VSAM_fft_config() is handed to the task,
+ *	which frees it between analyses.
+ */
+
+#include        <stdlib.h>
+#include        <string.h>
+#include        <math.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include        "dbScan.h"         /* scanIoRequest()      */
+#include	"VSAM.h"           /* VSAMFFT, etc         */
+#include        "epicsExport.h"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+#define FFT_MAX_SLEEP  1.0         /* sec, longest idle wait */
+
+/* Local variables */
+static epicsThreadId   fft_tid = NULL;
+static epicsMutexId    fft_lock = NULL;     /* guards fft_retired   */
+static VSAMFFT        *fft_retired = NULL;  /* for the task to free */
+
+static void VSAM_fft_task( void *parm );
+static void VSAM_fft_free( VSAMFFT *pfft );
+static void VSAM_fft_analyze( VSAM_ID pcard );
+static void VSAM_fft_real( VSAMFFT *pfft,const float *px,float *pmag );
+
+/*
+ * VSAM_fft_config - keep a history of channels first..last in
+ *                   fast scan and analyze it every period sec
+ */
+long VSAM_fft_config( short card,short first,short last,int n,double period,double sample_period )
+{
+    VSAM_ID    pcard = NULL;
+    VSAMFFT   *pfft = NULL;
+    VSAMFFT   *pold = NULL;
+    unsigned long  mask,unsched;
+    int        i;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || (first<0) || (last>=VSAM_NUM_CHANS) || (first>last) ||
+         (n<8) || (n>VSAM_FFT_MAX) || (n & (n-1)) || (period<=0.0) || (sample_period<0.0) ) {
+       errlogPrintf("VSAM_fft_config: bad card %hd, channels %hd..%hd, n (power of 2, 8..%d) or period\n",
+                    card,first,last,VSAM_FFT_MAX);
+       return(ERROR);
+    }
+
+    epicsMutexMustLock( pcard->lock );
+    unsched = pcard->pfft ? pcard->pfft->mask : 0;
+    epicsMutexUnlock( pcard->lock );
+    mask = VSAM_CHAN_RANGE( first,last );
+    if ( VSAM_sched_claim(card,DATA_TYPE,mask,sample_period,VSAM_SCHED_FFT)!=OK ) return(ERROR);
+    VSAM_sched_claim( card,DATA_TYPE,unsched & ~mask,0.0,VSAM_SCHED_FFT );
+
+    pfft = callocMustSucceed( 1,sizeof(VSAMFFT),"VSAM_fft_config" );
+    pfft->n      = n;
+    pfft->nbins  = n/2+1;
+    pfft->period = period;
+    pfft->mask   = mask;
+    pfft->ring     = callocMustSucceed( n*VSAM_NUM_CHANS,sizeof(float),"VSAM_fft_config" );
+    pfft->stamp    = callocMustSucceed( n,sizeof(epicsTimeStamp),"VSAM_fft_config" );
+    pfft->mag      = callocMustSucceed( pfft->nbins*VSAM_NUM_CHANS,sizeof(float),"VSAM_fft_config" );
+    pfft->work     = callocMustSucceed( n*VSAM_NUM_CHANS,sizeof(float),"VSAM_fft_config" );
+    pfft->work_mag = callocMustSucceed( pfft->nbins*VSAM_NUM_CHANS,sizeof(float),"VSAM_fft_config" );
+    pfft->re       = callocMustSucceed( n/2,sizeof(double),"VSAM_fft_config" );
+    pfft->im       = callocMustSucceed( n/2,sizeof(double),"VSAM_fft_config" );
+    pfft->tw_re    = callocMustSucceed( n/2,sizeof(double),"VSAM_fft_config" );
+    pfft->tw_im    = callocMustSucceed( n/2,sizeof(double),"VSAM_fft_config" );
+    pfft->window   = callocMustSucceed( n,sizeof(double),"VSAM_fft_config" );
+    for (i=0; i<n/2; i++) {
+       pfft->tw_re[i] =  cos( 2.0*M_PI*i/n );
+       pfft->tw_im[i] = -sin( 2.0*M_PI*i/n );
+    }
+    for (i=0,pfft->wsum=0.0; i<n; i++) {
+       pfft->window[i] = 0.5 - 0.5*cos( 2.0*M_PI*i/n );
+       pfft->wsum += pfft->window[i];
+    }
+
+    epicsMutexMustLock( pcard->lock );
+    pold = pcard->pfft;
+    if ( pold ) pfft->ioscan = pold->ioscan;
+    else scanIoInit( &pfft->ioscan );
+    pcard->pfft = pfft;
+    epicsMutexUnlock( pcard->lock );
+
+    if ( pold ) {
+       /* the task may be analyzing it, so it frees it */
+       if ( !fft_lock ) fft_lock = epicsMutexMustCreate();
+       epicsMutexMustLock( fft_lock );
+       pold->pnext = fft_retired;
+       fft_retired = pold;
+       epicsMutexUnlock( fft_lock );
+    }
+
+    for (i=first; i<=last; i++) VSAM_register_use( card,i,DATA_TYPE );
+    if ( !fft_tid ) {
+       fft_tid = epicsThreadCreate( "VSAMfft",
+                                    epicsThreadPriorityLow,
+                                    epicsThreadGetStackSize(epicsThreadStackMedium),
+                                    VSAM_fft_task,
+                                    NULL );
+       if ( !fft_tid ) {
+          errlogPrintf("VSAM_fft_config: cannot start analysis task\n");
+          return(ERROR);
+       }
+    }
+    return(OK);
+}
+
+/*
+ * VSAM_fft_sample - add the data just read to the history
+ *
+ *  Called by VSAM_acquire_mask() with the card locked.
+ */
+void VSAM_fft_sample( VSAM_ID pcard,unsigned long dmask )
+{
+    VSAMFFT  *pfft = pcard->pfft;
+
+    if ( (pcard->snap.status & (FAST_SCAN_MODE|FIRMWARE_REV)) != FAST_SCAN_MODE ) {
+       pfft->filled = 0;
+       return;
+    }
+    if ( (dmask & pfft->mask) != pfft->mask ) return;
+
+    memcpy( &pfft->ring[pfft->head*VSAM_NUM_CHANS],pcard->snap.data,VSAM_NUM_CHANS*sizeof(float) );
+    pfft->stamp[pfft->head] = pcard->snap.stamp;
+    pfft->head = (pfft->head+1) % pfft->n;
+    if ( pfft->filled<pfft->n ) pfft->filled++;
+}
+
+/*
+ * VSAM_fft_task - analyze the cards as they fall due
+ */
+static void VSAM_fft_task( void *parm )
+{
+    VSAM_ID         pcard = NULL;
+    VSAMFFT        *pold,*pfft;
+    epicsTimeStamp  now;
+    double          wait,left;
+    int             due;
+
+    for (;;) {
+       /* nothing is being analyzed here, free the replaced histories */
+       if ( fft_lock ) {
+          epicsMutexMustLock( fft_lock );
+          pold = fft_retired;
+          fft_retired = NULL;
+          epicsMutexUnlock( fft_lock );
+          while ( pold ) {
+             VSAMFFT *pnext = pold->pnext;
+             VSAM_fft_free( pold );
+             pold = pnext;
+          }
+       }
+       wait = FFT_MAX_SLEEP;
+       for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+          if ( !pcard->present ) continue;
+          /* the history can be replaced, look at it under the lock */
+          epicsMutexMustLock( pcard->lock );
+          pfft = pcard->pfft;
+          due  = FALSE;
+          if ( pfft ) {
+             epicsTimeGetCurrent( &now );
+             left = epicsTimeDiffInSeconds( &pfft->due,&now );
+             if ( left<=0.0 ) {
+                due = TRUE;
+                epicsTimeAddSeconds( &now,pfft->period );
+                pfft->due = now;
+             }
+             else if ( left<wait ) wait = left;
+          }
+          epicsMutexUnlock( pcard->lock );
+          if ( due ) VSAM_fft_analyze( pcard );
+       }
+       epicsThreadSleep( wait );
+    }
+}
+
+/*
+ * VSAM_fft_analyze - spectra of all channels of a card
+ */
+static void VSAM_fft_analyze( VSAM_ID pcard )
+{
+    VSAMFFT        *pfft;
+    unsigned long   k,slot,n;
+    float          *pmag;
+    float           a,b,c;
+    double          dt,delta;
+    short           chan;
+
+    /* copy the history out, oldest first, one channel after the other */
+    epicsMutexMustLock( pcard->lock );
+    pfft = pcard->pfft;
+    n    = pfft->n;
+    if ( pfft->filled<n ) {
+       epicsMutexUnlock( pcard->lock );
+       return;
+    }
+    for (k=0; k<n; k++) {
+       slot = (pfft->head+k) % n;
+       for (chan=0; chan<VSAM_NUM_CHANS; chan++)
+          pfft->work[chan*n+k] = pfft->ring[slot*VSAM_NUM_CHANS+chan];
+    }
+    slot = (pfft->head+n-1) % n;
+    dt = epicsTimeDiffInSeconds( &pfft->stamp[slot],&pfft->stamp[pfft->head] )/(n-1);
+    epicsMutexUnlock( pcard->lock );
+    if ( dt<=0.0 ) return;
+
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+       if ( pfft->mask & (1UL<<chan) )
+          VSAM_fft_real( pfft,&pfft->work[chan*n],&pfft->work_mag[chan*pfft->nbins] );
+    }
+
+    epicsMutexMustLock( pcard->lock );
+    memcpy( pfft->mag,pfft->work_mag,pfft->nbins*VSAM_NUM_CHANS*sizeof(float) );
+    pfft->df = 1.0/(n*dt);
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+       if ( !(pfft->mask & (1UL<<chan)) ) continue;
+       pmag = &pfft->mag[chan*pfft->nbins];
+       /* largest bin above DC, refined with a parabola through its neighbours */
+       for (k=2,slot=1; k<pfft->nbins; k++) if ( pmag[k]>pmag[slot] ) slot = k;
+       delta = 0.0;
+       if ( slot<pfft->nbins-1 ) {
+          a = pmag[slot-1];  b = pmag[slot];  c = pmag[slot+1];
+          if ( (a-2*b+c)!=0.0 ) delta = 0.5*(a-c)/(a-2*b+c);
+       }
+       pfft->peak[chan] = (slot+delta)*pfft->df;
+    }
+    pfft->count++;
+    epicsMutexUnlock( pcard->lock );
+    scanIoRequest( pfft->ioscan );
+}
+
+/*
+ * VSAM_fft_free - free a history and its buffers
+ */
+static void VSAM_fft_free( VSAMFFT *pfft )
+{
+    free( pfft->ring );     free( pfft->stamp );
+    free( pfft->mag );      free( pfft->work );    free( pfft->work_mag );
+    free( pfft->re );       free( pfft->im );
+    free( pfft->tw_re );    free( pfft->tw_im );   free( pfft->window );
+    free( pfft );
+}
+
+/*
+ * VSAM_fft_real - amplitude spectrum of n real samples
+ *
+ *  The samples are packed as n/2 complex values, transformed with
+ *  an in-place radix-2 FFT and split into the spectrum of the real
+ *  sequence.  Amplitudes are scaled so a sine of amplitude A
+ *  centred on a bin reads A.
+ */
+static void VSAM_fft_real( VSAMFFT *pfft,const float *px,float *pmag )
+{
+    double  *re = pfft->re;
+    double  *im = pfft->im;
+    double   mean,tr,ti,wr,wi;
+    double   er,ei,odr,odi,xr,xi,scale;
+    unsigned long  n = pfft->n;
+    unsigned long  m = n/2;
+    unsigned long  i,j,k,len,half,step;
+
+    for (i=0,mean=0.0; i<n; i++) mean += px[i];
+    mean /= n;
+    for (i=0; i<m; i++) {
+       re[i] = (px[2*i]   - mean)*pfft->window[2*i];
+       im[i] = (px[2*i+1] - mean)*pfft->window[2*i+1];
+    }
+
+    /* bit reversal */
+    for (i=1,j=0; i<m; i++) {
+       for (k=m>>1; j & k; k>>=1) j ^= k;
+       j |= k;
+       if ( i<j ) {
+          tr = re[i]; re[i] = re[j]; re[j] = tr;
+          ti = im[i]; im[i] = im[j]; im[j] = ti;
+       }
+    }
+    /* butterflies, W_m^x = W_n^2x */
+    for (len=2; len<=m; len<<=1) {
+       half = len>>1;
+       step = 2*(m/len);
+       for (i=0; i<m; i+=len) {
+          for (j=0; j<half; j++) {
+             wr = pfft->tw_re[j*step];
+             wi = pfft->tw_im[j*step];
+             tr = wr*re[i+j+half] - wi*im[i+j+half];
+             ti = wr*im[i+j+half] + wi*re[i+j+half];
+             re[i+j+half] = re[i+j] - tr;
+             im[i+j+half] = im[i+j] - ti;
+             re[i+j] += tr;
+             im[i+j] += ti;
+          }
+       }
+    }
+
+    /* split: X[k] = E[k] + W_n^k O[k] */
+    scale = 2.0/pfft->wsum;
+    for (k=0; k<=m; k++) {
+       i  = k % m;
+       j  = (m-k) % m;
+       er = 0.5*(re[i] + re[j]);
+       ei = 0.5*(im[i] - im[j]);
+       odr = 0.5*(im[i] + im[j]);
+       odi = -0.5*(re[i] - re[j]);
+       if ( k<m ) { wr = pfft->tw_re[k]; wi = pfft->tw_im[k]; }
+       else       { wr = -1.0;           wi = 0.0; }
+       xr = er + wr*odr - wi*odi;
+       xi = ei + wr*odi + wi*odr;
+       pmag[k] = (float)(sqrt(xr*xr + xi*xi)*((k==0 || k==m) ? 0.5*scale : scale));
+    }
+}
+
+/*
+ * VSAM_get_spectrum - copy out the spectrum of a channel, or the
+ *                     bin frequencies if signal is VSAM_NUM_CHANS
+ */
+int VSAM_get_spectrum( short card,short signal,double *pval,unsigned long nmax,unsigned long *pnval )
+{
+    VSAM_ID         pcard = NULL;
+    VSAMFFT        *pfft = NULL;
+    unsigned long   k,nval;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present || !pcard->pfft ) return(ERROR);
+    if ( (signal<0) || (signal>VSAM_NUM_CHANS) ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    pfft = pcard->pfft;
+    nval = pfft->count ? pfft->nbins : 0;
+    if ( nval>nmax ) nval = nmax;
+    for (k=0; k<nval; k++) {
+       if ( signal==VSAM_NUM_CHANS ) pval[k] = k*pfft->df;
+       else pval[k] = pfft->mag[signal*pfft->nbins+k];
+    }
+    epicsMutexUnlock( pcard->lock );
+    *pnval = nval;
+    return(OK);
+}
+
+/*
+ * VSAM_get_peak - dominant frequency of a channel (Hz)
+ */
+int VSAM_get_peak( short card,short chan,double *pval )
+{
+    VSAM_ID  pcard = NULL;
+    int      status = OK;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present || !pcard->pfft ) return(ERROR);
+    if ( (chan<0) || (chan>=VSAM_NUM_CHANS) ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    if ( pcard->pfft->count && (pcard->pfft->mask & (1UL<<chan)) )
+       *pval = pcard->pfft->peak[chan];
+    else status = ERROR;
+    epicsMutexUnlock( pcard->lock );
+    return(status);
+}
+
+/*
+ * VSAM_fft_report - print the spectral analysis of a card
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_fft_report( VSAM_ID pcard )
+{
+    VSAMFFT  *pfft = pcard->pfft;
+    short     chan;
+
+    epicsMutexMustLock( pcard->lock );
+    printf("\tfft: %lu samples of 0x%08lx every %g sec  %lu/%lu in history  %lu spectra  %g Hz/bin\n",
+           pfft->n,pfft->mask,pfft->period,pfft->filled,pfft->n,pfft->count,pfft->df);
+    if ( pfft->count ) {
+       for (chan=0; chan<VSAM_NUM_CHANS; chan++)
+          if ( pfft->mask & (1UL<<chan) ) printf("\t\tch %2hd: peak %g Hz\n",chan,pfft->peak[chan]);
+    }
+    epicsMutexUnlock( pcard->lock );
+}
@@ -0,0 +1,427 @@
+/* drvVSAMFilt.c - Digital filter bank for VSAM channel data
+ *
+ *	Each channel can have an FIR filter of up to VSAM_FIR_TAPS
+ *	taps followed by up to VSAM_FILT_STAGES second order IIR
+ *	sections (biquads), eg. a low-pass and a 60 Hz notch.  The
+ *	coefficients are designed for a sample period, so the filtered
+ *	channels are put on the acquisition schedule at that period
+ *	and the filters run only on the passes of the scheduler; reads
+ *	for records or other callers in between do not step them.
+ *
+ *	Coefficients are given with
+ *	    VSAM_filter_biquad(card,first,last,period,b0,b1,b2,a1,a2)
+ *	    VSAM_filter_fir(card,first,last,period,"h0 h1 h2 ...")
+ *	    VSAM_filter_clear(card,first,last)
+ *	or read from a file with VSAM_filter_load(card,file,period),
+ *	one filter per line:
+ *	    # 2 Hz low-pass at 20 Hz
+ *	    0-7   biquad 0.0675 0.1349 0.0675 -1.1430 0.4128
+ *	    12    fir    0.25 0.25 0.25 0.25
+ *	A biquad line adds a section, a fir line sets the FIR.
+ *
+ *	Once a channel is filtered it stays on the schedule at the
+ *	period of its filter: a different period, from VSAM_sched_set()
+ *	or another feature, is refused until the filter is cleared.
+ *
+ *	The biquad is y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2,
+ *	run in transposed direct form II.
+ *
+ *	Coefficients and state are kept one array per coefficient
+ *	with one element per channel, and channels without a filter
+ *	get unity coefficients, so the kernel is a plain loop over
+ *	all 32 channels that the compiler can vectorize.  A channel
+ *	that was not read on an acquisition is held with a 0/1 gate
+ *	instead of a branch.
+ *
+ *	All filter state is guarded by the card lock.  The filters
+ *	are run by VSAM_acquire_sched() with the lock held.
+ */
+
+#include        <stdlib.h>
+#include        <stdio.h>
+#include        <string.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include	"VSAM.h"           /* VSAMFILT, etc        */
+#include        "epicsExport.h"
+
+#define FILT_LINE_SIZE  512
+
+static VSAMFILT *VSAM_filter_get( VSAM_ID pcard );
+static void      VSAM_filter_unity( VSAMFILT *pfilt,short chan );
+static void      VSAM_filter_count( VSAMFILT *pfilt );
+static int       VSAM_filter_chans( const char *spec,short *pfirst,short *plast );
+static long      VSAM_filter_period( const char *name,VSAM_ID pcard,short first,short last,double period );
+
+/*
+ * VSAM_filter_biquad - add a second order section to channels first..last
+ */
+long VSAM_filter_biquad( short card,short first,short last,double period,
+                         double b0,double b1,double b2,double a1,double a2 )
+{
+    VSAM_ID    pcard = NULL;
+    VSAMFILT  *pfilt = NULL;
+    short      chan;
+    int        s;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || (first<0) || (last>=VSAM_NUM_CHANS) || (first>last) ) {
+       errlogPrintf("VSAM_filter_biquad: bad card %hd or channels %hd..%hd\n",card,first,last);
+       return(ERROR);
+    }
+    if ( period<=0.0 ) {
+       errlogPrintf("VSAM_filter_biquad: filtering needs the period samples are taken at\n");
+       return(ERROR);
+    }
+    pfilt = VSAM_filter_get( pcard );
+
+    epicsMutexMustLock( pcard->lock );
+    for (chan=first; chan<=last; chan++) {
+       if ( pfilt->stages[chan]>=VSAM_FILT_STAGES ) {
+          epicsMutexUnlock( pcard->lock );
+          errlogPrintf("VSAM_filter_biquad: channel %hd has %d sections already\n",chan,pfilt->stages[chan]);
+          return(ERROR);
+       }
+    }
+    epicsMutexUnlock( pcard->lock );
+    if ( VSAM_filter_period("VSAM_filter_biquad",pcard,first,last,period)!=OK ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    for (chan=first; chan<=last; chan++) {
+       s = pfilt->stages[chan];
+       pfilt->b0[s][chan] = b0;
+       pfilt->b1[s][chan] = b1;
+       pfilt->b2[s][chan] = b2;
+       pfilt->a1[s][chan] = a1;
+       pfilt->a2[s][chan] = a2;
+       pfilt->z1[s][chan] = pfilt->z2[s][chan] = 0.0;
+       pfilt->stages[chan]++;
+       pfilt->period[chan] = period;
+       pfilt->mask  |=  (1UL<<chan);
+       pfilt->valid &= ~(1UL<<chan);
+    }
+    VSAM_filter_count( pfilt );
+    epicsMutexUnlock( pcard->lock );
+    return(OK);
+}
+
+/*
+ * VSAM_filter_fir - set the FIR taps of channels first..last
+ *
+ *  taps is a string of coefficients separated by blanks or commas,
+ *  h0 applying to the newest sample.
+ */
+long VSAM_filter_fir( short card,short first,short last,double period,const char *taps )
+{
+    VSAM_ID    pcard = NULL;
+    VSAMFILT  *pfilt = NULL;
+    double     h[VSAM_FIR_TAPS];
+    const char *pc;
+    char       *pend;
+    short      chan;
+    int        t,n = 0;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !taps || (first<0) || (last>=VSAM_NUM_CHANS) || (first>last) ) {
+       errlogPrintf("VSAM_filter_fir: bad card %hd, channels %hd..%hd or taps\n",card,first,last);
+       return(ERROR);
+    }
+    if ( period<=0.0 ) {
+       errlogPrintf("VSAM_filter_fir: filtering needs the period samples are taken at\n");
+       return(ERROR);
+    }
+    for (pc=taps; *pc; pc=pend) {
+       while ( (*pc==' ') || (*pc==',') || (*pc=='\t') ) pc++;
+       if ( !*pc || (*pc=='\n') || (*pc=='#') ) break;
+       if ( n>=VSAM_FIR_TAPS ) {
+          errlogPrintf("VSAM_filter_fir: at most %d taps\n",VSAM_FIR_TAPS);
+          return(ERROR);
+       }
+       h[n] = strtod( pc,&pend );
+       if ( pend==pc ) {
+          errlogPrintf("VSAM_filter_fir: bad tap \"%s\"\n",pc);
+          return(ERROR);
+       }
+       n++;
+    }
+    if ( !n ) {
+       errlogPrintf("VSAM_filter_fir: no taps\n");
+       return(ERROR);
+    }
+    pfilt = VSAM_filter_get( pcard );
+    if ( VSAM_filter_period("VSAM_filter_fir",pcard,first,last,period)!=OK ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    for (chan=first; chan<=last; chan++) {
+       for (t=0; t<VSAM_FIR_TAPS; t++) {
+          pfilt->h[t][chan] = (t<n) ? h[t] : 0.0;
+          pfilt->x[t][chan] = 0.0;
+       }
+       pfilt->taps[chan] = n;
+       pfilt->period[chan] = period;
+       pfilt->mask  |=  (1UL<<chan);
+       pfilt->valid &= ~(1UL<<chan);
+    }
+    VSAM_filter_count( pfilt );
+    epicsMutexUnlock( pcard->lock );
+    return(OK);
+}
+
+/*
+ * VSAM_filter_clear - take the filters off channels first..last,
+ *                     and the channels off the schedule unless
+ *                     something else has them on it
+ */
+long VSAM_filter_clear( short card,short first,short last )
+{
+    VSAM_ID        pcard = NULL;
+    unsigned long  mask;
+    short          chan;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || (first<0) || (last>=VSAM_NUM_CHANS) || (first>last) ) {
+       errlogPrintf("VSAM_filter_clear: bad card %hd or channels %hd..%hd\n",card,first,last);
+       return(ERROR);
+    }
+    if ( !pcard->pfilt ) return(OK);
+
+    epicsMutexMustLock( pcard->lock );
+    mask = pcard->pfilt->mask & VSAM_CHAN_RANGE(first,last);
+    for (chan=first; chan<=last; chan++) {
+       VSAM_filter_unity( pcard->pfilt,chan );
+       pcard->pfilt->period[chan] = 0.0;
+       pcard->pfilt->mask  &= ~(1UL<<chan);
+       pcard->pfilt->valid &= ~(1UL<<chan);
+    }
+    VSAM_filter_count( pcard->pfilt );
+    epicsMutexUnlock( pcard->lock );
+    return( VSAM_sched_claim(card,DATA_TYPE,mask,0.0,VSAM_SCHED_FILT) );
+}
+
+/*
+ * VSAM_filter_load - read filters of a card from a file, all for
+ *                    samples period sec apart
+ *
+ *  The channels named in the file are cleared first, so loading
+ *  a file again replaces its filters.
+ */
+long VSAM_filter_load( short card,const char *file,double period )
+{
+    FILE   *fp = NULL;
+    char    line[FILT_LINE_SIZE];
+    char    kind[16];
+    char    chans[32];
+    double  c[5];
+    short   first,last;
+    int     n,lineno = 0;
+    long    status = OK;
+
+    if ( !file || !(fp=fopen(file,"r")) ) {
+       errlogPrintf("VSAM_filter_load: cannot open %s\n",file ? file : "(null)");
+       return(ERROR);
+    }
+    while ( (status==OK) && fgets(line,sizeof(line),fp) ) {
+       lineno++;
+       if ( sscanf(line,"%31s %15s %n",chans,kind,&n)<2 || (chans[0]=='#') ) continue;
+       if ( VSAM_filter_chans(chans,&first,&last) ) {
+          errlogPrintf("VSAM_filter_load: %s line %d bad channels %s\n",file,lineno,chans);
+          status = ERROR;
+       }
+       else if ( VSAM_filter_clear(card,first,last)!=OK ) status = ERROR;
+    }
+    if ( status!=OK ) {
+       fclose( fp );
+       return(ERROR);
+    }
+    rewind( fp );
+    lineno = 0;
+    while ( (status==OK) && fgets(line,sizeof(line),fp) ) {
+       lineno++;
+       if ( sscanf(line,"%31s %15s %n",chans,kind,&n)<2 || (chans[0]=='#') ) continue;
+       if ( VSAM_filter_chans(chans,&first,&last) ) status = ERROR;
+       else if ( !strcmp(kind,"biquad") ) {
+          if ( sscanf(line+n,"%lf %lf %lf %lf %lf",&c[0],&c[1],&c[2],&c[3],&c[4])!=5 ) status = ERROR;
+          else status = VSAM_filter_biquad( card,first,last,period,c[0],c[1],c[2],c[3],c[4] );
+       }
+       else if ( !strcmp(kind,"fir") ) status = VSAM_filter_fir( card,first,last,period,line+n );
+       else status = ERROR;
+       if ( status!=OK ) errlogPrintf("VSAM_filter_load: %s line %d not understood\n",file,lineno);
+    }
+    fclose( fp );
+    return(status);
+}
+
+/*
+ * VSAM_filter_run - filter the data just read
+ *
+ *  Called by VSAM_acquire_mask() with the card locked; does
+ *  nothing unless the scheduler is acquiring.
+ */
+void VSAM_filter_run( VSAM_ID pcard,unsigned long dmask )
+{
+    VSAMFILT  *pfilt = pcard->pfilt;
+    double     g[VSAM_NUM_CHANS];       /* 1: channel was read */
+    double     v[VSAM_NUM_CHANS];
+    double     y[VSAM_NUM_CHANS];
+    double     z1,z2;
+    int        ch,s,t;
+
+    if ( !pcard->sched_pass ) return;
+    if ( pcard->snap.status & FIRMWARE_REV ) return;
+    if ( !(dmask & pfilt->mask) ) return;
+    for (ch=0; ch<VSAM_NUM_CHANS; ch++) {
+       g[ch] = (dmask>>ch) & 1;
+       v[ch] = pcard->snap.data[ch];
+    }
+
+    /* FIR: shift the delay line of the channels read, then sum */
+    if ( pfilt->ntaps ) {
+       for (t=pfilt->ntaps-1; t>0; t--)
+          for (ch=0; ch<VSAM_NUM_CHANS; ch++)
+             pfilt->x[t][ch] += g[ch]*(pfilt->x[t-1][ch] - pfilt->x[t][ch]);
+       for (ch=0; ch<VSAM_NUM_CHANS; ch++) {
+          pfilt->x[0][ch] += g[ch]*(v[ch] - pfilt->x[0][ch]);
+          y[ch] = 0.0;
+       }
+       for (t=0; t<pfilt->ntaps; t++)
+          for (ch=0; ch<VSAM_NUM_CHANS; ch++)
+             y[ch] += pfilt->h[t][ch]*pfilt->x[t][ch];
+       for (ch=0; ch<VSAM_NUM_CHANS; ch++) v[ch] = y[ch];
+    }
+
+    /* biquads, transposed direct form II */
+    for (s=0; s<pfilt->nstages; s++) {
+       for (ch=0; ch<VSAM_NUM_CHANS; ch++) {
+          y[ch] = pfilt->b0[s][ch]*v[ch] + pfilt->z1[s][ch];
+          z1    = pfilt->b1[s][ch]*v[ch] - pfilt->a1[s][ch]*y[ch] + pfilt->z2[s][ch];
+          z2    = pfilt->b2[s][ch]*v[ch] - pfilt->a2[s][ch]*y[ch];
+          pfilt->z1[s][ch] += g[ch]*(z1 - pfilt->z1[s][ch]);
+          pfilt->z2[s][ch] += g[ch]*(z2 - pfilt->z2[s][ch]);
+          v[ch] = y[ch];
+       }
+    }
+
+    for (ch=0; ch<VSAM_NUM_CHANS; ch++)
+       pfilt->out[ch] += (float)(g[ch]*(v[ch] - pfilt->out[ch]));
+    pfilt->valid |= (dmask & pfilt->mask);
+}
+
+/*
+ * VSAM_filter_report - print the filtered channels of a card
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_filter_report( VSAM_ID pcard )
+{
+    VSAMFILT  *pfilt = pcard->pfilt;
+    short      chan;
+
+    epicsMutexMustLock( pcard->lock );
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+       if ( !(pfilt->mask & (1UL<<chan)) ) continue;
+       printf("\tch %2hd: %d FIR taps  %d biquads  every %g sec  ",
+              chan,pfilt->taps[chan],pfilt->stages[chan],pfilt->period[chan]);
+       if ( pfilt->valid & (1UL<<chan) ) printf("%g\n",pfilt->out[chan]);
+       else printf("no value yet\n");
+    }
+    epicsMutexUnlock( pcard->lock );
+}
+
+/*
+ * VSAM_filter_period - put filtered channels on the schedule
+ */
+static long VSAM_filter_period( const char *name,VSAM_ID pcard,short first,short last,double period )
+{
+    VSAMFILT  *pfilt = pcard->pfilt;
+    short      chan;
+
+    /* the sections of a channel are all designed for one period */
+    epicsMutexMustLock( pcard->lock );
+    for (chan=first; chan<=last; chan++) {
+       if ( (pfilt->mask & (1UL<<chan)) && (pfilt->period[chan]!=period) ) {
+          epicsMutexUnlock( pcard->lock );
+          errlogPrintf("%s: channel %hd is filtered for %g sec, clear it first\n",name,chan,pfilt->period[chan]);
+          return(ERROR);
+       }
+    }
+    epicsMutexUnlock( pcard->lock );
+
+    if ( VSAM_sched_claim(pcard->card,DATA_TYPE,VSAM_CHAN_RANGE(first,last),period,VSAM_SCHED_FILT)!=OK ) {
+       errlogPrintf("%s: cannot schedule channels %hd..%hd\n",name,first,last);
+       return(ERROR);
+    }
+    for (chan=first; chan<=last; chan++) VSAM_register_use( pcard->card,chan,DATA_TYPE );
+    return(OK);
+}
+
+/*
+ * VSAM_filter_get - filter bank of a card, created with unity filters
+ */
+static VSAMFILT *VSAM_filter_get( VSAM_ID pcard )
+{
+    VSAMFILT  *pfilt = NULL;
+    short      chan;
+
+    if ( pcard->pfilt ) return(pcard->pfilt);
+
+    pfilt = callocMustSucceed( 1,sizeof(VSAMFILT),"VSAM_filter_get" );
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++) VSAM_filter_unity( pfilt,chan );
+    epicsMutexMustLock( pcard->lock );
+    pcard->pfilt = pfilt;
+    epicsMutexUnlock( pcard->lock );
+    return(pfilt);
+}
+
+/*
+ * VSAM_filter_unity - make a channel pass through unchanged
+ */
+static void VSAM_filter_unity( VSAMFILT *pfilt,short chan )
+{
+    int  s,t;
+
+    for (s=0; s<VSAM_FILT_STAGES; s++) {
+       pfilt->b0[s][chan] = 1.0;
+       pfilt->b1[s][chan] = pfilt->b2[s][chan] = 0.0;
+       pfilt->a1[s][chan] = pfilt->a2[s][chan] = 0.0;
+       pfilt->z1[s][chan] = pfilt->z2[s][chan] = 0.0;
+    }
+    for (t=0; t<VSAM_FIR_TAPS; t++) {
+       pfilt->h[t][chan] = t ? 0.0 : 1.0;
+       pfilt->x[t][chan] = 0.0;
+    }
+    pfilt->stages[chan] = 0;
+    pfilt->taps[chan]   = 0;
+}
+
+/*
+ * VSAM_filter_count - sections and taps the kernel has to run,
+ *                     the most used by any channel
+ */
+static void VSAM_filter_count( VSAMFILT *pfilt )
+{
+    short  chan;
+
+    pfilt->nstages = pfilt->ntaps = 0;
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+       if ( pfilt->stages[chan]>pfilt->nstages ) pfilt->nstages = pfilt->stages[chan];
+       if ( pfilt->taps[chan]>pfilt->ntaps )     pfilt->ntaps   = pfilt->taps[chan];
+    }
+}
+
+/*
+ * VSAM_filter_chans - parse "n" or "first-last"
+ */
+static int VSAM_filter_chans( const char *spec,short *pfirst,short *plast )
+{
+    int  first,last;
+
+    switch ( sscanf(spec,"%d-%d",&first,&last) ) {
+      case 1:  last = first; break;
+      case 2:  break;
+      default: return(ERROR);
+    }
+    if ( (first<0) || (last>=VSAM_NUM_CHANS) || (first>last) ) return(ERROR);
+    *pfirst = first;
+    *plast  = last;
+    return(OK);
+}
@@ -0,0 +1,697 @@
+/* drvVSAMHistory.c - Compressed in-memory history of VSAM channels
+ *
+ *	VSAM_history_config(card,kbytes) keeps kbytes of history for
+ *	each data channel of a card, at the full acquisition rate but
+ *	compressed, so a board with little memory holds hours of it.
+ *	VSAM_history_set(card,first,last,mode,err) sets how channels
+ *	first..last are compressed, within err of the value read:
+ *
+ *	    "deadband"  a point is stored when the value moves more
+ *	                than err from the last one stored; read back
+ *	                as steps (the default, with err 0)
+ *	    "swing"     swinging door: a point is stored when no
+ *	                straight line from the last one stored passes
+ *	                within err of all samples since; read back by
+ *	                joining the points
+ *
+ *	Points go into a ring of 256 byte blocks per channel, oldest
+ *	overwritten first.  A block holds its first point as is and
+ *	the others as the time since the point before, in usec, and
+ *	the change of value in steps of err/8, both as varints of
+ *	one to five bytes, so a slow channel costs two or three bytes
+ *	a point.  Half a step of rounding is kept out of err.  With
+ *	err 0 values are stored as raw floats.  Decoding runs forward
+ *	through a block with no multiplies but the step.
+ *
+ *	Waveforms read the newest NELM points of a channel, parm Z
+ *	for the values and ZT for the times, in seconds before now:
+ *
+ *	    #C0 S5 @Z      card 0 channel 5 history values
+ *	    #C0 S5 @ZT     card 0 channel 5 history times
+ *
+ *	The latest sample is always given as the last point, stored
+ *	or not.
+ *
+ *	A window of the history is read through one of the
+ *	VSAM_HISTORY_QUERIES queries of a card.  ao records set its
+ *	start and end time, in seconds before now if 0 or less, else
+ *	seconds past the EPICS epoch, and its channel:
+ *
+ *	    #C0 S1 @ZS     card 0 query 1 start
+ *	    #C0 S1 @ZE     card 0 query 1 end
+ *	    #C0 S1 @ZC     card 0 query 1 channel
+ *	    #C0 S1 @ZQ     card 0 query 1 values
+ *	    #C0 S1 @ZQT    card 0 query 1 times, sec from the start
+ *
+ *	db/vsam_history.template loads query 0 of a card.
+ *
+ *	The waveforms give the points stored between start and end,
+ *	led by the last point before the start, moved to the start,
+ *	since the value held there.  The block holding the start is
+ *	found by a binary search on the block end times, and decoding
+ *	stops past the end.  If there are more points than NELM, the
+ *	window is cut into NELM/2 equal bins and the lowest and
+ *	highest point of each bin are given, in time order, so spikes
+ *	are not lost.  The window is resolved, and the points picked,
+ *	when the values are read; the times read after give the same
+ *	points, so process ZQ before ZQT.
+ *
+ *	All history state is guarded by the card lock.
+ *	Samples are taken by VSAM_acquire_mask() with the lock held.
+ */
+
+#include        <stdlib.h>
+#include        <string.h>
+#include        <math.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include        "epicsMath.h"      /* isnan(), isinf()     */
+#include	"VSAM.h"           /* VSAMHISTORY, etc     */
+#include        "epicsExport.h"
+
+#define HISTORY_MAX_USEC   4000000000.0   /* longest delta in one block */
+#define HISTORY_MAX_STEPS  1000000000.0   /* largest value change, steps */
+#define HISTORY_HDR_BYTES  (sizeof(VSAMHISTORYBLK)-VSAM_HISTORY_CODE)
+
+/* position while decoding a block */
+typedef struct HISTCURSOR {
+    const VSAMHISTORYBLK *pb;
+    unsigned long   pos;                   /* next byte of code[]       */
+    unsigned long   n;                     /* points decoded            */
+    epicsTimeStamp  t;                     /* of the current point      */
+    float           v;
+} HISTCURSOR;
+
+/* window being read by a query */
+typedef struct HISTSLICE {
+    epicsTimeStamp  start;
+    epicsTimeStamp  end;
+    double          span;                  /* end - start, sec          */
+    unsigned long   nbin;                  /* 0 to give every point     */
+    double         *pt;                    /* times, sec from the start */
+    double         *pv;
+    unsigned long   nmax;
+    unsigned long   n;                     /* given so far              */
+    long            bin;                   /* being filled, -1 if none  */
+    double          min_t,min_v;
+    double          max_t,max_v;
+} HISTSLICE;
+
+static void VSAM_history_add( VSAMHISTORY *phist,VSAMHISTORYCHAN *pch,const epicsTimeStamp *pt,float v );
+static void VSAM_history_put( VSAMHISTORY *phist,VSAMHISTORYCHAN *pch,const epicsTimeStamp *pt,float v );
+
+/*
+ * history_add_usec - move a time stamp on by usec, in integers so
+ *                    that the encoder and decoder agree exactly
+ */
+static void history_add_usec( epicsTimeStamp *pt,unsigned long usec )
+{
+    pt->secPastEpoch += usec/1000000;
+    pt->nsec         += (usec%1000000)*1000;
+    if ( pt->nsec>=1000000000 ) {
+       pt->nsec -= 1000000000;
+       pt->secPastEpoch++;
+    }
+}
+
+/*
+ * history_varint - seven bits a byte, low first, top bit set if
+ *                  more follow
+ */
+static int history_varint( unsigned char *p,unsigned long val )
+{
+    int  n = 0;
+
+    while ( val>=0x80 ) {
+       p[n++] = (unsigned char)(val | 0x80);
+       val >>= 7;
+    }
+    p[n++] = (unsigned char)val;
+    return(n);
+}
+
+static unsigned long history_unvarint( const unsigned char *p,unsigned long *ppos )
+{
+    unsigned long  val = 0;
+    int            shift = 0;
+
+    do val |= (unsigned long)(p[*ppos] & 0x7f) << shift, shift += 7;
+    while ( p[(*ppos)++] & 0x80 );
+    return(val);
+}
+
+/*
+ * history_first - start decoding a block at its first point
+ */
+static void history_first( HISTCURSOR *pcur,const VSAMHISTORYBLK *pb )
+{
+    pcur->pb  = pb;
+    pcur->pos = 0;
+    pcur->n   = 1;
+    pcur->t   = pb->start;
+    pcur->v   = pb->first;
+}
+
+/*
+ * history_next - decode the next point of the block, FALSE at the end
+ */
+static int history_next( HISTCURSOR *pcur )
+{
+    const VSAMHISTORYBLK *pb = pcur->pb;
+    unsigned long         zz;
+    long                  k;
+
+    if ( pcur->n>=pb->npts ) return(FALSE);
+    history_add_usec( &pcur->t,history_unvarint(pb->code,&pcur->pos) );
+    if ( pb->quant>0.0 ) {
+       zz = history_unvarint( pb->code,&pcur->pos );
+       k  = (zz & 1) ? -(long)((zz+1)>>1) : (long)(zz>>1);
+       pcur->v = (float)(pcur->v + k*(double)pb->quant);
+    }
+    else {
+       memcpy( &pcur->v,pb->code+pcur->pos,sizeof(float) );
+       pcur->pos += sizeof(float);
+    }
+    pcur->n++;
+    return(TRUE);
+}
+
+/*
+ * VSAM_history_config - keep kbytes of history per channel of a card
+ */
+long VSAM_history_config( short card,int kbytes )
+{
+    VSAM_ID          pcard = NULL;
+    VSAMHISTORY     *phist = NULL;
+    VSAMHISTORYCHAN *pch;
+    unsigned long    nblk;
+    short            chan;
+    int              n;
+
+    pcard = VSAM_getByCard( card );
+    nblk  = (kbytes>0) ? (unsigned long)kbytes*1024/sizeof(VSAMHISTORYBLK) : 0;
+    if ( !pcard || (nblk<2) ) {
+       errlogPrintf("VSAM_history_config: bad card %hd or kbytes (at least 1)\n",card);
+       return(ERROR);
+    }
+    if ( pcard->phistory ) {
+       errlogPrintf("VSAM_history_config: card %hd already has history\n",card);
+       return(ERROR);
+    }
+
+    phist = callocMustSucceed( 1,sizeof(VSAMHISTORY),"VSAM_history_config" );
+    phist->nblk = nblk;
+    for (chan=0,pch=phist->chan; chan<VSAM_NUM_CHANS; chan++,pch++) {
+       pch->mode = 'D';
+       pch->blk  = callocMustSucceed( nblk,sizeof(VSAMHISTORYBLK),"VSAM_history_config" );
+    }
+    for (n=0; n<VSAM_HISTORY_QUERIES; n++) phist->query[n].start = -60.0;
+
+    epicsMutexMustLock( pcard->lock );
+    pcard->phistory = phist;
+    epicsMutexUnlock( pcard->lock );
+    return(OK);
+}
+
+/*
+ * VSAM_history_set - compression of channels first..last
+ *
+ *  Points stored so far keep the old setting; the next one starts
+ *  a new block.
+ */
+long VSAM_history_set( short card,short first,short last,const char *mode,double err )
+{
+    VSAM_ID          pcard = NULL;
+    VSAMHISTORYCHAN *pch;
+    char             spec;
+    short            chan;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->phistory ) {
+       errlogPrintf("VSAM_history_set: card %hd has no history, use VSAM_history_config first\n",card);
+       return(ERROR);
+    }
+    spec = (mode) ? mode[0] : 0;
+    if ( (first<0) || (last>=VSAM_NUM_CHANS) || (first>last) ||
+         ((spec!='d') && (spec!='s') && (spec!='D') && (spec!='S')) || (err<0.0) ) {
+       errlogPrintf("VSAM_history_set: bad channels %hd..%hd, mode (deadband or swing) or err\n",first,last);
+       return(ERROR);
+    }
+
+    epicsMutexMustLock( pcard->lock );
+    for (chan=first; chan<=last; chan++) {
+       pch = &pcard->phistory->chan[chan];
+       /* keep the sample not yet stored, under the old setting */
+       if ( pch->held ) VSAM_history_put( pcard->phistory,pch,&pch->h_t,pch->h_v );
+       pch->held  = 0;
+       pch->open  = 0;
+       pch->mode  = (spec=='s' || spec=='S') ? 'S' : 'D';
+       pch->err   = (float)err;
+       pch->quant = (float)(err/8.0);
+       pch->band  = (float)(err - err/16.0);
+    }
+    epicsMutexUnlock( pcard->lock );
+    return(OK);
+}
+
+/*
+ * VSAM_history_sample - add the data just read to the history
+ *
+ *  Called by VSAM_acquire_mask() with the card locked.
+ */
+void VSAM_history_sample( VSAM_ID pcard,unsigned long dmask )
+{
+    VSAMHISTORY  *phist = pcard->phistory;
+    short         chan;
+
+    if ( pcard->snap.status & FIRMWARE_REV ) return;
+    for (chan=0; dmask && (chan<VSAM_NUM_CHANS); chan++) {
+       if ( !(dmask & (1UL<<chan)) ) continue;
+       dmask &= ~(1UL<<chan);
+       VSAM_history_add( phist,&phist->chan[chan],&pcard->snap.stamp,pcard->snap.data[chan] );
+    }
+}
+
+/*
+ * VSAM_history_add - compress one sample of a channel
+ *
+ *  A NaN or infinite sample is skipped: once it is the anchor
+ *  or in the slopes no later sample would get past the test.
+ */
+static void VSAM_history_add( VSAMHISTORY *phist,VSAMHISTORYCHAN *pch,const epicsTimeStamp *pt,float v )
+{
+    double  dt,hdt,lo,hi,s;
+
+    if ( isnan(v) || isinf(v) ) return;
+    pch->nin++;
+    if ( !pch->nout ) {
+       VSAM_history_put( phist,pch,pt,v );
+       return;
+    }
+    dt = epicsTimeDiffInSeconds( pt,&pch->a_t );
+    if ( dt<1e-6 ) return;                 /* not after the last point */
+
+    if ( pch->mode=='D' ) {
+       if ( fabs(v-pch->a_v)>pch->band ) {
+          VSAM_history_put( phist,pch,pt,v );
+          pch->held = 0;
+          return;
+       }
+    }
+    else {
+       lo = (v - pch->band - pch->a_v)/dt;
+       hi = (v + pch->band - pch->a_v)/dt;
+       if ( !pch->held ) {
+          pch->s_lo = lo;
+          pch->s_hi = hi;
+       }
+       else if ( (lo>pch->s_hi) || (hi<pch->s_lo) ) {
+          /* the doors are open: store the held sample where a line
+             through all samples since the last point meets it */
+          hdt = epicsTimeDiffInSeconds( &pch->h_t,&pch->a_t );
+          s   = (pch->h_v - pch->a_v)/hdt;
+          if ( s<pch->s_lo ) s = pch->s_lo;
+          if ( s>pch->s_hi ) s = pch->s_hi;
+          VSAM_history_put( phist,pch,&pch->h_t,(float)(pch->a_v + s*hdt) );
+          dt = epicsTimeDiffInSeconds( pt,&pch->a_t );
+          if ( dt<1e-6 ) {
+             pch->held = 0;
+             return;
+          }
+          pch->s_lo = (v - pch->band - pch->a_v)/dt;
+          pch->s_hi = (v + pch->band - pch->a_v)/dt;
+       }
+       else {
+          if ( lo>pch->s_lo ) pch->s_lo = lo;
+          if ( hi<pch->s_hi ) pch->s_hi = hi;
+       }
+    }
+    pch->held = 1;
+    pch->h_t  = *pt;
+    pch->h_v  = v;
+}
+
+/*
+ * VSAM_history_put - store a point, in a new block if it does not
+ *                    fit or cannot be coded in the open one
+ */
+static void VSAM_history_put( VSAMHISTORY *phist,VSAMHISTORYCHAN *pch,const epicsTimeStamp *pt,float v )
+{
+    VSAMHISTORYBLK  *pb = &pch->blk[pch->cur];
+    unsigned char    buf[12];
+    double           usec,steps;
+    unsigned long    du = 0;
+    long             k = 0;
+    int              n = 0;
+
+    if ( pch->open ) {
+       usec  = floor( epicsTimeDiffInSeconds(pt,&pch->a_t)*1e6 + 0.5 );
+       steps = (pb->quant>0.0) ? floor( (v-pch->a_v)/pb->quant + 0.5 ) : 0.0;
+       if ( (usec>=0.0) && (usec<HISTORY_MAX_USEC) && (fabs(steps)<HISTORY_MAX_STEPS) ) {
+          du = (unsigned long)usec;
+          n  = history_varint( buf,du );
+          if ( pb->quant>0.0 ) {
+             k  = (long)steps;
+             n += history_varint( buf+n,(k<0) ? ((unsigned long)(-k)<<1)-1 : (unsigned long)k<<1 );
+          }
+          else {
+             memcpy( buf+n,&v,sizeof(float) );
+             n += sizeof(float);
+          }
+       }
+       if ( n && (pb->used+n<=VSAM_HISTORY_CODE) && (pb->npts<0xffff) ) {
+          memcpy( pb->code+pb->used,buf,n );
+          pb->used += n;
+          pb->npts++;
+          history_add_usec( &pch->a_t,du );
+          pch->a_v  = (pb->quant>0.0) ? (float)(pch->a_v + k*(double)pb->quant) : v;
+          pb->end   = pch->a_t;
+          pch->nout++;
+          pch->nbytes += n;
+          return;
+       }
+    }
+
+    /* new block, over the oldest once the ring is full */
+    if ( pch->nused ) pch->cur = (pch->cur+1) % phist->nblk;
+    if ( pch->nused<phist->nblk ) pch->nused++;
+    pb = &pch->blk[pch->cur];
+    pb->start = pb->end = *pt;
+    pb->first = v;
+    pb->quant = pch->quant;
+    pb->npts  = 1;
+    pb->used  = 0;
+    pch->open = 1;
+    pch->a_t  = *pt;
+    pch->a_v  = v;
+    pch->nout++;
+    pch->nbytes += HISTORY_HDR_BYTES;
+}
+
+/*
+ * VSAM_get_history - copy out the newest points of a channel,
+ *                    oldest first
+ *
+ *  which is 'T' for the times in seconds before now, otherwise
+ *  the values.  The latest sample is the last point.
+ */
+int VSAM_get_history( short card,short chan,char which,
+                      double *pval,unsigned long nmax,unsigned long *pnval )
+{
+    VSAM_ID          pcard = NULL;
+    VSAMHISTORYCHAN *pch;
+    HISTCURSOR       cur;
+    epicsTimeStamp   now;
+    unsigned long    need,have,skip,b,nb,n = 0;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present || !pcard->phistory ) return(ERROR);
+    if ( (chan<0) || (chan>=VSAM_NUM_CHANS) ) return(ERROR);
+
+    epicsTimeGetCurrent( &now );
+    epicsMutexMustLock( pcard->lock );
+    pch  = &pcard->phistory->chan[chan];
+    nb   = pcard->phistory->nblk;
+    need = (pch->held && nmax) ? nmax-1 : nmax;
+
+    /* back from the newest block until enough points are covered */
+    for (b=0,have=0; (b<pch->nused) && (have<need); b++)
+       have += pch->blk[(pch->cur + nb - b) % nb].npts;
+    skip = (have>need) ? have-need : 0;
+
+    for (; b>0; b--) {
+       history_first( &cur,&pch->blk[(pch->cur + nb - (b-1)) % nb] );
+       do {
+          if ( skip ) {
+             skip--;
+             continue;
+          }
+          pval[n++] = (which=='T') ? epicsTimeDiffInSeconds(&cur.t,&now) : cur.v;
+       } while ( history_next(&cur) );
+    }
+    if ( pch->held && (n<nmax) )
+       pval[n++] = (which=='T') ? epicsTimeDiffInSeconds(&pch->h_t,&now) : pch->h_v;
+    epicsMutexUnlock( pcard->lock );
+    *pnval = n;
+    return(OK);
+}
+
+/*
+ * VSAM_history_query - set the start, end or channel of a query
+ */
+int VSAM_history_query( short card,short query,char field,double val )
+{
+    VSAM_ID            pcard = NULL;
+    VSAMHISTORYQUERY  *pq;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->phistory ) return(ERROR);
+    if ( (query<0) || (query>=VSAM_HISTORY_QUERIES) ) return(ERROR);
+    if ( (field=='C') && ((val<0.0) || (val>=VSAM_NUM_CHANS)) ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    pq = &pcard->phistory->query[query];
+    switch ( field ) {
+       case 'S': pq->start = val;          break;
+       case 'E': pq->end   = val;          break;
+       case 'C': pq->chan  = (short)val;   break;
+    }
+    epicsMutexUnlock( pcard->lock );
+    return( ((field=='S') || (field=='E') || (field=='C')) ? OK : ERROR );
+}
+
+/*
+ * history_query_time - time of a query start or end
+ */
+static void history_query_time( double val,const epicsTimeStamp *pnow,epicsTimeStamp *pt )
+{
+    if ( val<=0.0 ) {
+       *pt = *pnow;
+       epicsTimeAddSeconds( pt,val );
+    }
+    else {
+       pt->secPastEpoch = (epicsUInt32)val;
+       pt->nsec         = (epicsUInt32)((val - floor(val))*1e9);
+    }
+}
+
+/*
+ * history_slice_give - put a point in the waveform buffer
+ */
+static void history_slice_give( HISTSLICE *ps,double t,double v )
+{
+    if ( ps->n>=ps->nmax ) return;
+    ps->pt[ps->n] = t;
+    ps->pv[ps->n] = v;
+    ps->n++;
+}
+
+/*
+ * history_slice_flush - give the lowest and highest point of the bin
+ */
+static void history_slice_flush( HISTSLICE *ps )
+{
+    if ( ps->bin<0 ) return;
+    if ( ps->min_t==ps->max_t ) history_slice_give( ps,ps->min_t,ps->min_v );
+    else if ( ps->min_t<ps->max_t ) {
+       history_slice_give( ps,ps->min_t,ps->min_v );
+       history_slice_give( ps,ps->max_t,ps->max_v );
+    }
+    else {
+       history_slice_give( ps,ps->max_t,ps->max_v );
+       history_slice_give( ps,ps->min_t,ps->min_v );
+    }
+    ps->bin = -1;
+}
+
+/*
+ * history_slice_point - take a point of the window, t sec from the start
+ */
+static void history_slice_point( HISTSLICE *ps,double t,double v )
+{
+    long  bin;
+
+    if ( !ps->nbin ) {
+       history_slice_give( ps,t,v );
+       return;
+    }
+    bin = (long)(t/ps->span*ps->nbin);
+    if ( bin>=(long)ps->nbin ) bin = ps->nbin-1;
+    if ( bin!=ps->bin ) {
+       history_slice_flush( ps );
+       ps->bin   = bin;
+       ps->min_t = ps->max_t = t;
+       ps->min_v = ps->max_v = v;
+    }
+    else if ( v<ps->min_v ) {
+       ps->min_t = t;
+       ps->min_v = v;
+    }
+    else if ( v>ps->max_v ) {
+       ps->max_t = t;
+       ps->max_v = v;
+    }
+}
+
+/*
+ * history_walk - pass the points of a channel between start and end
+ *                to the slice, or just count them if ps is NULL
+ *
+ *  The last point before the start is given first, at the start,
+ *  unless there is a point right at the start.
+ */
+static unsigned long history_walk( VSAMHISTORYCHAN *pch,unsigned long nb,
+                                   const epicsTimeStamp *pstart,const epicsTimeStamp *pend,
+                                   HISTSLICE *ps )
+{
+    HISTCURSOR     cur;
+    unsigned long  lo,hi,mid,oldest,b,n = 0;
+    int            past = 0;
+    int            prev = 0;               /* prev_v not given yet      */
+    float          prev_v = 0.0;
+
+    /* first block, oldest first, that ends at or after the start */
+    oldest = (pch->cur + nb + 1 - pch->nused) % nb;
+    lo = 0;
+    hi = pch->nused;
+    while ( lo<hi ) {
+       mid = (lo+hi)/2;
+       if ( epicsTimeLessThan(&pch->blk[(oldest+mid) % nb].end,pstart) ) lo = mid+1;
+       else hi = mid;
+    }
+
+    /* from the block before, which ends with the last point before the start */
+    for (b=(lo>0) ? lo-1 : 0; (b<pch->nused) && !past; b++) {
+       history_first( &cur,&pch->blk[(oldest+b) % nb] );
+       do {
+          if ( epicsTimeLessThan(&cur.t,pstart) ) {
+             prev   = 1;
+             prev_v = cur.v;
+             continue;
+          }
+          if ( epicsTimeLessThan(pend,&cur.t) ) {
+             past = 1;
+             break;
+          }
+          if ( prev && epicsTimeGreaterThan(&cur.t,pstart) ) {
+             if ( ps ) history_slice_point( ps,0.0,prev_v );
+             n++;
+          }
+          prev = 0;
+          if ( ps ) history_slice_point( ps,epicsTimeDiffInSeconds(&cur.t,pstart),cur.v );
+          n++;
+       } while ( history_next(&cur) );
+    }
+    if ( !past && pch->held && !epicsTimeLessThan(pend,&pch->h_t) ) {
+       if ( epicsTimeLessThan(&pch->h_t,pstart) ) {
+          prev   = 1;
+          prev_v = pch->h_v;
+       }
+       else {
+          if ( prev && epicsTimeGreaterThan(&pch->h_t,pstart) ) {
+             if ( ps ) history_slice_point( ps,0.0,prev_v );
+             n++;
+          }
+          prev = 0;
+          if ( ps ) history_slice_point( ps,epicsTimeDiffInSeconds(&pch->h_t,pstart),pch->h_v );
+          n++;
+       }
+    }
+    /* no point in the window, the one before holds all through it */
+    if ( prev ) {
+       if ( ps ) history_slice_point( ps,0.0,prev_v );
+       n++;
+    }
+    return(n);
+}
+
+/*
+ * VSAM_get_history_query - copy out the window of a query, oldest
+ *                          first, decimated to nmax points
+ *
+ *  which is 'T' for the times in seconds from the start,
+ *  otherwise the values.  Reading the values resolves the window
+ *  and keeps the points picked; the times are those of the same
+ *  points.
+ */
+int VSAM_get_history_query( short card,short query,char which,
+                            double *pval,unsigned long nmax,unsigned long *pnval )
+{
+    VSAM_ID            pcard = NULL;
+    VSAMHISTORY       *phist;
+    VSAMHISTORYCHAN   *pch;
+    VSAMHISTORYQUERY  *pq;
+    HISTSLICE          slice;
+    epicsTimeStamp     now;
+    unsigned long      i,n;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present || !pcard->phistory ) return(ERROR);
+    if ( (query<0) || (query>=VSAM_HISTORY_QUERIES) ) return(ERROR);
+
+    epicsTimeGetCurrent( &now );
+    epicsMutexMustLock( pcard->lock );
+    phist = pcard->phistory;
+    pq    = &phist->query[query];
+    if ( (which!='T') || !pq->valid ) {
+       if ( pq->size<nmax ) {
+          free( pq->t );
+          free( pq->v );
+          pq->t    = callocMustSucceed( nmax,sizeof(double),"VSAM_get_history_query" );
+          pq->v    = callocMustSucceed( nmax,sizeof(double),"VSAM_get_history_query" );
+          pq->size = nmax;
+       }
+       pch = &phist->chan[pq->chan];
+       history_query_time( pq->start,&now,&pq->w_start );
+       history_query_time( pq->end,&now,&pq->w_end );
+       memset( &slice,0,sizeof(slice) );
+       slice.start = pq->w_start;
+       slice.end   = pq->w_end;
+       slice.span  = epicsTimeDiffInSeconds( &slice.end,&slice.start );
+       slice.pt    = pq->t;
+       slice.pv    = pq->v;
+       slice.nmax  = nmax;
+       slice.bin   = -1;
+       if ( slice.span>0.0 ) {
+          n = history_walk( pch,phist->nblk,&slice.start,&slice.end,NULL );
+          slice.nbin = (n<=nmax) ? 0 : (nmax>1) ? nmax/2 : 1;
+          history_walk( pch,phist->nblk,&slice.start,&slice.end,&slice );
+          history_slice_flush( &slice );
+       }
+       pq->n     = slice.n;
+       pq->valid = 1;
+    }
+    n = (pq->n<nmax) ? pq->n : nmax;
+    for (i=0; i<n; i++) pval[i] = (which=='T') ? pq->t[i] : pq->v[i];
+    epicsMutexUnlock( pcard->lock );
+    *pnval = n;
+    return(OK);
+}
+
+/*
+ * VSAM_history_report - print the history kept of each channel
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_history_report( VSAM_ID pcard )
+{
+    VSAMHISTORY     *phist = pcard->phistory;
+    VSAMHISTORYCHAN *pch;
+    VSAMHISTORYBLK  *pold;
+    double           ratio,span;
+    short            chan;
+
+    epicsMutexMustLock( pcard->lock );
+    printf("\thistory: %lu blocks of %u bytes per channel\n",
+           phist->nblk,(unsigned)sizeof(VSAMHISTORYBLK));
+    for (chan=0,pch=phist->chan; chan<VSAM_NUM_CHANS; chan++,pch++) {
+       if ( !pch->nin ) continue;
+       pold  = &pch->blk[(pch->cur + phist->nblk + 1 - pch->nused) % phist->nblk];
+       span  = epicsTimeDiffInSeconds( &pch->blk[pch->cur].end,&pold->start );
+       ratio = pch->nin*(double)(sizeof(float)+sizeof(epicsTimeStamp))/pch->nbytes;
+       printf("\t  chan %2hd %s %g: %lu samples, %lu points, %lu bytes (%.1fx), %.0f sec kept\n",
+              chan,(pch->mode=='S') ? "swing" : "deadband",pch->err,
+              pch->nin,pch->nout,pch->nbytes,ratio,span);
+    }
+    epicsMutexUnlock( pcard->lock );
+}
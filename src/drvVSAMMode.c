@@ -0,0 +1,288 @@
+/* drvVSAMMode.c - Interleaved normal and fast scan of VSAM cards
+ *
+ *	The card gives AC measurements only in normal scan and fast
+ *	data only in fast scan.  VSAM_interleave(card,normal,fast,
+ *	settle) switches a card between the two, normal seconds in
+ *	normal scan and fast seconds in fast scan, so both are had.
+ *	VSAM_interleave(card,0,0,0) leaves the card in normal scan.
+ *
+ *	After each switch the status register is polled until it
+ *	shows the new mode; the time from the write to that is the
+ *	settling time, kept as last, mean and max and traced as the
+ *	"scan settle" phase.  It is polled first in a spin of up to
+ *	MODE_SPIN_READS reads, within MODE_SPIN_USEC on the cycle
+ *	counter, with the card locked, as the status mostly follows
+ *	within that.  The reads are claimed from the bus budget with
+ *	the switch, whether or not they are all made.  If it has not, it
+ *	is polled every clock tick after.  The AC values need settle seconds of
+ *	normal scan on top of that.  At the end of a normal period
+ *	that has had them, the status, range and AC words are read
+ *	into a cache.  ai records of AC and range on the card are
+ *	served from the cache in both modes, so they are never more
+ *	than fast+settle seconds plus one normal period old; data
+ *	is read as usual, fast during fast periods.
+ *
+ *	While interleaving, the scan mode bit is owned by this task;
+ *	a bo record writing it is undone at the next switch.
+ *	Switching is done by one task for all cards, which wakes at
+ *	the next switch, or every clock tick while a card settles
+ *	after the spin.
+ */
+
+#include        <stdlib.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include	"VSAM.h"           /* VSAMMODE, etc        */
+#include        "epicsExport.h"
+
+#define MODE_SETTLE_MAX   1.0       /* sec the status may take to follow */
+#define MODE_IDLE         1.0       /* sec between looks with no cards   */
+#define MODE_SPIN_USEC    200.0     /* usec to spin on the status        */
+#define MODE_SPIN_READS   20        /* most status reads in the spin     */
+
+/* Local variables */
+static int             mode_started = 0;    /* driver init done         */
+static epicsThreadId   mode_tid = NULL;
+static epicsEventId    mode_wake = NULL;
+
+static void VSAM_mode_task( void *parm );
+static void VSAM_mode_switch( VSAM_ID pcard,const epicsTimeStamp *pnow );
+static void VSAM_mode_poll( VSAM_ID pcard,const epicsTimeStamp *pnow );
+static void VSAM_mode_settled( VSAM_ID pcard,double t,unsigned long sval );
+
+/*
+ * VSAM_interleave - alternate a card between normal and fast scan
+ */
+long VSAM_interleave( short card,double normal,double fast,double settle )
+{
+    VSAM_ID     pcard = NULL;
+    VSAMMODE   *pm;
+    int         on;
+
+    pcard = VSAM_getByCard( card );
+    on    = (normal>0.0) || (fast>0.0);
+    if ( !pcard || (on && ((normal<=settle) || (fast<=0.0) || (settle<0.0))) ) {
+       errlogPrintf("VSAM_interleave: bad card %hd, or need normal > settle >= 0 and fast > 0\n",card);
+       return(ERROR);
+    }
+    if ( !on && !pcard->pmode ) return(OK);
+    if ( !pcard->pmode )
+       pcard->pmode = callocMustSucceed( 1,sizeof(VSAMMODE),"VSAM_interleave" );
+
+    epicsMutexMustLock( pcard->lock );
+    pm = pcard->pmode;
+    pm->normal = normal;
+    pm->fast   = fast;
+    pm->settle = settle;
+    if ( on && !pm->on ) {
+       /* start with a normal period, so the cache fills first */
+       pm->valid   = 0;
+       pm->fast_on = 1;
+       pm->settled = 1;
+       epicsTimeGetCurrent( &pm->due );
+    }
+    else if ( !on && pm->on && pm->fast_on ) {
+       /* one last switch back to normal scan */
+       epicsTimeGetCurrent( &pm->due );
+    }
+    pm->on = on;
+    epicsMutexUnlock( pcard->lock );
+
+    if ( mode_started ) return( VSAM_mode_start() );
+    return(OK);
+}
+
+/*
+ * VSAM_mode_start - start the switching task, called at the end
+ *                   of driver init
+ */
+int VSAM_mode_start( void )
+{
+    VSAM_ID  pcard;
+
+    mode_started = 1;
+    if ( mode_tid ) {
+       epicsEventSignal( mode_wake );
+       return(OK);
+    }
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+       if ( pcard->pmode ) break;
+    if ( !pcard ) return(OK);
+
+    mode_wake = epicsEventMustCreate( epicsEventEmpty );
+    mode_tid  = epicsThreadCreate( "VSAMmode",
+                                   epicsThreadPriorityHigh,
+                                   epicsThreadGetStackSize(epicsThreadStackSmall),
+                                   VSAM_mode_task,
+                                   NULL );
+    if ( !mode_tid ) {
+       errlogPrintf("VSAM_mode_start: cannot start scan mode task\n");
+       return(ERROR);
+    }
+    return(OK);
+}
+
+/*
+ * VSAM_mode_task - switch the cards that are due, and poll the
+ *                  ones settling
+ */
+static void VSAM_mode_task( void *parm )
+{
+    VSAM_ID         pcard;
+    VSAMMODE       *pm;
+    epicsTimeStamp  now;
+    double          wait,left;
+
+    for (;;) {
+       wait = MODE_IDLE;
+       for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+          pm = pcard->pmode;
+          if ( !pm || !pcard->present ) continue;
+          epicsTimeGetCurrent( &now );
+          if ( !pm->settled ) VSAM_mode_poll( pcard,&now );
+          if ( (pm->on || pm->fast_on) && !epicsTimeLessThan(&now,&pm->due) )
+             VSAM_mode_switch( pcard,&now );
+          if ( !pm->settled ) left = 0.0;
+          else if ( pm->on ) left = epicsTimeDiffInSeconds( &pm->due,&now );
+          else continue;
+          if ( left<wait ) wait = left;
+       }
+       /* settling cards are polled every clock tick */
+       epicsEventWaitWithTimeout( mode_wake,(wait>0.0) ? wait : epicsThreadSleepQuantum() );
+    }
+}
+
+/*
+ * VSAM_mode_switch - end the period of a card, keeping AC and
+ *                    range if it was a settled normal one
+ */
+static void VSAM_mode_switch( VSAM_ID pcard,const epicsTimeStamp *pnow )
+{
+    VSAMMODE           *pm = pcard->pmode;
+    VSAMMEM            *pVSAM = pcard->pVSAM;
+    VSAMSNAP           *pc = &pm->cache;
+    volatile uint32_t  *ptr;
+    unsigned long       sval,lval;
+    epicsUInt32         start;
+    double              usec;
+    short               i;
+    int                 n;
+
+    /* status, mode write and the spin, range and AC to keep */
+    VSAM_bus_claim( pcard,2 + MODE_SPIN_READS + (pm->fast_on ? 0 : VSAM_NUM_CHANS/4 + VSAM_NUM_CHANS/2) );
+    epicsMutexMustLock( pcard->lock );
+    sval = VSAM_IN32(&pVSAM->status);
+    pcard->stats.csr_reads++;
+
+    if ( !pm->fast_on ) {
+       if ( pm->settled && !(sval & (FAST_SCAN_MODE|FIRMWARE_REV)) &&
+            (epicsTimeDiffInSeconds(pnow,&pm->switched) >= pm->settle_last+pm->settle) ) {
+          epicsTimeGetCurrent( &pc->stamp );
+          pc->status = sval;
+          for (i=0,ptr=(volatile uint32_t *)pVSAM->range; i<VSAM_NUM_CHANS/4; i++,ptr++)
+             pc->range[i] = VSAM_IN32(ptr);
+          for (i=0,ptr=(volatile uint32_t *)pVSAM->ac; i<VSAM_NUM_CHANS/2; i++,ptr++)
+             pc->ac[i] = VSAM_IN32(ptr);
+          pcard->stats.range_reads += VSAM_NUM_CHANS/4;
+          pcard->stats.ac_reads    += VSAM_NUM_CHANS/2;
+          pm->valid = 1;
+       }
+       else pm->misses++;
+    }
+
+    /* as output_VSAM_driver(), the other mode bits from the status */
+    lval = sval & MODE_MASK;
+    if ( pm->on && !pm->fast_on ) lval |= SET_FAST_SCAN;
+    else lval &= ~SET_FAST_SCAN;
+    VSAM_OUT32(&pVSAM->mode_control,lval);
+    start = VSAM_cycles();
+    pcard->stats.mode_writes++;
+    VSAM_trace( pcard->card,VSAM_TRC_SETTLE,lval );
+
+    epicsTimeGetCurrent( &pm->switched );
+    pm->fast_on = (lval & SET_FAST_SCAN) ? 1 : 0;
+    pm->settled = 0;
+    pm->due     = pm->switched;
+    epicsTimeAddSeconds( &pm->due,pm->fast_on ? pm->fast : pm->normal );
+    pm->switches++;
+
+    /* spin on the status for a while, then leave it to the task */
+    n = 0;
+    do {
+       sval = VSAM_IN32(&pVSAM->status);
+       pcard->stats.csr_reads++;
+       usec = VSAM_cycle_usec( start );
+       if ( ((sval & FAST_SCAN_MODE) ? 1 : 0) == pm->fast_on ) {
+          VSAM_mode_settled( pcard,usec*1e-6,sval );
+          break;
+       }
+    } while ( (++n<MODE_SPIN_READS) && (usec<MODE_SPIN_USEC) );
+    epicsMutexUnlock( pcard->lock );
+}
+
+/*
+ * VSAM_mode_poll - see if the status of a card shows the mode
+ *                  written
+ */
+static void VSAM_mode_poll( VSAM_ID pcard,const epicsTimeStamp *pnow )
+{
+    VSAMMODE       *pm = pcard->pmode;
+    unsigned long   sval;
+    double          t;
+
+    VSAM_bus_claim( pcard,1 );
+    epicsMutexMustLock( pcard->lock );
+    sval = VSAM_IN32(&pcard->pVSAM->status);
+    pcard->stats.csr_reads++;
+    t = epicsTimeDiffInSeconds( pnow,&pm->switched );
+    if ( ((sval & FAST_SCAN_MODE) ? 1 : 0) == pm->fast_on ) VSAM_mode_settled( pcard,t,sval );
+    else if ( t>MODE_SETTLE_MAX ) {
+       /* give up on this period, the next switch writes again */
+       pm->settled = 1;
+       pm->timeouts++;
+       VSAM_trace( pcard->card,VSAM_TRC_SETTLE|VSAM_TRC_END,sval );
+    }
+    epicsMutexUnlock( pcard->lock );
+}
+
+/*
+ * VSAM_mode_settled - the status shows the mode written, t sec
+ *                     after the write
+ */
+static void VSAM_mode_settled( VSAM_ID pcard,double t,unsigned long sval )
+{
+    VSAMMODE  *pm = pcard->pmode;
+
+    pm->settled     = 1;
+    pm->settle_last = t;
+    pm->settle_sum += t;
+    pm->settle_count++;
+    if ( t>pm->settle_max ) pm->settle_max = t;
+    VSAM_trace( pcard->card,VSAM_TRC_SETTLE|VSAM_TRC_END,sval );
+}
+
+/*
+ * VSAM_mode_report - print the interleaving of a card
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_mode_report( VSAM_ID pcard )
+{
+    VSAMMODE       *pm = pcard->pmode;
+    epicsTimeStamp  now;
+
+    epicsTimeGetCurrent( &now );
+    epicsMutexMustLock( pcard->lock );
+    printf("\tinterleave %s: normal %g sec, fast %g sec, settle %g sec, now %s scan\n",
+           pm->on ? "on" : "off",pm->normal,pm->fast,pm->settle,pm->fast_on ? "fast" : "normal");
+    printf("\t  %lu switches, status follows in %.6f sec (mean %.6f, max %.6f), %lu timeouts\n",
+           pm->switches,pm->settle_last,
+           pm->settle_count ? pm->settle_sum/pm->settle_count : 0.0,
+           pm->settle_max,pm->timeouts);
+    if ( pm->valid )
+       printf("\t  AC and range %.3f sec old, %lu normal periods missed\n",
+              epicsTimeDiffInSeconds(&now,&pm->cache.stamp),pm->misses);
+    else
+       printf("\t  no AC and range yet, %lu normal periods missed\n",pm->misses);
+    epicsMutexUnlock( pcard->lock );
+}
@@ -0,0 +1,248 @@
+/* drvVSAMRec.c - Binary recorder of VSAM snapshots
+ *
+ *	VSAM_rec_start(file,nrec) appends every snapshot of every
+ *	configured card to file, a circular file of nrec fixed-size
+ *	records that is preallocated and memory mapped.  Call it after
+ *	the cards are configured.  Linux only.
+ *
+ *	The file starts with a VSAMRECHDR (see VSAM.h) giving the
+ *	layout and the ring position: the next record is written at
+ *	index head, and the count newest records, ending just before
+ *	head, are valid.  A record is complete before head and count
+ *	move past it, and the pages belong to the kernel, so the file
+ *	holds everything up to the last record if the IOC crashes.
+ *	Pages are also flushed once a second.  Starting again on a
+ *	file with the same layout carries on where it stopped.
+ *
+ *	Acquisition never waits for the file.  Snapshots are queued in
+ *	memory by the subscription (drvVSAMSub.c) of each card, and a
+ *	low priority task copies them into the file.  If the queue is
+ *	full because the disk is slow, the snapshot is dropped and
+ *	counted.
+ */
+
+#include        <stdlib.h>
+#include        <string.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include	"VSAM.h"           /* VSAMRECHDR, etc      */
+#include        "epicsExport.h"
+
+#ifdef __linux__
+#include        <fcntl.h>
+#include        <unistd.h>
+#include        <sys/mman.h>
+#endif
+
+#define REC_QUEUE_SIZE   1024      /* records, power of two */
+#define REC_SYNC_PERIOD  1.0       /* sec */
+
+#if defined(__GNUC__) && ((__GNUC__>4) || ((__GNUC__==4) && (__GNUC_MINOR__>=1)))
+#define REC_BARRIER()  __sync_synchronize()
+#else
+#define REC_BARRIER()
+#endif
+
+/* Local variables */
+static VSAMRECHDR     *rec_hdr = NULL;     /* the mapped file          */
+static VSAMRECORD     *rec_file = NULL;    /* first record in the file */
+static char           *rec_name = NULL;
+static unsigned long   rec_size = 0;       /* bytes mapped             */
+static VSAMRECORD     *rec_queue = NULL;
+static unsigned long   rec_qhead = 0;      /* queued                   */
+static unsigned long   rec_qtail = 0;      /* written to the file      */
+static unsigned long   rec_qmax = 0;       /* most ever waiting        */
+static unsigned long   rec_dropped = 0;
+static epicsMutexId    rec_lock = NULL;    /* guards the queue         */
+static epicsEventId    rec_wake = NULL;
+
+static void VSAM_rec_queue( void *arg,short card,const VSAMSNAP *psnap,
+                            unsigned long dmask,unsigned long rmask,unsigned long amask );
+static void VSAM_rec_task( void *parm );
+
+/*
+ * VSAM_rec_start - map the file and start recording
+ */
+long VSAM_rec_start( const char *file,int nrec )
+{
+#ifdef __linux__
+    VSAM_ID       pcard;
+    VSAMRECHDR   *phdr;
+    void         *base;
+    int           fd,keep;
+
+    if ( rec_hdr ) {
+       errlogPrintf("VSAM_rec_start: already recording to %s\n",rec_name);
+       return(ERROR);
+    }
+    if ( !file || !file[0] || (nrec<2) ) {
+       errlogPrintf("VSAM_rec_start: need a file and at least 2 records\n");
+       return(ERROR);
+    }
+
+    rec_size = sizeof(VSAMRECHDR) + (unsigned long)nrec*sizeof(VSAMRECORD);
+    fd = open( file,O_CREAT|O_RDWR,0644 );
+    if ( fd<0 ) {
+       errlogPrintf("VSAM_rec_start: can't open %s\n",file);
+       return(ERROR);
+    }
+    /* allocate the blocks now so a full disk can't fault the mapping later */
+    if ( posix_fallocate(fd,0,(off_t)rec_size) ) {
+       errlogPrintf("VSAM_rec_start: can't allocate %lu bytes for %s\n",rec_size,file);
+       close( fd );
+       return(ERROR);
+    }
+    base = mmap( NULL,rec_size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0 );
+    close( fd );
+    if ( base==MAP_FAILED ) {
+       errlogPrintf("VSAM_rec_start: can't map %s\n",file);
+       return(ERROR);
+    }
+
+    phdr = (VSAMRECHDR *)base;
+    keep = (phdr->magic==VSAM_REC_MAGIC) && (phdr->version==VSAM_REC_VERSION) &&
+           (phdr->hdr_size==sizeof(VSAMRECHDR)) && (phdr->rec_size==sizeof(VSAMRECORD)) &&
+           (phdr->nrec==(epicsUInt32)nrec) && (phdr->head<phdr->nrec) && (phdr->count<=phdr->nrec);
+    if ( !keep ) {
+       memset( phdr,0,sizeof(VSAMRECHDR) );
+       phdr->version  = VSAM_REC_VERSION;
+       phdr->hdr_size = sizeof(VSAMRECHDR);
+       phdr->rec_size = sizeof(VSAMRECORD);
+       phdr->nrec     = nrec;
+       REC_BARRIER();
+       phdr->magic    = VSAM_REC_MAGIC;
+    }
+    else printf("VSAM_rec_start: %s has %lu records, appending\n",file,(unsigned long)phdr->count);
+
+    rec_queue = callocMustSucceed( REC_QUEUE_SIZE,sizeof(VSAMRECORD),"VSAM_rec_start" );
+    rec_lock  = epicsMutexMustCreate();
+    rec_wake  = epicsEventMustCreate( epicsEventEmpty );
+    rec_file  = (VSAMRECORD *)((char *)base + sizeof(VSAMRECHDR));
+    rec_name  = epicsStrDup( file );
+    rec_hdr   = phdr;
+
+    if ( !epicsThreadCreate("VSAMrec",
+                            epicsThreadPriorityLow,
+                            epicsThreadGetStackSize(epicsThreadStackSmall),
+                            VSAM_rec_task,
+                            NULL) ) {
+       errlogPrintf("VSAM_rec_start: cannot start recorder task\n");
+       return(ERROR);
+    }
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       if ( VSAM_subscribe(pcard->card,0,VSAM_rec_queue,NULL)==ERROR )
+          errlogPrintf("VSAM_rec_start: card %hd not recorded\n",pcard->card);
+    }
+    return(OK);
+#else
+    errlogPrintf("VSAM_rec_start: recorder not supported here\n");
+    return(ERROR);
+#endif
+}
+
+/*
+ * VSAM_rec_queue - queue a new snapshot for the file
+ *
+ *  Called through the subscription of the card, with the card
+ *  locked.  Only the short copy into the queue is waited for.
+ */
+static void VSAM_rec_queue( void *arg,short card,const VSAMSNAP *psnap,
+                            unsigned long dmask,unsigned long rmask,unsigned long amask )
+{
+    VSAMRECORD     *prec;
+    unsigned long   n;
+    short           i;
+
+    epicsMutexMustLock( rec_lock );
+    n = rec_qhead - rec_qtail;
+    if ( n>=REC_QUEUE_SIZE ) {
+       rec_dropped++;
+       epicsMutexUnlock( rec_lock );
+       return;
+    }
+    prec = &rec_queue[ rec_qhead & (REC_QUEUE_SIZE-1) ];
+    prec->card   = card;
+    prec->flags  = 0;
+    prec->sec    = psnap->stamp.secPastEpoch;
+    prec->nsec   = psnap->stamp.nsec;
+    prec->status = psnap->status;
+    prec->dmask  = dmask;
+    prec->rmask  = rmask;
+    prec->amask  = amask;
+    for (i=0; i<VSAM_NUM_CHANS; i++)   prec->data[i]  = psnap->data[i];
+    for (i=0; i<VSAM_NUM_CHANS/4; i++) prec->range[i] = psnap->range[i];
+    for (i=0; i<VSAM_NUM_CHANS/2; i++) prec->ac[i]    = psnap->ac[i];
+    rec_qhead++;
+    if ( ++n>rec_qmax ) rec_qmax = n;
+    epicsMutexUnlock( rec_lock );
+    epicsEventSignal( rec_wake );
+}
+
+/*
+ * VSAM_rec_task - copy queued records into the file
+ *
+ *  The slots between tail and head belong to this task until the
+ *  tail is moved, so they are copied without the lock.
+ */
+static void VSAM_rec_task( void *parm )
+{
+#ifdef __linux__
+    epicsTimeStamp  last,now;
+    unsigned long   head,tail;
+
+    epicsTimeGetCurrent( &last );
+    for (;;) {
+       epicsEventWaitWithTimeout( rec_wake,REC_SYNC_PERIOD );
+
+       epicsMutexMustLock( rec_lock );
+       head = rec_qhead;
+       tail = rec_qtail;
+       epicsMutexUnlock( rec_lock );
+
+       for (; tail!=head; tail++) {
+          /* when full the oldest record is overwritten, so drop it first */
+          if ( rec_hdr->count==rec_hdr->nrec ) rec_hdr->count--;
+          REC_BARRIER();
+          rec_file[rec_hdr->head] = rec_queue[ tail & (REC_QUEUE_SIZE-1) ];
+          REC_BARRIER();
+          rec_hdr->head = (rec_hdr->head+1) % rec_hdr->nrec;
+          rec_hdr->count++;
+          rec_hdr->total++;
+       }
+
+       epicsMutexMustLock( rec_lock );
+       rec_qtail = tail;
+       rec_hdr->dropped = rec_dropped;
+       epicsMutexUnlock( rec_lock );
+
+       epicsTimeGetCurrent( &now );
+       if ( epicsTimeDiffInSeconds(&now,&last)>=REC_SYNC_PERIOD ) {
+          msync( rec_hdr,rec_size,MS_ASYNC );
+          last = now;
+       }
+    }
+#endif
+}
+
+/*
+ * VSAM_rec_report - print the recorder state
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_rec_report( void )
+{
+    unsigned long  count,nrec,total,dropped,queued,qmax;
+
+    if ( !rec_hdr ) return;
+    /* copy under the lock, print without it */
+    epicsMutexMustLock( rec_lock );
+    count   = rec_hdr->count;
+    nrec    = rec_hdr->nrec;
+    total   = rec_hdr->total;
+    dropped = rec_dropped;
+    queued  = rec_qhead - rec_qtail;
+    qmax    = rec_qmax;
+    epicsMutexUnlock( rec_lock );
+    printf("VSAM recorder %s: %lu of %lu records, %lu written, %lu dropped, queue %lu (most %lu of %d)\n",
+           rec_name,count,nrec,total,dropped,queued,qmax,REC_QUEUE_SIZE);
+}
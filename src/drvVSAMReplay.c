@@ -0,0 +1,286 @@
+/* drvVSAMReplay.c - Replay bus backend for the VSAM driver
+ *
+ *	VSAM_replay(file,speed,loop) makes the driver read a file
+ *	written by the recorder (drvVSAMRec.c) instead of the VME bus,
+ *	so the whole driver and device support can be run against a
+ *	recorded incident on a host with no VME hardware.  Call it
+ *	before any VSAM_config(); the cards configured afterwards get
+ *	card memory in RAM and the addresses are ignored.
+ *
+ *	Playback starts once the cards are initialized at iocInit.
+ *	Records are written into the card memory of the card they
+ *	were recorded from, only the words that were read at the
+ *	time, in real time times speed, or as fast as possible if
+ *	speed is 0.  With loop set the file is played over and over.
+ *	Records of cards that are not configured are skipped.  The
+ *	driver stamps the replayed snapshots with the current time.
+ *
+ *	The card memory acts enough like the card for VSAM_init():
+ *	it reports calibration done until the first record, and
+ *	setting SET_FIRMWARE in the mode control register shows the
+ *	firmware revision in the data words instead of the recording.
+ *	The firmware and scan mode bits of the status always follow
+ *	mode control, whatever the recording had.  Other writes are
+ *	stored and otherwise ignored.
+ */
+
+#include        <stdlib.h>
+#include        <stdio.h>
+#include        <string.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include	"VSAM.h"           /* VSAMBUS, etc         */
+#include        "epicsExport.h"
+
+typedef struct REPLAYCARD {
+    short           card;
+    VSAMMEM        *pmem;
+} REPLAYCARD;
+
+static long        replay_map( const char *name,short card,unsigned long addr,VSAMMEM **ppVSAM );
+static int         replay_probe( volatile void *paddr,epicsUInt32 *pval );
+static epicsUInt32 replay_in32( volatile void *paddr );
+static void        replay_out32( volatile void *paddr,epicsUInt32 val );
+static float       replay_inf( volatile void *paddr );
+static void        VSAM_replay_task( void *parm );
+static void        VSAM_replay_apply( const VSAMRECORD *prec );
+static epicsUInt32 replay_status( VSAMMEM *pmem,epicsUInt32 status );
+
+static VSAMBUS replay_bus = { "replay",replay_map,replay_probe,replay_in32,replay_out32,replay_inf };
+
+/* Local variables */
+static REPLAYCARD      rp_card[VSAM_MAX_CARDS];
+static int             rp_ncards = 0;
+static FILE           *rp_fp = NULL;
+static char           *rp_name = NULL;
+static VSAMRECHDR      rp_hdr;
+static double          rp_speed = 1.0;
+static int             rp_loop = 0;
+static int             rp_running = 0;
+static unsigned long   rp_count = 0;        /* records applied          */
+static unsigned long   rp_skipped = 0;      /* of cards not configured  */
+static unsigned long   rp_passes = 0;       /* over the whole file      */
+static double          rp_lag_max = 0.0;    /* sec behind the recording */
+static epicsTimeStamp  rp_start;
+
+/*
+ * VSAM_replay - read the cards from a recording
+ */
+long VSAM_replay( const char *file,double speed,int loop )
+{
+    FILE  *fp;
+
+    if ( rp_fp ) {
+       errlogPrintf("VSAM_replay: already replaying %s\n",rp_name);
+       return(ERROR);
+    }
+    if ( !file || !file[0] || (speed<0.0) ) {
+       errlogPrintf("VSAM_replay: need a file and speed >= 0\n");
+       return(ERROR);
+    }
+    fp = fopen( file,"rb" );
+    if ( !fp ) {
+       errlogPrintf("VSAM_replay: can't open %s\n",file);
+       return(ERROR);
+    }
+    if ( (fread(&rp_hdr,sizeof(rp_hdr),1,fp)!=1) ||
+         (rp_hdr.magic!=VSAM_REC_MAGIC) || (rp_hdr.version!=VSAM_REC_VERSION) ||
+         (rp_hdr.rec_size!=sizeof(VSAMRECORD)) || (rp_hdr.head>=rp_hdr.nrec) ||
+         (rp_hdr.count>rp_hdr.nrec) ) {
+       errlogPrintf("VSAM_replay: %s is not a VSAM recording of layout %d\n",file,VSAM_REC_VERSION);
+       fclose( fp );
+       return(ERROR);
+    }
+    if ( !rp_hdr.count ) {
+       errlogPrintf("VSAM_replay: %s has no records\n",file);
+       fclose( fp );
+       return(ERROR);
+    }
+    if ( VSAM_bus_set(&replay_bus) ) {
+       fclose( fp );
+       return(ERROR);
+    }
+    rp_fp    = fp;
+    rp_name  = epicsStrDup( file );
+    rp_speed = speed;
+    rp_loop  = loop;
+    return(OK);
+}
+
+/*
+ * VSAM_replay_start - start playback, called at the end of
+ *                     driver init
+ */
+int VSAM_replay_start( void )
+{
+    if ( !rp_fp || rp_running ) return(OK);
+    rp_running = 1;
+    if ( !epicsThreadCreate("VSAMreplay",
+                            epicsThreadPriorityMedium,
+                            epicsThreadGetStackSize(epicsThreadStackSmall),
+                            VSAM_replay_task,
+                            NULL) ) {
+       errlogPrintf("VSAM_replay_start: cannot start replay task\n");
+       rp_running = 0;
+       return(ERROR);
+    }
+    return(OK);
+}
+
+/*
+ * VSAM_replay_task - play the records, oldest first
+ */
+static void VSAM_replay_task( void *parm )
+{
+    VSAMRECORD      rec;
+    epicsTimeStamp  stamp,first,wall,now;
+    unsigned long   n,idx;
+    double          due,elapsed;
+
+    do {
+       idx = (rp_hdr.head + rp_hdr.nrec - rp_hdr.count) % rp_hdr.nrec;
+       fseek( rp_fp,(long)(rp_hdr.hdr_size + idx*rp_hdr.rec_size),SEEK_SET );
+       epicsTimeGetCurrent( &wall );
+       if ( !rp_passes ) rp_start = wall;
+
+       for (n=0; n<rp_hdr.count; n++) {
+          if ( fread(&rec,sizeof(rec),1,rp_fp)!=1 ) {
+             errlogPrintf("VSAM_replay_task: read of %s failed at record %lu\n",rp_name,idx);
+             rp_running = 0;
+             return;
+          }
+          stamp.secPastEpoch = rec.sec;
+          stamp.nsec         = rec.nsec;
+          if ( !n ) first = stamp;
+
+          if ( rp_speed>0.0 ) {
+             due = epicsTimeDiffInSeconds( &stamp,&first )/rp_speed;
+             epicsTimeGetCurrent( &now );
+             elapsed = epicsTimeDiffInSeconds( &now,&wall );
+             if ( due>elapsed ) epicsThreadSleep( due-elapsed );
+             else if ( elapsed-due>rp_lag_max ) rp_lag_max = elapsed-due;
+          }
+          VSAM_replay_apply( &rec );
+
+          if ( ++idx>=rp_hdr.nrec ) {
+             idx = 0;
+             fseek( rp_fp,(long)rp_hdr.hdr_size,SEEK_SET );
+          }
+       }
+       rp_passes++;
+    } while ( rp_loop );
+    rp_running = 0;
+}
+
+/*
+ * VSAM_replay_apply - write one record into the memory of its card
+ */
+static void VSAM_replay_apply( const VSAMRECORD *prec )
+{
+    VSAMMEM  *pmem = NULL;
+    int       i;
+
+    for (i=0; i<rp_ncards; i++) {
+       if ( rp_card[i].card==(short)prec->card ) pmem = rp_card[i].pmem;
+    }
+    if ( !pmem ) {
+       rp_skipped++;
+       return;
+    }
+    if ( !(pmem->mode_control & SET_FIRMWARE) ) {
+       for (i=0; i<VSAM_NUM_CHANS; i++)
+          if ( prec->dmask & (1UL<<i) ) pmem->data[i] = prec->data[i];
+    }
+    for (i=0; i<VSAM_NUM_CHANS/4; i++)
+       if ( prec->rmask & (0xfUL<<(i*4)) ) ((volatile epicsUInt32 *)pmem->range)[i] = prec->range[i];
+    for (i=0; i<VSAM_NUM_CHANS/2; i++)
+       if ( prec->amask & (0x3UL<<(i*2)) ) ((volatile epicsUInt32 *)pmem->ac)[i] = prec->ac[i];
+    pmem->status = replay_status( pmem,prec->status );
+    rp_count++;
+}
+
+/*
+ * replay_status - a status word with the firmware and scan mode
+ *                 bits of the mode last written
+ */
+static epicsUInt32 replay_status( VSAMMEM *pmem,epicsUInt32 status )
+{
+    epicsUInt32  mc = pmem->mode_control;
+
+    status &= ~(FIRMWARE_REV | FAST_SCAN_MODE);
+    if ( mc & SET_FIRMWARE )  status |= FIRMWARE_REV;
+    if ( mc & SET_FAST_SCAN ) status |= FAST_SCAN_MODE;
+    return(status);
+}
+
+/* Replay backend: card memory in RAM, in the byte order of the host */
+
+static long replay_map( const char *name,short card,unsigned long addr,VSAMMEM **ppVSAM )
+{
+    VSAMMEM  *pmem;
+
+    if ( rp_ncards>=VSAM_MAX_CARDS ) return(ERROR);
+    pmem = (VSAMMEM *)callocMustSucceed( 1,sizeof(VSAMMEM),"replay_map" );
+    pmem->status = CALIB_SUCCESS;
+    rp_card[rp_ncards].card = card;
+    rp_card[rp_ncards].pmem = pmem;
+    rp_ncards++;
+    *ppVSAM = pmem;
+    return(OK);
+}
+
+static int replay_probe( volatile void *paddr,epicsUInt32 *pval )
+{
+    *pval = *(volatile epicsUInt32 *)paddr;
+    return(OK);
+}
+
+static epicsUInt32 replay_in32( volatile void *paddr )
+{
+    return( *(volatile epicsUInt32 *)paddr );
+}
+
+/* a write to the mode control register switches firmware revision and
+   the scan mode on or off */
+static void replay_out32( volatile void *paddr,epicsUInt32 val )
+{
+    VSAMMEM  *pmem;
+    int       i,chan;
+
+    *(volatile epicsUInt32 *)paddr = val;
+    for (i=0; i<rp_ncards; i++) {
+       pmem = rp_card[i].pmem;
+       if ( paddr!=(volatile void *)&pmem->mode_control ) continue;
+       pmem->status = replay_status( pmem,pmem->status );
+       if ( val & SET_FIRMWARE ) {
+          /* read back with VSAM_IN32, as an integer */
+          for (chan=0; chan<VSAM_NUM_CHANS; chan++)
+             ((volatile epicsUInt32 *)pmem->data)[chan] = VSAM_HARDWARE_REV;
+       }
+    }
+}
+
+static float replay_inf( volatile void *paddr )
+{
+    return( *(volatile float *)paddr );
+}
+
+/*
+ * VSAM_replay_report - print the playback state
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_replay_report( void )
+{
+    epicsTimeStamp  now;
+    double          t;
+
+    if ( !rp_fp ) return;
+    printf("VSAM replay of %s: %lu records, speed %g%s, %s\n",
+           rp_name,(unsigned long)rp_hdr.count,rp_speed,rp_loop ? ", looping" : "",
+           rp_running ? "playing" : "stopped");
+    epicsTimeGetCurrent( &now );
+    t = rp_count ? epicsTimeDiffInSeconds( &now,&rp_start ) : 0.0;
+    printf("\t%lu records applied (%.0f/sec), %lu skipped, %lu passes, up to %.6f sec late\n",
+           rp_count,(t>0.0) ? rp_count/t : 0.0,rp_skipped,rp_passes,rp_lag_max);
+}
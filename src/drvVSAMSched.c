@@ -0,0 +1,391 @@
+/* drvVSAMSched.c - Multi-rate acquisition scheduler for the VSAM driver
+ *
+ *	Each channel and data type of a card can be given its own
+ *	acquisition period with VSAM_sched_set(), eg. vacuum data
+ *	at 20 Hz, range bytes at 0.1 Hz and AC at 1 Hz.  On every
+ *	pass over a card all the words that are due are read in one
+ *	VSAM_acquire_mask() call, and I/O Intr is posted for the
+ *	channels read.
+ *
+ *	Comparators, averaging, filters, the FFT and capture put
+ *	their channels on the schedule with VSAM_sched_claim().  Each
+ *	keeps its own period, and a channel is only ever read at one:
+ *	a period that differs from one already asked for is refused.
+ *
+ *	Passes are made by a pool of worker tasks, configured with
+ *	VSAM_pool_config() before iocInit.  Cards are dealt out to
+ *	the workers in turn.  A worker serves its own cards first;
+ *	when it has nothing due it takes a due card whose owner is
+ *	busy reading another card, so one slow card does not hold
+ *	up the others.  By default there is one worker per card.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE                /* for CPU affinity */
+#endif
+
+#include        <math.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include        "dbScan.h"         /* scanIoRequest()      */
+#include	"VSAM.h"           /* VSAMSCHED, etc       */
+#include        "epicsExport.h"
+
+#ifdef __linux__
+#include        <pthread.h>        /* pthread_setaffinity_np() */
+#include        <sched.h>
+#endif
+
+#define SCHED_MAX_SLEEP   1.0      /* sec, longest idle wait */
+#define SCHED_SAME        1e-9     /* periods closer than this part agree */
+#define POOL_MAX_WORKERS  16
+
+typedef struct VSAMWORKER {
+    int             id;
+    epicsThreadId   tid;
+    epicsEventId    wake;
+    int             busy;          /* reading one of the cards */
+    unsigned long   passes;
+    unsigned long   steals;
+} VSAMWORKER;
+
+/* Local variables */
+static epicsMutexId    pool_lock = NULL;
+static int             pool_size = 0;       /* 0 = one per card */
+static int             pool_prio = epicsThreadPriorityHigh;
+static unsigned long   pool_cpus = 0;       /* 0 = any cpu      */
+static int             pool_running = 0;
+static int             pool_next_owner = 0;
+static epicsTimeStamp  pool_start;
+static VSAMWORKER      pool_worker[POOL_MAX_WORKERS];
+static const char     *sched_user_c[VSAM_SCHED_USERS] = 
+   { "VSAM_sched_set","comparators","averaging","filters","FFT","capture" };
+
+static double VSAM_sched_pass( VSAM_ID pcard,double t );
+static void   VSAM_pool_task( void *parm );
+static void   VSAM_pool_wake( void );
+
+/*
+ * VSAM_sched_set - set the acquisition period of channels first..last
+ *                  of one data type ("D", "R" or "A").  A period of
+ *                  zero takes the channels off the schedule, unless
+ *                  a feature still has them on it.
+ *
+ *  Can be called before iocInit, or at run time.
+ */
+long VSAM_sched_set( short card,const char *type,short first,short last,double period )
+{
+    if ( !type || (first<0) || (last>=VSAM_NUM_CHANS) || (first>last) ) {
+       errlogPrintf("VSAM_sched_set: bad card %hd, type or channels %hd..%hd\n",card,first,last);
+       return(ERROR);
+    }
+    return( VSAM_sched_claim(card,type[0],VSAM_CHAN_RANGE(first,last),period,VSAM_SCHED_SET) );
+}
+
+/*
+ * VSAM_sched_claim - ask for the channels in mask to be read every
+ *                    period sec on behalf of user (VSAM_SCHED_xxx),
+ *                    or with period zero drop the request
+ *
+ *  The period each user asked for is kept.  A channel another user
+ *  has on the schedule at a different period is refused, and then
+ *  none of the channels is changed: filters, the FFT and capture
+ *  are only right at the period they were set up for.
+ */
+long VSAM_sched_claim( short card,char type,unsigned long mask,double period,int user )
+{
+    short       chan;
+    int         idx,u;
+    double      want;
+    VSAMSCHED  *psched;
+    VSAM_ID     pcard;
+
+    pcard = VSAM_getByCard( card );
+    idx   = VSAM_type_index( type );
+    if ( !pcard || (idx<0) || (user<0) || (user>=VSAM_SCHED_USERS) || (period<0.0) ) {
+       errlogPrintf("VSAM_sched_set: bad card %hd, type or period\n",card);
+       return(ERROR);
+    }
+    if ( (period<=0.0) && !pcard->psched ) return(OK);
+    if ( !pool_lock ) pool_lock = epicsMutexMustCreate();
+
+    epicsMutexMustLock( pool_lock );
+    if ( !pcard->psched ) {
+       psched = callocMustSucceed( 1,sizeof(VSAMSCHED),"VSAM_sched_set" );
+       psched->owner = pool_size ? (pool_next_owner++ % pool_size) : -1;
+       pcard->psched = psched;
+    }
+    psched = pcard->psched;
+    psched->next = 0.0;
+    epicsMutexUnlock( pool_lock );
+
+    epicsMutexMustLock( pcard->lock );
+    for (chan=0; (chan<VSAM_NUM_CHANS) && (period>0.0); chan++) {
+       if ( !(mask & (1UL<<chan)) ) continue;
+       for (u=0; u<VSAM_SCHED_USERS; u++) {
+          want = psched->want[u][idx][chan];
+          if ( (u==user) || (want<=0.0) || (fabs(want-period)<=SCHED_SAME*period) ) continue;
+          epicsMutexUnlock( pcard->lock );
+          errlogPrintf("VSAM_sched_claim: card %hd ch %hd %c is read every %g sec for %s, %s wants %g\n",
+                       card,chan,type,want,sched_user_c[u],sched_user_c[user],period);
+          return(ERROR);
+       }
+    }
+    for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+       if ( !(mask & (1UL<<chan)) ) continue;
+       psched->want[user][idx][chan] = period;
+       /* all the users agree, so any of them gives the period */
+       for (u=0,want=0.0; u<VSAM_SCHED_USERS; u++) 
+          if ( psched->want[u][idx][chan]>0.0 ) want = psched->want[u][idx][chan];
+       if ( want!=psched->period[idx][chan] ) psched->due[idx][chan] = 0.0;
+       psched->period[idx][chan] = want;
+       if ( want>0.0 ) psched->mask[idx] |=  (1UL<<chan);
+       else            psched->mask[idx] &= ~(1UL<<chan);
+    }
+    epicsMutexUnlock( pcard->lock );
+
+    /* after driver init the pool is started here, before by init() */
+    if ( pcard->present && !pool_running ) VSAM_pool_start();
+    else if ( pool_running ) VSAM_pool_wake();
+    return(OK);
+}
+
+/*
+ * VSAM_pool_config - set the number of acquisition workers, their
+ *                    EPICS priority and the CPUs they may run on
+ *                    (bit n for cpu n, 0 for any).  Call before iocInit.
+ *                    CPU affinity is only applied on Linux.
+ */
+long VSAM_pool_config( int nworkers,int priority,unsigned long cpumask )
+{
+    if ( pool_running ) {
+       errlogPrintf("VSAM_pool_config: workers already started\n");
+       return(ERROR);
+    }
+    if ( (nworkers<0) || (nworkers>POOL_MAX_WORKERS) ||
+         (priority<epicsThreadPriorityMin) || (priority>epicsThreadPriorityMax) ) {
+       errlogPrintf("VSAM_pool_config: need 0..%d workers and priority %d..%d\n",
+                    POOL_MAX_WORKERS,epicsThreadPriorityMin,epicsThreadPriorityMax);
+       return(ERROR);
+    }
+#ifndef __linux__
+    if ( cpumask ) 
+       errlogPrintf("VSAM_pool_config: CPU affinity not supported here, ignored\n");
+#endif
+    pool_size = nworkers;
+    pool_prio = priority ? priority : epicsThreadPriorityHigh;
+    pool_cpus = cpumask;
+    return(OK);
+}
+
+/*
+ * VSAM_pool_start - deal the scheduled cards out to the workers
+ *                   and start them
+ */
+int VSAM_pool_start( void )
+{
+    int        i,n = 0;
+    char       name_c[16];
+    VSAM_ID    pcard;
+
+    if ( pool_running ) return(OK);
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) 
+       if ( pcard->psched && pcard->present ) n++;
+    if ( !n ) return(OK);
+    if ( !pool_lock ) pool_lock = epicsMutexMustCreate();
+
+    epicsMutexMustLock( pool_lock );
+    if ( !pool_size ) pool_size = (n<POOL_MAX_WORKERS) ? n : POOL_MAX_WORKERS;
+    pool_next_owner = 0;
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       if ( pcard->psched ) pcard->psched->owner = pool_next_owner++ % pool_size;
+    }
+    /* the events exist before anyone sees pool_running and wakes them */
+    for (i=0; i<pool_size; i++) {
+       pool_worker[i].id   = i;
+       pool_worker[i].wake = epicsEventMustCreate( epicsEventEmpty );
+    }
+    epicsTimeGetCurrent( &pool_start );
+    pool_running = 1;
+    epicsMutexUnlock( pool_lock );
+
+    for (i=0; i<pool_size; i++) {
+       sprintf( name_c,"VSAMacq%d",i );
+       pool_worker[i].tid = epicsThreadMustCreate( name_c,
+                                                   pool_prio,
+                                                   epicsThreadGetStackSize(epicsThreadStackMedium),
+                                                   VSAM_pool_task,
+                                                   &pool_worker[i] );
+    }
+    return(OK);
+}
+
+static void VSAM_pool_wake( void )
+{
+    int  i;
+
+    for (i=0; i<pool_size; i++) epicsEventSignal( pool_worker[i].wake );
+}
+
+static void VSAM_pool_task( void *parm )
+{
+    VSAMWORKER     *pw = (VSAMWORKER *)parm;
+    VSAMSCHED      *psched;
+    VSAM_ID         pcard,pick,steal;
+    epicsTimeStamp  now;
+    double          t,wait,next;
+#ifdef __linux__
+    cpu_set_t       cpus;
+    int             cpu;
+
+    if ( pool_cpus ) {
+       CPU_ZERO( &cpus );
+       for (cpu=0; cpu<(int)(8*sizeof(pool_cpus)); cpu++) 
+          if ( pool_cpus & (1UL<<cpu) ) CPU_SET( cpu,&cpus );
+       if ( pthread_setaffinity_np(pthread_self(),sizeof(cpus),&cpus) )
+          errlogPrintf("VSAM_pool_task: can't set CPU affinity 0x%lx\n",pool_cpus);
+    }
+#endif
+
+    for (;;) {
+       epicsMutexMustLock( pool_lock );
+       epicsTimeGetCurrent( &now );
+       t     = epicsTimeDiffInSeconds( &now,&pool_start );
+       wait  = SCHED_MAX_SLEEP;
+       pick  = steal = NULL;
+       for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+          psched = pcard->psched;
+          if ( !psched || !pcard->present || psched->busy ) continue;
+          if ( psched->next>t ) {
+             if ( psched->next-t<wait ) wait = psched->next-t;
+          }
+          else if ( psched->owner==pw->id ) {
+             pick = pcard;
+             break;
+          }
+          else if ( !steal && pool_worker[psched->owner].busy ) {
+             steal = pcard;
+          }
+       }
+       if ( !pick && steal ) {
+          pick = steal;
+          pick->psched->stolen++;
+          pw->steals++;
+       }
+       if ( pick ) {
+          pick->psched->busy = 1;
+          pw->busy = 1;
+       }
+       epicsMutexUnlock( pool_lock );
+
+       if ( !pick ) {
+          epicsEventWaitWithTimeout( pw->wake,wait );
+          continue;
+       }
+
+       next = VSAM_sched_pass( pick,t );
+       pw->passes++;
+
+       epicsMutexMustLock( pool_lock );
+       pick->psched->next = next;
+       pick->psched->busy = 0;
+       pw->busy = 0;
+       epicsMutexUnlock( pool_lock );
+    }
+}
+
+/*
+ * VSAM_sched_pass - read what is due on one card at time t (sec from
+ *                   pool start) and return when the card is next due
+ */
+static double VSAM_sched_pass( VSAM_ID pcard,double t )
+{
+    VSAMSCHED      *psched = pcard->psched;
+    double          next,period;
+    unsigned long   mask[VSAM_NUM_IDX];
+    short           chan;
+    int             idx;
+
+    next = t + SCHED_MAX_SLEEP;
+
+    /* collect everything that is due */
+    epicsMutexMustLock( pcard->lock );
+    for (idx=0; idx<VSAM_NUM_IDX; idx++) {
+       mask[idx] = 0;
+       for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+          period = psched->period[idx][chan];
+          if ( period<=0.0 ) continue;
+          if ( psched->due[idx][chan]<=t ) {
+             mask[idx] |= (1UL<<chan);
+             psched->due[idx][chan] += period;
+             /* fell more than a period behind, don't try to catch up */
+             if ( psched->due[idx][chan]<=t ) {
+                psched->due[idx][chan] = t + period;
+                psched->late++;
+             }
+          }
+          if ( psched->due[idx][chan]<next ) next = psched->due[idx][chan];
+       }
+    }
+    epicsMutexUnlock( pcard->lock );
+
+    if ( mask[VSAM_IDX_DATA] || mask[VSAM_IDX_RANGE] || mask[VSAM_IDX_AC] ) {
+       /* AC values are scaled by the range of their channel */
+       if ( VSAM_acquire_sched( pcard,
+                                mask[VSAM_IDX_DATA],
+                                mask[VSAM_IDX_RANGE] | mask[VSAM_IDX_AC],
+                                mask[VSAM_IDX_AC] )==OK ) {
+          psched->passes++;
+          for (idx=0; idx<VSAM_NUM_IDX; idx++) {
+             for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+                if ( mask[idx] & (1UL<<chan) ) scanIoRequest( pcard->ioscan[idx][chan] );
+             }
+          }
+       }
+    }
+    if ( pcard->ptrend ) VSAM_trend_tick( pcard );
+    return(next);
+}
+
+/*
+ * VSAM_pool_report - print the acquisition workers
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_pool_report( void )
+{
+    int  i;
+
+    if ( !pool_running ) {
+       printf("VSAM acquisition workers: not running\n");
+       return;
+    }
+    printf("VSAM acquisition workers: %d at priority %d, cpus 0x%lx\n",pool_size,pool_prio,pool_cpus);
+    for (i=0; i<pool_size; i++) 
+       printf("\tworker %d: %lu passes  %lu stolen\n",i,pool_worker[i].passes,pool_worker[i].steals);
+}
+
+/*
+ * VSAM_sched_report - print the schedule of a card
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_sched_report( VSAM_ID pcard )
+{
+    VSAMSCHED   *psched = pcard->psched;
+    short        chan;
+    int          idx,u;
+    static const char type_c[VSAM_NUM_IDX] = { DATA_TYPE,RANGE_TYPE,AC_TYPE };
+
+    printf("\tscheduler: worker %d  %lu passes  %lu by other workers  %lu late\n",
+           psched->owner,psched->passes,psched->stolen,psched->late);
+    for (idx=0; idx<VSAM_NUM_IDX; idx++) {
+       for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+          if ( psched->period[idx][chan]<=0.0 ) continue;
+          printf("\t\tch %2hd %c every %g sec, for",chan,type_c[idx],psched->period[idx][chan]);
+          for (u=0; u<VSAM_SCHED_USERS; u++) 
+             if ( psched->want[u][idx][chan]>0.0 ) printf(" %s",sched_user_c[u]);
+          printf("\n");
+       }
+    }
+}
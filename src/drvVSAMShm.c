@@ -0,0 +1,184 @@
+/* drvVSAMShm.c - Shared-memory export of VSAM snapshots
+ *
+ *	VSAM_shm_export(name,depth) publishes the snapshots of all
+ *	configured cards in the POSIX shared-memory segment name, eg.
+ *	"/vsam", so that other processes on the same host can read
+ *	them at the full acquisition rate without Channel Access.
+ *	Call it after the cards are configured.  Linux only.
+ *
+ *	The layout is described by VSAMSHMHDR in VSAM.h.  After the
+ *	header come ncards card areas of card_size bytes each: a
+ *	VSAMSHMCARD followed by a ring of depth VSAMSHMSLOTs holding
+ *	the last depth snapshots of the card.  The newest snapshot is
+ *	in slot (count-1) % depth.  Readers must check magic and
+ *	version, and use the sizes in the header rather than sizeof.
+ *
+ *	Each slot is a seqlock: its seq is odd while the slot is
+ *	being written.  A reader copies a slot with
+ *
+ *	    do {
+ *	       s1 = slot->seq;  barrier();
+ *	       copy = *slot;    barrier();
+ *	       s2 = slot->seq;
+ *	    } while ( (s1&1) || (s1!=s2) );
+ *
+ *	The writer never waits for readers.  Slots are written from
+ *	the snapshot subscription (drvVSAMSub.c) of each card.
+ */
+
+#include        <stdlib.h>
+#include        <string.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include	"VSAM.h"           /* VSAMSHMHDR, etc      */
+#include        "epicsExport.h"
+
+#ifdef __linux__
+#include        <fcntl.h>
+#include        <unistd.h>
+#include        <sys/mman.h>
+#endif
+
+#define SHM_MAX_DEPTH  4096
+
+#if defined(__GNUC__) && ((__GNUC__>4) || ((__GNUC__==4) && (__GNUC_MINOR__>=1)))
+#define SHM_BARRIER()  __sync_synchronize()
+#else
+#define SHM_BARRIER()
+#endif
+
+/* Local variables */
+static char           *shm_base  = NULL;
+static char           *shm_name  = NULL;
+static unsigned long   shm_size  = 0;
+
+static void VSAM_shm_write( void *arg,short card,const VSAMSNAP *psnap,
+                            unsigned long dmask,unsigned long rmask,unsigned long amask );
+
+/*
+ * VSAM_shm_export - create the segment and start publishing
+ */
+long VSAM_shm_export( const char *name,int depth )
+{
+#ifdef __linux__
+    VSAMSHMHDR   *phdr;
+    VSAMSHMCARD  *pshc;
+    VSAM_ID       pcard;
+    unsigned long ncards,card_size,i;
+    void         *base;
+    int           fd;
+
+    if ( shm_base ) {
+       errlogPrintf("VSAM_shm_export: already exporting to %s\n",shm_name);
+       return(ERROR);
+    }
+    if ( !name || (name[0]!='/') || (depth<1) || (depth>SHM_MAX_DEPTH) ) {
+       errlogPrintf("VSAM_shm_export: need a name such as /vsam and depth 1..%d\n",SHM_MAX_DEPTH);
+       return(ERROR);
+    }
+    for (ncards=0,pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) ncards++;
+    if ( !ncards ) {
+       errlogPrintf("VSAM_shm_export: no cards configured\n");
+       return(ERROR);
+    }
+
+    card_size = sizeof(VSAMSHMCARD) + depth*sizeof(VSAMSHMSLOT);
+    shm_size  = sizeof(VSAMSHMHDR) + ncards*card_size;
+    fd = shm_open( name,O_CREAT|O_RDWR,0644 );
+    if ( fd<0 ) {
+       errlogPrintf("VSAM_shm_export: can't open %s\n",name);
+       return(ERROR);
+    }
+    if ( ftruncate(fd,(off_t)shm_size) ) {
+       errlogPrintf("VSAM_shm_export: can't size %s to %lu bytes\n",name,shm_size);
+       close( fd );
+       return(ERROR);
+    }
+    base = mmap( NULL,shm_size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0 );
+    close( fd );
+    if ( base==MAP_FAILED ) {
+       errlogPrintf("VSAM_shm_export: can't map %s\n",name);
+       return(ERROR);
+    }
+
+    /* readers wait for the magic number, so it goes in last */
+    memset( base,0,shm_size );
+    phdr = (VSAMSHMHDR *)base;
+    phdr->version   = VSAM_SHM_VERSION;
+    phdr->hdr_size  = sizeof(VSAMSHMHDR);
+    phdr->card_size = card_size;
+    phdr->slot_size = sizeof(VSAMSHMSLOT);
+    phdr->ncards    = ncards;
+    phdr->depth     = depth;
+    for (i=0,pcard=VSAM_next_card(NULL); pcard; i++,pcard=VSAM_next_card(pcard)) {
+       pshc = (VSAMSHMCARD *)((char *)base + sizeof(VSAMSHMHDR) + i*card_size);
+       pshc->card = pcard->card;
+    }
+    SHM_BARRIER();
+    phdr->magic = VSAM_SHM_MAGIC;
+
+    shm_base = (char *)base;
+    shm_name = epicsStrDup( name );
+    for (i=0,pcard=VSAM_next_card(NULL); pcard; i++,pcard=VSAM_next_card(pcard)) {
+       pshc = (VSAMSHMCARD *)(shm_base + sizeof(VSAMSHMHDR) + i*card_size);
+       if ( VSAM_subscribe(pcard->card,0,VSAM_shm_write,pshc)==ERROR )
+          errlogPrintf("VSAM_shm_export: card %hd not exported\n",pcard->card);
+    }
+    return(OK);
+#else
+    errlogPrintf("VSAM_shm_export: shared memory not supported here\n");
+    return(ERROR);
+#endif
+}
+
+/*
+ * VSAM_shm_write - copy a new snapshot into the next slot of a card
+ *
+ *  Called through the subscription of the card, with the card
+ *  locked, so there is one writer per card area.
+ */
+static void VSAM_shm_write( void *arg,short card,const VSAMSNAP *psnap,
+                            unsigned long dmask,unsigned long rmask,unsigned long amask )
+{
+    VSAMSHMHDR   *phdr = (VSAMSHMHDR *)shm_base;
+    VSAMSHMCARD  *pshc = (VSAMSHMCARD *)arg;
+    VSAMSHMSLOT  *pslot;
+    short         i;
+
+    pslot = (VSAMSHMSLOT *)((char *)pshc + sizeof(VSAMSHMCARD)) + (pshc->count % phdr->depth);
+    pslot->seq++;
+    SHM_BARRIER();
+    pslot->sec    = psnap->stamp.secPastEpoch;
+    pslot->nsec   = psnap->stamp.nsec;
+    pslot->status = psnap->status;
+    pslot->dmask  = dmask;
+    pslot->rmask  = rmask;
+    pslot->amask  = amask;
+    for (i=0; i<VSAM_NUM_CHANS; i++)   pslot->data[i]  = psnap->data[i];
+    for (i=0; i<VSAM_NUM_CHANS/4; i++) pslot->range[i] = psnap->range[i];
+    for (i=0; i<VSAM_NUM_CHANS/2; i++) pslot->ac[i]    = psnap->ac[i];
+    SHM_BARRIER();
+    pslot->seq++;
+    pshc->count++;
+}
+
+/*
+ * VSAM_shm_report - print the shared-memory export
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_shm_report( void )
+{
+    VSAMSHMHDR   *phdr = (VSAMSHMHDR *)shm_base;
+    VSAMSHMCARD  *pshc;
+    unsigned long i;
+
+    if ( !shm_base ) return;
+    printf("VSAM shared memory %s: %lu bytes, %lu cards, %lu deep, layout %lu\n",
+           shm_name,shm_size,(unsigned long)phdr->ncards,(unsigned long)phdr->depth,
+           (unsigned long)phdr->version);
+    for (i=0; i<phdr->ncards; i++) {
+       pshc = (VSAMSHMCARD *)(shm_base + phdr->hdr_size + i*phdr->card_size);
+       printf("\tcard %lu: %lu snapshots\n",(unsigned long)pshc->card,(unsigned long)pshc->count);
+    }
+}
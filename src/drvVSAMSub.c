@@ -0,0 +1,165 @@
+/* drvVSAMSub.c - In-process subscribers to VSAM snapshots
+ *
+ *	Other drivers and sequencers in the IOC can get each new
+ *	snapshot of a card without going through records:
+ *
+ *	    id = VSAM_subscribe(card,mask,func,arg);
+ *
+ *	calls func(arg,card,psnap,dmask,rmask,amask) after every
+ *	acquisition that read a data channel in mask, or after every
+ *	acquisition at all if mask is 0.  psnap points at the snapshot
+ *	of the card itself, not a copy: it is read-only and only good
+ *	until func returns.  dmask, rmask and amask are the channels
+ *	just read; the rest of the snapshot is from earlier reads.
+ *
+ *	func is called by the task that did the acquisition, with the
+ *	card locked and after averaging, filtering and derived channels
+ *	have been updated.  It must not block or take long, as it holds
+ *	up the acquisition of the card and every record reading it.
+ *
+ *	Consumers that poll instead use VSAM_snap_lock(), which locks
+ *	the card and gives the same read-only pointer along with the
+ *	snapshot count, and VSAM_snap_unlock() when done.
+ *
+ *	VSAM_unsubscribe(card,id) removes a subscriber.
+ */
+
+#include        <stdlib.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include	"VSAM.h"           /* VSAMSUBS, etc        */
+#include        "epicsExport.h"
+
+/*
+ * VSAM_subscribe - call func after each new snapshot of a card
+ *
+ *  Returns the subscriber id, or ERROR if the card is unknown
+ *  or already has VSAM_SUB_MAX subscribers.
+ */
+int VSAM_subscribe( short card,unsigned long mask,VSAM_SUB_FUNC func,void *arg )
+{
+    VSAM_ID    pcard = NULL;
+    VSAMSUBS  *psubs = NULL;
+    int        id;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !func ) {
+       errlogPrintf("VSAM_subscribe: bad card %hd or no function\n",card);
+       return(ERROR);
+    }
+
+    if ( !pcard->psubs ) {
+       psubs = callocMustSucceed( 1,sizeof(VSAMSUBS),"VSAM_subscribe" );
+       epicsMutexMustLock( pcard->lock );
+       if ( !pcard->psubs ) pcard->psubs = psubs;
+       else free( psubs );
+       epicsMutexUnlock( pcard->lock );
+    }
+    psubs = pcard->psubs;
+
+    epicsMutexMustLock( pcard->lock );
+    for (id=0; (id<VSAM_SUB_MAX) && psubs->sub[id].func; id++);
+    if ( id<VSAM_SUB_MAX ) {
+       psubs->sub[id].mask  = mask;
+       psubs->sub[id].arg   = arg;
+       psubs->sub[id].calls = 0;
+       psubs->sub[id].func  = func;
+       psubs->nsub++;
+    }
+    epicsMutexUnlock( pcard->lock );
+
+    if ( id>=VSAM_SUB_MAX ) {
+       errlogPrintf("VSAM_subscribe: card %hd already has %d subscribers\n",card,VSAM_SUB_MAX);
+       return(ERROR);
+    }
+    return(id);
+}
+
+/*
+ * VSAM_unsubscribe - remove a subscriber
+ *
+ *  Once this returns func is no longer called.
+ */
+long VSAM_unsubscribe( short card,int id )
+{
+    VSAM_ID  pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->psubs || (id<0) || (id>=VSAM_SUB_MAX) ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    if ( pcard->psubs->sub[id].func ) {
+       pcard->psubs->sub[id].func = NULL;
+       pcard->psubs->nsub--;
+    }
+    epicsMutexUnlock( pcard->lock );
+    return(OK);
+}
+
+/*
+ * VSAM_sub_notify - call the subscribers of a new snapshot
+ *
+ *  Called by VSAM_acquire_mask() with the card locked.
+ */
+void VSAM_sub_notify( VSAM_ID pcard,unsigned long dmask,unsigned long rmask,unsigned long amask )
+{
+    VSAMSUB  *psub;
+    int       id;
+
+    for (id=0,psub=pcard->psubs->sub; id<VSAM_SUB_MAX; id++,psub++) {
+       if ( !psub->func ) continue;
+       if ( psub->mask && !(psub->mask & dmask) ) continue;
+       psub->calls++;
+       (*psub->func)( psub->arg,pcard->card,&pcard->snap,dmask,rmask,amask );
+    }
+}
+
+/*
+ * VSAM_snap_lock - lock a card and point at its last snapshot
+ *
+ *  *pcount, if given, is the number of snapshots taken so far, so
+ *  a poller can tell whether there is a new one.  Every successful
+ *  call must be followed by VSAM_snap_unlock().
+ */
+int VSAM_snap_lock( short card,const VSAMSNAP **ppsnap,unsigned long *pcount )
+{
+    VSAM_ID  pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present || !ppsnap ) return(ERROR);
+
+    epicsMutexMustLock( pcard->lock );
+    *ppsnap = &pcard->snap;
+    if ( pcount ) *pcount = pcard->stats.snapshots;
+    return(OK);
+}
+
+/*
+ * VSAM_snap_unlock - release a card locked by VSAM_snap_lock()
+ */
+void VSAM_snap_unlock( short card )
+{
+    VSAM_ID  pcard = NULL;
+
+    pcard = VSAM_getByCard( card );
+    if ( pcard ) epicsMutexUnlock( pcard->lock );
+}
+
+/*
+ * VSAM_sub_report - print the subscribers of a card
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_sub_report( VSAM_ID pcard )
+{
+    VSAMSUB  *psub;
+    int       id;
+
+    epicsMutexMustLock( pcard->lock );
+    for (id=0,psub=pcard->psubs->sub; id<VSAM_SUB_MAX; id++,psub++) {
+       if ( !psub->func ) continue;
+       printf("\tsubscriber %d: func %p arg %p  mask 0x%08lx  %lu calls\n",
+              id,(void *)psub->func,psub->arg,psub->mask,psub->calls);
+    }
+    epicsMutexUnlock( pcard->lock );
+}
@@ -0,0 +1,111 @@
+/* drvVSAMTrace.c - Event trace for the VSAM driver
+ *
+ *	A fixed-size ring of timestamped driver events (configuration,
+ *	probe, clear, firmware read, calibration, resets, mode writes,
+ *	cards left out).  Recording an event takes a slot with one
+ *	atomic increment and fills it in, and stamps it with the CPU
+ *	cycle counter, so it is cheap enough to stay enabled in
+ *	production.  Set VSAM_TRACE to 0 to disable.
+ */
+
+#include        "dbDefs.h"
+#include        "epicsInterrupt.h" /* epicsInterruptLock() */
+#include	"VSAM.h"           /* VSAMTRACE, etc       */
+#include        "epicsExport.h"
+
+/* Global variables */
+int     VSAM_TRACE = 1;
+
+/* Local variables */
+static VSAMTRACE      trace_ring[VSAM_TRACE_SIZE];
+static unsigned long  trace_next = 0;    /* total events recorded */
+
+static const char *traceName_c[VSAM_NUM_TRC_EVENTS] = {
+    "?", "config", "init", "probe", "clear", "fw read", "calibrate",
+    "calib try", "reset", "mode write", "diag", "quarantine", "bus error",
+    "scan settle" };
+
+#if defined(__GNUC__) && ((__GNUC__>4) || ((__GNUC__==4) && (__GNUC_MINOR__>=1)))
+#define TRACE_CLAIM()  __sync_fetch_and_add( &trace_next,1 )
+#else
+static unsigned long TRACE_CLAIM( void )
+{
+    int            key;
+    unsigned long  n;
+
+    key = epicsInterruptLock();
+    n   = trace_next++;
+    epicsInterruptUnlock( key );
+    return(n);
+}
+#endif
+
+/*
+ * VSAM_trace - record one event
+ */
+void VSAM_trace( short card,unsigned short event,unsigned long arg )
+{
+    VSAMTRACE  *ptrc;
+
+    if ( !VSAM_TRACE ) return;
+    ptrc = &trace_ring[ TRACE_CLAIM() & (VSAM_TRACE_SIZE-1) ];
+    ptrc->sec   = VSAM_clock_sec();
+    ptrc->card  = card;
+    ptrc->event = event;
+    ptrc->arg   = arg;
+}
+
+/*
+ * VSAM_trace_dump - print per-phase durations for a card, or for all
+ *                   cards if card is negative.  Level 1 adds the
+ *                   list of events, oldest first.
+ */
+long VSAM_trace_dump( short card,int level )
+{
+    unsigned long   n,first,last,k;
+    unsigned short  phase;
+    double          dt;
+    char            time_c[32];
+    epicsTimeStamp  stamp;
+    VSAMTRACE      *ptrc,*pbeg;
+
+    last  = trace_next;
+    first = (last>VSAM_TRACE_SIZE) ? last-VSAM_TRACE_SIZE : 0;
+    printf("VSAM trace: %lu events recorded, %lu kept\n",last,last-first);
+
+    for (n=first; n<last; n++) {
+      ptrc  = &trace_ring[ n & (VSAM_TRACE_SIZE-1) ];
+      phase = ptrc->event & ~VSAM_TRC_END;
+      if ( ((card>=0) && (ptrc->card!=card)) || (phase>=VSAM_NUM_TRC_EVENTS) ) continue;
+
+      if ( level>0 ) {
+        VSAM_clock_wall( ptrc->sec,&stamp );
+        epicsTimeToStrftime( time_c,sizeof(time_c),"%H:%M:%S.%06f",&stamp );
+        printf("  %s card %2hd %-10s %-5s arg 0x%lx\n",
+               time_c,ptrc->card,traceName_c[phase],
+               (ptrc->event & VSAM_TRC_END) ? "end" : "",ptrc->arg);
+      }
+
+      /* find the matching begin for the end of a phase */
+      if ( !(ptrc->event & VSAM_TRC_END) ) continue;
+      for (k=n; k-- > first; ) {
+        pbeg = &trace_ring[ k & (VSAM_TRACE_SIZE-1) ];
+        if ( (pbeg->card==ptrc->card) && (pbeg->event==phase) ) {
+          dt = ptrc->sec - pbeg->sec;
+          printf("    card %2hd %-10s took %10.6f sec\n",ptrc->card,traceName_c[phase],dt);
+          break;
+        }
+      }
+    }
+    return(OK);
+}
+
+/*
+ * VSAM_trace_reset - forget all recorded events
+ */
+long VSAM_trace_reset( void )
+{
+    trace_next = 0;
+    memset( trace_ring,0,sizeof(trace_ring) );
+    return(OK);
+}
@@ -0,0 +1,285 @@
+/* drvVSAMTrend.c - Min/max/mean trend pyramid of VSAM channels
+ *
+ *	VSAM_trend_config(card,depth) keeps, for every data channel
+ *	of a card, the min, max and mean over 1 sec, 10 sec, 1 min
+ *	and 10 min buckets, the last depth buckets of each.  Buckets
+ *	start on whole multiples of their period.  Every sample read
+ *	goes into the open 1 sec bucket; when a bucket closes it is
+ *	merged into the open bucket of the next level, so each level
+ *	costs one merge per bucket of the level below, and a spike of
+ *	one sample shows in the max of every level.
+ *
+ *	Waveforms read one level, oldest bucket first, with parm M,
+ *	the level (0-3) and N, X or A for min, max or mean:
+ *
+ *	    #C0 S5 @M2X     card 0 channel 5, max over 1 min buckets
+ *	    #C0 S32 @M2     card 0, 1 min bucket start times, sec
+ *	                    before now
+ *
+ *	They are posted through I/O Intr when a bucket of their level
+ *	closes.  A channel with no sample in a bucket reads NaN.  The
+ *	open bucket is closed by the first sample after its period, or
+ *	by VSAM_trend_tick(), which the scheduler calls on every pass
+ *	of the card and the trigger task about once a second, so the
+ *	trends keep moving if the card stops answering.  Buckets that
+ *	went by with no sample and no tick are closed then too, each
+ *	holding NaN, so the start times stay one period apart.  Call
+ *	VSAM_trend_config() before iocInit.
+ *
+ *	All trend state is guarded by the card lock.  Samples are
+ *	taken by VSAM_acquire_mask() with the lock held.
+ */
+
+#include        <stdlib.h>
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include        "dbScan.h"         /* scanIoRequest()      */
+#include        "epicsMath.h"      /* epicsNAN             */
+#include	"VSAM.h"           /* VSAMTREND, etc       */
+#include        "epicsExport.h"
+
+static const unsigned long trendPeriod_c[VSAM_TREND_LEVELS] = { 1, 10, 60, 600 };
+
+static void VSAM_trend_merge( VSAMTREND *ptrend,int level,unsigned long start,const VSAMTRENDBIN *pb );
+static void VSAM_trend_gap( VSAMTREND *ptrend,int level,unsigned long sec );
+static void VSAM_trend_close( VSAMTREND *ptrend,int level );
+static void VSAM_trend_post( VSAMTREND *ptrend );
+
+/*
+ * VSAM_trend_config - keep depth buckets per level for a card
+ */
+long VSAM_trend_config( short card,int depth )
+{
+    VSAM_ID     pcard = NULL;
+    VSAMTREND  *ptrend = NULL;
+    int         level;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || (depth<1) || (depth>VSAM_TREND_MAX) ) {
+       errlogPrintf("VSAM_trend_config: bad card %hd or depth (1..%d)\n",card,VSAM_TREND_MAX);
+       return(ERROR);
+    }
+    if ( pcard->ptrend ) {
+       errlogPrintf("VSAM_trend_config: card %hd already has trends\n",card);
+       return(ERROR);
+    }
+
+    ptrend = callocMustSucceed( 1,sizeof(VSAMTREND),"VSAM_trend_config" );
+    ptrend->depth = depth;
+    for (level=0; level<VSAM_TREND_LEVELS; level++) {
+       ptrend->lvl[level].period = trendPeriod_c[level];
+       ptrend->lvl[level].min    = callocMustSucceed( depth*VSAM_NUM_CHANS,sizeof(float),"VSAM_trend_config" );
+       ptrend->lvl[level].max    = callocMustSucceed( depth*VSAM_NUM_CHANS,sizeof(float),"VSAM_trend_config" );
+       ptrend->lvl[level].mean   = callocMustSucceed( depth*VSAM_NUM_CHANS,sizeof(float),"VSAM_trend_config" );
+       ptrend->lvl[level].start  = callocMustSucceed( depth,sizeof(epicsUInt32),"VSAM_trend_config" );
+       scanIoInit( &ptrend->lvl[level].ioscan );
+    }
+
+    epicsMutexMustLock( pcard->lock );
+    pcard->ptrend = ptrend;
+    epicsMutexUnlock( pcard->lock );
+    return(OK);
+}
+
+/*
+ * VSAM_trend_sample - add the data just read to the 1 sec buckets
+ *
+ *  Called by VSAM_acquire_mask() with the card locked.
+ */
+void VSAM_trend_sample( VSAM_ID pcard,unsigned long dmask )
+{
+    VSAMTREND      *ptrend = pcard->ptrend;
+    VSAMTRENDLVL   *plvl = &ptrend->lvl[0];
+    VSAMTRENDBIN   *pb;
+    unsigned long   sec;
+    float           val;
+    short           chan;
+
+    if ( pcard->snap.status & FIRMWARE_REV ) return;
+    sec = pcard->snap.stamp.secPastEpoch;
+    /* read before a tick that opened the next bucket */
+    if ( plvl->open && (sec<plvl->open_sec) ) sec = plvl->open_sec;
+    VSAM_trend_gap( ptrend,0,sec );
+    for (chan=0; dmask && (chan<VSAM_NUM_CHANS); chan++) {
+       if ( !(dmask & (1UL<<chan)) ) continue;
+       dmask &= ~(1UL<<chan);
+       val = pcard->snap.data[chan];
+       pb  = &plvl->bucket[chan];
+       if ( !pb->n || (val<pb->min) ) pb->min = val;
+       if ( !pb->n || (val>pb->max) ) pb->max = val;
+       pb->sum += val;
+       pb->n++;
+    }
+    VSAM_trend_post( ptrend );
+}
+
+/*
+ * VSAM_trend_tick - close the buckets of a card whose period is over
+ */
+void VSAM_trend_tick( VSAM_ID pcard )
+{
+    VSAMTREND      *ptrend = pcard->ptrend;
+    epicsTimeStamp  now;
+
+    epicsMutexMustLock( pcard->lock );
+    epicsTimeGetCurrent( &now );
+    /* nothing to close before the first sample */
+    if ( ptrend->lvl[0].open && (now.secPastEpoch>ptrend->lvl[0].open_sec) ) {
+       VSAM_trend_gap( ptrend,0,now.secPastEpoch );
+       VSAM_trend_post( ptrend );
+    }
+    epicsMutexUnlock( pcard->lock );
+}
+
+/*
+ * VSAM_trend_gap - close the open bucket of a level, and an empty
+ *                  one for each period after it up to the bucket
+ *                  holding sec, which is left open
+ */
+static void VSAM_trend_gap( VSAMTREND *ptrend,int level,unsigned long sec )
+{
+    VSAMTRENDLVL   *plvl = &ptrend->lvl[level];
+    unsigned long   n,next;
+
+    sec -= sec%plvl->period;
+    if ( plvl->open && (plvl->open_sec==sec) ) return;
+    if ( plvl->open && (plvl->open_sec<sec) ) {
+       next = plvl->open_sec + plvl->period;
+       VSAM_trend_close( ptrend,level );
+       /* no more than the ring holds; the level above fills the rest */
+       n = (sec-next)/plvl->period;
+       if ( n>ptrend->depth ) {
+          next += (n-ptrend->depth)*plvl->period;
+          n = ptrend->depth;
+       }
+       for (; n; n--,next+=plvl->period) {
+          plvl->open_sec = next;
+          VSAM_trend_close( ptrend,level );
+       }
+    }
+    else if ( plvl->open ) VSAM_trend_close( ptrend,level );
+    plvl->open_sec = sec;
+    plvl->open     = 1;
+}
+
+/*
+ * VSAM_trend_close - store the open bucket of a level in its ring,
+ *                    merge it into the level above and empty it
+ */
+static void VSAM_trend_close( VSAMTREND *ptrend,int level )
+{
+    VSAMTRENDLVL   *plvl = &ptrend->lvl[level];
+    VSAMTRENDBIN   *pb;
+    unsigned long   slot;
+    short           chan;
+
+    slot = plvl->head*VSAM_NUM_CHANS;
+    for (chan=0,pb=plvl->bucket; chan<VSAM_NUM_CHANS; chan++,pb++) {
+       if ( pb->n ) {
+          plvl->min[slot+chan]  = pb->min;
+          plvl->max[slot+chan]  = pb->max;
+          plvl->mean[slot+chan] = (float)(pb->sum/pb->n);
+       }
+       else plvl->min[slot+chan] = plvl->max[slot+chan] = plvl->mean[slot+chan] = epicsNAN;
+    }
+    plvl->start[plvl->head] = plvl->open_sec;
+    plvl->head = (plvl->head+1) % ptrend->depth;
+    if ( plvl->count<ptrend->depth ) plvl->count++;
+
+    if ( level+1<VSAM_TREND_LEVELS ) VSAM_trend_merge( ptrend,level+1,plvl->open_sec,plvl->bucket );
+    for (chan=0,pb=plvl->bucket; chan<VSAM_NUM_CHANS; chan++,pb++) {
+       pb->n   = 0;
+       pb->sum = 0.0;
+    }
+    plvl->open = 0;
+    ptrend->closed |= (1UL<<level);
+}
+
+/*
+ * VSAM_trend_post - post the levels that closed a bucket, once
+ *                   however many closed
+ */
+static void VSAM_trend_post( VSAMTREND *ptrend )
+{
+    int  level;
+
+    for (level=0; ptrend->closed && (level<VSAM_TREND_LEVELS); level++) {
+       if ( !(ptrend->closed & (1UL<<level)) ) continue;
+       ptrend->closed &= ~(1UL<<level);
+       scanIoRequest( ptrend->lvl[level].ioscan );
+    }
+}
+
+/*
+ * VSAM_trend_merge - add a closed bucket starting at start to the
+ *                    open bucket of a level
+ */
+static void VSAM_trend_merge( VSAMTREND *ptrend,int level,unsigned long start,const VSAMTRENDBIN *pb )
+{
+    VSAMTRENDLVL   *plvl = &ptrend->lvl[level];
+    VSAMTRENDBIN   *pm;
+    short           chan;
+
+    VSAM_trend_gap( ptrend,level,start );
+    for (chan=0,pm=plvl->bucket; chan<VSAM_NUM_CHANS; chan++,pm++,pb++) {
+       if ( !pb->n ) continue;
+       if ( !pm->n || (pb->min<pm->min) ) pm->min = pb->min;
+       if ( !pm->n || (pb->max>pm->max) ) pm->max = pb->max;
+       pm->sum += pb->sum;
+       pm->n   += pb->n;
+    }
+}
+
+/*
+ * VSAM_get_trend - copy out the buckets of one level, oldest first
+ *
+ *  chan VSAM_NUM_CHANS gives the bucket start times in seconds
+ *  before now.  stat is 'N' (min), 'X' (max) or 'A' (mean).  If
+ *  there are more buckets than nmax, the newest nmax are given.
+ */
+int VSAM_get_trend( short card,short level,short chan,char stat,
+                    double *pval,unsigned long nmax,unsigned long *pnval )
+{
+    VSAM_ID         pcard = NULL;
+    VSAMTRENDLVL   *plvl;
+    float          *pstat;
+    epicsTimeStamp  now;
+    unsigned long   n,nval,slot,depth;
+
+    pcard = VSAM_getByCard( card );
+    if ( !pcard || !pcard->present || !pcard->ptrend ) return(ERROR);
+    if ( (level<0) || (level>=VSAM_TREND_LEVELS) || (chan<0) || (chan>VSAM_NUM_CHANS) ) return(ERROR);
+
+    epicsTimeGetCurrent( &now );
+    epicsMutexMustLock( pcard->lock );
+    plvl  = &pcard->ptrend->lvl[level];
+    depth = pcard->ptrend->depth;
+    pstat = (stat=='N') ? plvl->min : (stat=='X') ? plvl->max : plvl->mean;
+    nval  = (plvl->count<nmax) ? plvl->count : nmax;
+    slot  = (plvl->head + depth - nval) % depth;
+    for (n=0; n<nval; n++,slot=(slot+1)%depth) {
+       if ( chan==VSAM_NUM_CHANS ) pval[n] = (double)plvl->start[slot] - (double)now.secPastEpoch;
+       else pval[n] = pstat[slot*VSAM_NUM_CHANS+chan];
+    }
+    epicsMutexUnlock( pcard->lock );
+    *pnval = nval;
+    return(OK);
+}
+
+/*
+ * VSAM_trend_report - print the trend levels of a card
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_trend_report( VSAM_ID pcard )
+{
+    VSAMTREND  *ptrend = pcard->ptrend;
+    int         level;
+
+    epicsMutexMustLock( pcard->lock );
+    printf("\ttrends: %lu buckets of",ptrend->depth);
+    for (level=0; level<VSAM_TREND_LEVELS; level++)
+       printf(" %lu sec (%lu kept)%s",ptrend->lvl[level].period,ptrend->lvl[level].count,
+              (level<VSAM_TREND_LEVELS-1) ? "," : "\n");
+    epicsMutexUnlock( pcard->lock );
+}
@@ -0,0 +1,242 @@
+/* drvVSAMTrig.c - Triggered snapshot of all VSAM cards
+ *
+ *	VSAM_trigger() wakes a high priority task that reads every
+ *	card enabled with VSAM_trig_enable() back-to-back, so all
+ *	channels are sampled as close together in time as the bus
+ *	allows.  Every snapshot is stamped with the time of the
+ *	trigger and I/O Intr is posted for the channels read.
+ *
+ *	The trigger can come from iocsh, from code, or from a bo
+ *	record writing signal TRIGGER_CHANNEL of any card, eg. with
+ *	SCAN "Event" to follow an EPICS event:
+ *
+ *	    record(bo,"$(S):VSAM:TRIG") {
+ *	        field(DTYP,"VSAM")
+ *	        field(SCAN,"Event")
+ *	        field(EVNT,"$(EVNT)")
+ *	        field(OUT,"#C0 S36 @")
+ *	    }
+ *
+ *	The snapshot taken for a trigger is kept apart from the one
+ *	the scheduler refreshes, stamped with the time of the trigger,
+ *	and channels of a triggered card are read from it; ai records
+ *	with TSE = -2 take their time stamp from it.  For each trigger
+ *	the time from the trigger to each card and the skew from the
+ *	first card started to the last card done are kept.  These and
+ *	the trigger itself are driver-wide, see db/vsam_trig.db.
+ */
+
+#include        "dbDefs.h"
+#include        "errlog.h"         /* errlogPrintf()       */
+#include        "dbScan.h"         /* scanIoRequest()      */
+#include	"VSAM.h"           /* VSAM_trigger, etc    */
+#include        "epicsExport.h"
+
+#define TRIG_TICK      1.0         /* sec without a trigger to tick trends */
+
+/* Local variables */
+static epicsMutexId    trig_lock = NULL;
+static epicsEventId    trig_event = NULL;
+static epicsThreadId   trig_tid = NULL;
+static epicsTimeStamp  trig_stamp;         /* time of the last trigger */
+static unsigned long   trig_count = 0;     /* triggers served          */
+static unsigned long   trig_missed = 0;    /* came in while busy       */
+static unsigned long   trig_skew = 0;      /* usec, last trigger       */
+static unsigned long   trig_skew_max = 0;
+static int             trig_pending = 0;
+
+static void VSAM_trig_task( void *parm );
+static void VSAM_trig_masks( VSAM_ID pcard,unsigned long *pmask );
+
+/*
+ * VSAM_trig_enable - include a card (-1 for all cards) in the
+ *                    triggered snapshot, or take it out again.
+ *
+ *  Channels of an enabled card are read from the snapshot.
+ */
+long VSAM_trig_enable( short card,int enable )
+{
+    VSAM_ID  pcard = NULL;
+    int      found = 0;
+
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       if ( (card>=0) && (pcard->card!=card) ) continue;
+       pcard->triggered = enable ? 1 : 0;
+       found++;
+    }
+    if ( !found ) {
+       errlogPrintf("VSAM_trig_enable: card %hd not configured\n",card);
+       return(ERROR);
+    }
+    if ( !trig_lock ) trig_lock = epicsMutexMustCreate();
+
+    epicsMutexMustLock( trig_lock );
+    if ( !trig_tid ) {
+       trig_event = epicsEventMustCreate( epicsEventEmpty );
+       trig_tid   = epicsThreadCreate( "VSAMtrig",
+                                       epicsThreadPriorityHigh+1,
+                                       epicsThreadGetStackSize(epicsThreadStackMedium),
+                                       VSAM_trig_task,
+                                       NULL );
+       if ( !trig_tid ) {
+          epicsMutexUnlock( trig_lock );
+          errlogPrintf("VSAM_trig_enable: cannot start trigger task\n");
+          return(ERROR);
+       }
+    }
+    epicsMutexUnlock( trig_lock );
+    return(OK);
+}
+
+/*
+ * VSAM_trigger - take a synchronized snapshot of the enabled cards
+ *
+ *  Only stamps the trigger and wakes the trigger task, so it can
+ *  be called from a record.  A trigger arriving while the last
+ *  one is still being served is counted as missed.
+ */
+long VSAM_trigger( void )
+{
+    epicsTimeStamp  now;
+
+    if ( !trig_tid ) return(ERROR);
+
+    epicsTimeGetCurrent( &now );
+    epicsMutexMustLock( trig_lock );
+    if ( trig_pending ) trig_missed++;
+    else {
+       trig_stamp   = now;
+       trig_pending = 1;
+    }
+    epicsMutexUnlock( trig_lock );
+    epicsEventSignal( trig_event );
+    return(OK);
+}
+
+/*
+ * VSAM_trig_task - serve the triggers
+ */
+static void VSAM_trig_task( void *parm )
+{
+    VSAM_ID         pcard = NULL;
+    epicsTimeStamp  stamp,first,last;
+    unsigned long   skew,mask[3];
+    int             n;
+
+    for (;;) {
+       if ( epicsEventWaitWithTimeout(trig_event,TRIG_TICK)!=epicsEventWaitOK ) {
+          /* no trigger, keep the trends of the cards moving */
+          for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard))
+             if ( pcard->triggered && pcard->present && pcard->ptrend ) VSAM_trend_tick( pcard );
+          continue;
+       }
+
+       epicsMutexMustLock( trig_lock );
+       stamp = trig_stamp;
+       epicsMutexUnlock( trig_lock );
+
+       /* wait for the bus budget of all cards before locking any */
+       for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+          if ( !pcard->triggered || !pcard->present ) continue;
+          VSAM_trig_masks( pcard,mask );
+          VSAM_bus_claim( pcard,VSAM_acquire_words(mask[0],mask[1],mask[2]) );
+       }
+
+       /* read all cards first, post the records afterwards */
+       n = 0;
+       epicsTimeGetCurrent( &first );
+       for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+          if ( !pcard->triggered || !pcard->present ) continue;
+          /* the lock nests, so no scheduled pass gets in between */
+          epicsMutexMustLock( pcard->lock );
+          VSAM_trig_masks( pcard,mask );
+          if ( VSAM_acquire_claimed(pcard,mask[0],mask[1],mask[2])==OK ) {
+             pcard->stats.trig_usec = (unsigned long)(1.0e6*epicsTimeDiffInSeconds(&pcard->snap.stamp,&stamp));
+             pcard->trig_snap = pcard->snap;
+             pcard->trig_snap.stamp = stamp;
+          }
+          epicsMutexUnlock( pcard->lock );
+          n++;
+       }
+       epicsTimeGetCurrent( &last );
+       skew = (unsigned long)(1.0e6*epicsTimeDiffInSeconds(&last,&first));
+
+       epicsMutexMustLock( trig_lock );
+       trig_count++;
+       trig_skew = skew;
+       if ( skew>trig_skew_max ) trig_skew_max = skew;
+       trig_pending = 0;
+       epicsMutexUnlock( trig_lock );
+
+       if ( !n ) continue;
+       for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+          short  chan;
+
+          if ( !pcard->triggered || !pcard->present ) continue;
+          for (chan=0; chan<VSAM_NUM_CHANS; chan++) {
+             if ( pcard->use.data_mask  & (1UL<<chan) ) scanIoRequest( pcard->ioscan[VSAM_IDX_DATA][chan] );
+             if ( pcard->use.range_mask & (1UL<<chan) ) scanIoRequest( pcard->ioscan[VSAM_IDX_RANGE][chan] );
+             if ( pcard->use.ac_mask    & (1UL<<chan) ) scanIoRequest( pcard->ioscan[VSAM_IDX_AC][chan] );
+          }
+       }
+    }
+}
+
+/*
+ * VSAM_trig_masks - data, range and AC words in use on one card,
+ *                   all of them if no record has registered
+ */
+static void VSAM_trig_masks( VSAM_ID pcard,unsigned long *pmask )
+{
+    VSAMUSE  *puse = &pcard->use;
+
+    if ( puse->data_mask || puse->range_mask || puse->ac_mask ) {
+        pmask[0] = puse->data_mask;
+        pmask[1] = puse->range_mask | puse->ac_mask;
+        pmask[2] = puse->ac_mask;
+    }
+    else pmask[0] = pmask[1] = pmask[2] = 0xffffffff;
+}
+
+/*
+ * VSAM_trig_stats - number of triggers and skew of the last one (usec)
+ */
+int VSAM_trig_stats( unsigned long *pcount,unsigned long *pskew )
+{
+    if ( !trig_lock ) {
+       if ( pcount ) *pcount = 0;
+       if ( pskew )  *pskew  = 0;
+       return(ERROR);
+    }
+    epicsMutexMustLock( trig_lock );
+    if ( pcount ) *pcount = trig_count;
+    if ( pskew )  *pskew  = trig_skew;
+    epicsMutexUnlock( trig_lock );
+    return(OK);
+}
+
+/*
+ * VSAM_trig_report - print the trigger statistics
+ *
+ * called by VSAM_io_report() if level is 3
+ */
+void VSAM_trig_report( void )
+{
+    VSAM_ID  pcard = NULL;
+    char     buf[40];
+
+    if ( !trig_tid ) {
+       printf("VSAM trigger: not enabled\n");
+       return;
+    }
+    epicsMutexMustLock( trig_lock );
+    epicsTimeToStrftime( buf,sizeof(buf),"%Y-%m-%d %H:%M:%S.%06f",&trig_stamp );
+    printf("VSAM trigger: %lu served  %lu missed  last %s\n",trig_count,trig_missed,buf);
+    printf("\tskew %lu usec  max %lu usec\n",trig_skew,trig_skew_max);
+    epicsMutexUnlock( trig_lock );
+
+    for (pcard=VSAM_next_card(NULL); pcard; pcard=VSAM_next_card(pcard)) {
+       if ( pcard->triggered )
+          printf("\tcard %hd: %lu usec after trigger\n",pcard->card,pcard->stats.trig_usec);
+    }
+}